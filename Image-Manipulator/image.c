@@ -1,4 +1,6 @@
 //This program takes in an image and perfoms simple visual effect operations on it, before the proccessed image is output to a new file.
+//Request POSIX functions (threads, clocks and memory mapping) alongside standard C
+#define _POSIX_C_SOURCE 200809L
 //Import standard libraries
 #include <stdio.h>
 #include <stdbool.h>
@@ -7,17 +9,39 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
+#include <pthread.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP 1
+#endif
+//Temporary files with names no other process is using (mkstemp), file identities (stat) and scratch directories for the tests (mkdtemp, from POSIX.1-2008 on)
+#if defined(_POSIX_VERSION) && _POSIX_VERSION >= 200809L
+#define HAVE_TEMPORARY_FILES 1
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 //Declaration of data type synonyms
 typedef unsigned char Byte;
 typedef int16_t Int2;
 typedef int32_t Int4;
 
+//Largest gradient a (normalised) Sobel kernel can produce: 4 * 255 / 9
+enum {MaxGradient = 113};
+
+//Convolution weights are fixed point numbers with this many fractional bits (a weight of 1 is 1 << WeightBits)
+//The largest kernel given on the command line is 15 by 15
+enum {WeightBits = 12, MaxKernelRadius = 7};
+
 //Useful global constants
 const Byte byteLength = 8;
 const Byte channels = 3;
 
-enum {Filetype1=0, Filetype2=1, Size=2, PixelDataIndex=10, Width=18, Height=22, BitsPerPixel=28, Compression=30};
+enum {Filetype1=0, Filetype2=1, Size=2, PixelDataIndex=10, InfoHeaderSize=14, Width=18, Height=22, Planes=26, BitsPerPixel=28, Compression=30, ImageSize=34, ColoursUsed=46};
 enum {inFile=1, outFile=2};
 const Byte kSize = 3;
 
@@ -32,10 +56,128 @@ struct ImageHeader{
     Int4 compression;
     Int4 colourDepth;
     Int4 pixelDataIndex;
+    Int4 paletteIndex;
+    Int4 colourCount;
 };
 
 typedef struct ImageHeader ImageHeader;
 
+//Pixel buffer object definition
+//Each colour channel is held in a plane of its own, so effects read every channel with unit stride
+//The 3 colour planes (blue, green, red) are followed by an alpha plane for 32 bit images, which only moves with the pixels
+//A palettized image instead has a single plane of colour indices
+//Every row of a plane starts on a 64 byte boundary and is padded up to %stride% bytes
+//A buffer can also be a view of some rows of another buffer, in which case it owns no memory
+struct PixelBuffer{
+    int height;
+    int width;
+    long stride;
+    Byte *planes[4];
+    Byte *memory;
+    int planeCount;
+};
+
+typedef struct PixelBuffer PixelBuffer;
+
+//Bitmap file object definition
+//When the file can be memory mapped its bytes are read and written in place through %mapping%
+//Otherwise %mapping% is NULL and the bytes go through the stdio stream
+struct BitmapFile{
+    FILE *stream;
+    Byte *mapping;
+    long size;
+};
+
+typedef struct BitmapFile BitmapFile;
+
+//Workspace object definition
+//The working memory for streaming an image, kept from one image to the next so a batch allocates it once per worker
+//It only grows, so after the largest image in a batch no more memory is allocated
+struct Workspace{
+    PixelBuffer band;
+    Byte *rawRows;
+    long rawSize;
+};
+
+typedef struct Workspace Workspace;
+
+//Magnitude of every Sobel gradient pair, filled by initialiseEdgeTable
+Byte edgeMagnitudes[MaxGradient + 1][MaxGradient + 1];
+
+//Convolution kernel object definition
+//A separable kernel holds 2 * %radius% + 1 weights, applied along the rows and then down the columns
+//Any other kernel holds a square of 2 * %radius% + 1 rows of 2 * %radius% + 1 weights
+//The weights are fixed point numbers with %shift% fractional bits, WeightBits unless that would take a weight past 16 bits
+struct Kernel{
+    int radius;
+    bool separable;
+    Int2 *weights;
+    int shift;
+};
+
+typedef struct Kernel Kernel;
+
+//Effect operation object definition
+//Holds a single step of the effect chain and its numeric parameter (0 if it takes none)
+//A kernel given on the command line is held in %kernel%
+//A resize holds the size it produces in %width% and %height%, either of which may be 0 to keep the aspect ratio
+struct Effect{
+    int type;
+    int param;
+    Byte *table;
+    Kernel *kernel;
+    int width;
+    int height;
+};
+
+typedef struct Effect Effect;
+
+//ToneOp is never parsed: it is a run of %param% tone effects composed by the plan into the 256 entry lookup table %table%
+//The %param% of KernelOp records which axes the kernel is mirrored in (MirrorRows, MirrorColumns), as flips are moved past it
+//The %param% of ResizeOp is the resampling filter
+//RemapOp is never parsed either: it is the histogram effect %param% once its tables have been counted, with each colour channel's 256 entries in turn in %table%
+enum {FlipXOp=1, FlipYOp, GreyscaleOp, InvertOp, EdgesOp, DarkenOp, BrightenOp, BlurOp, ToneOp, TransposeOp, Rotate90Op, GaussianOp, SharpenOp, KernelOp, ResizeOp, AutoLevelsOp, EqualizeOp, RemapOp};
+enum {MirrorRows=1, MirrorColumns=2};
+enum {BoxFilter=1, BilinearFilter, LanczosFilter};
+
+//Execution plan stage object definition
+//A stage is either a run of consecutive per-pixel effects fused into one sweep, or a single neighbourhood effect
+struct Stage{
+    bool fused;
+    int first;
+    int count;
+};
+
+typedef struct Stage Stage;
+
+//Command line options object definition
+struct Options{
+    int bandHeight;
+    bool explain;
+    int threadCount;
+    int benchmarkThreads;
+    bool benchmarkEdges;
+    bool useMapping;
+    int benchmarkIO;
+    bool batch;
+    bool benchmarkTone;
+    bool benchmarkSuite;
+    char *mipCache;
+};
+
+typedef struct Options Options;
+
+//Number of image rows processed at once per thread when streaming, unless overridden with --band
+const int defaultBandHeight = 256;
+//Unless overridden, a band is at least this many times the halo, since every pass of the chain recomputes the halo rows
+const int haloBandRatio = 16;
+const int maxThreads = 256;
+const int defaultBenchmarkMegabytes = 1000;
+//Largest width or height resize produces
+const int maxResize = 65536;
+//Largest factor resize shrinks by in one pass, which keeps the taps few enough for every fixed point weight to keep its precision
+const int maxShrink = 8;
+
 //IO FUNCTIONS
 
 //Safely opens a file
@@ -49,6 +191,15 @@ FILE *fopenCheck(const char fileName[], char mode[]){
     exit(1);
 }
 
+//Safely allocates memory
+//In case the allocation fails displays an error message and safely closes the program
+void *mallocCheck(size_t size){
+    void *p = malloc(size);
+    if (p != NULL || size == 0) return p;
+    fprintf(stderr, "Can't allocate %zu bytes\n", size);
+    exit(1);
+}
+
 //Packs 4 consecutive bytes in an array into a single 4 byte integer
 //Converts from little endian to big endian (LSB at lowest address)
 Int4 packBytes(Byte headerCopy[], int startIndex, int length){
@@ -61,21 +212,12 @@ Int4 packBytes(Byte headerCopy[], int startIndex, int length){
     return bytes;
 }
 
-//Gets the first %headerSize% bytes from the image file and copy into an array
-//Represents the header containing image metadata
-void getHeaderData(const char fileName[], Byte headerSize, Byte headerCopy[headerSize]){
-    FILE *in = fopenCheck(fileName,"rb");
-    fread(headerCopy, sizeof(Byte),headerSize, in);
-    fclose(in);
+//Unpacks an integer into consecutive bytes of an array (LSB at lowest address)
+//Inverse of packBytes
+void unpackBytes(Byte headerCopy[], int startIndex, int length, Int4 value){
+    for (int i = 0; i < length; i++) headerCopy[i + startIndex] = (value >> (byteLength * i)) & 0xFF;
 }
 
-//Check the provided file is a bitmap
-void bitmapCheck(Byte headerCopy[]){
-    if (headerCopy[0] != 'B' || headerCopy[1] != 'M') {
-        printf("Please use a bitmap file\n");
-        exit(1);
-    }
-}
 
 //Extracts useful metadata from the header bytes and loads into an ImageHeader structure
 void parseHeader(Byte headerCopy[], ImageHeader *header){
@@ -87,331 +229,3645 @@ void parseHeader(Byte headerCopy[], ImageHeader *header){
     header->height = packBytes(headerCopy, Height, 4);
     header->bitsPerPixel = packBytes(headerCopy, BitsPerPixel, 2);
     header->compression = packBytes(headerCopy, Compression, 4);
+    header->paletteIndex = InfoHeaderSize + packBytes(headerCopy, InfoHeaderSize, 4);
+    header->colourCount = 0;
+    if (header->bitsPerPixel == 8){
+        header->colourCount = packBytes(headerCopy, ColoursUsed, 4);
+        if (header->colourCount == 0) header->colourCount = 256;
+    }
 }
 
 //Validates image specificiation to ensure file in a suitable format to be processed
-void validateImage(ImageHeader *header){
-    if (header->compression != 0){
-        printf("Please use an uncompressed bitmap file\n");
+//Returns NULL if it is, otherwise the reason it isn't
+const char *imageProblem(ImageHeader *header){
+    if (header->compression != 0) return "Please use an uncompressed bitmap file";
+    if (header->bitsPerPixel != 8 && header->bitsPerPixel != 24 && header->bitsPerPixel != 32) return "Please use an 8, 24 or 32 bit bitmap file";
+    if (header->width <= 0 || header->height <= 0 || header->pixelDataIndex < 54) return "Please use a bitmap file with a valid header";
+    if (header->colourCount > 256 || header->paletteIndex + 4 * header->colourCount > header->pixelDataIndex){
+        return "Please use a bitmap file with a valid colour table";
+    }
+    return NULL;
+}
+
+//Number of bytes in one row of the pixel array, including the padding to a 4 byte boundary
+long rowBytes(ImageHeader *header){
+    const long padding = 4;
+    const long bytesPerPixel = header->bitsPerPixel / 8;
+    return ((header->width * bytesPerPixel + padding - 1) / padding) * padding;
+}
+
+//Number of planes a pixel buffer needs to hold the pixels of the image
+int formatPlanes(ImageHeader *header){
+    if (header->bitsPerPixel == 8) return 1;
+    if (header->bitsPerPixel == 32) return 4;
+    return channels;
+}
+
+//Offset in the file of row %firstRow% (counted from the top of the image) when %rowCount% rows are accessed together
+//Rows are stored bottom up, so the requested rows form one contiguous block of the file starting at the last of them
+long rowsOffset(ImageHeader *header, long rowSize, int firstRow, int rowCount){
+    return header->pixelDataIndex + (long) (header->height - firstRow - rowCount) * rowSize;
+}
+
+//Builds the header of a new uncompressed bitmap
+//An 8 bit bitmap has room for a colour table of 256 colours after the header (which the caller fills in)
+void createHeader(Byte headerBytes[54], int height, int width, int bitsPerPixel){
+    const Byte headerSize = 54;
+    const Byte infoHeaderSize = 40;
+    const int colourCount = bitsPerPixel == 8 ? 256 : 0;
+    const long pixelDataIndex = headerSize + 4 * colourCount;
+    ImageHeader header = {'B', 'M', 0, width, height, bitsPerPixel, 0, 0, pixelDataIndex, headerSize, colourCount};
+    const long pixelArraySize = rowBytes(&header) * height;
+    memset(headerBytes, 0, headerSize);
+    headerBytes[Filetype1] = 'B';
+    headerBytes[Filetype2] = 'M';
+    unpackBytes(headerBytes, Size, 4, pixelDataIndex + pixelArraySize);
+    unpackBytes(headerBytes, PixelDataIndex, 4, pixelDataIndex);
+    unpackBytes(headerBytes, InfoHeaderSize, 4, infoHeaderSize);
+    unpackBytes(headerBytes, Width, 4, width);
+    unpackBytes(headerBytes, Height, 4, height);
+    unpackBytes(headerBytes, Planes, 2, 1);
+    unpackBytes(headerBytes, BitsPerPixel, 2, bitsPerPixel);
+    unpackBytes(headerBytes, Compression, 4, 0);
+    unpackBytes(headerBytes, ImageSize, 4, pixelArraySize);
+    unpackBytes(headerBytes, ColoursUsed, 4, colourCount);
+}
+
+//Size of an open file in bytes
+long streamSize(FILE *stream){
+    fseek(stream, 0, SEEK_END);
+    long size = ftell(stream);
+    fseek(stream, 0, SEEK_SET);
+    return size;
+}
+
+//Creates a new file that is renamed to %name% once it is complete, putting its own name in %temporaryName%
+//It is made next to %name%, so the rename stays on one file system, and takes the permissions of any file it is going to replace
+//Returns NULL if the file can't be created
+FILE *createTemporary(const char name[], char temporaryName[], size_t nameSize){
+#ifdef HAVE_TEMPORARY_FILES
+    if (snprintf(temporaryName, nameSize, "%s.XXXXXX", name) >= (int) nameSize) return NULL;
+    const int descriptor = mkstemp(temporaryName);
+    if (descriptor < 0) return NULL;
+    FILE *stream = fdopen(descriptor, "w+b");
+    if (stream == NULL){
+        close(descriptor);
+        remove(temporaryName);
+        return NULL;
+    }
+    struct stat status;
+    if (stat(name, &status) == 0) fchmod(descriptor, status.st_mode & 07777);
+    return stream;
+#else
+    //Without mkstemp the address of the name buffer at least keeps the threads of this process apart
+    if (snprintf(temporaryName, nameSize, "%s.%p.tmp", name, (void *) temporaryName) >= (int) nameSize) return NULL;
+    return fopen(temporaryName, "w+b");
+#endif
+}
+
+//Whether %outName% names the same file as the open input %inStream%, including through another link to it
+//Without POSIX file identities only an identical name can be recognised
+bool sameFile(FILE *inStream, const char inName[], const char outName[]){
+#ifdef HAVE_TEMPORARY_FILES
+    struct stat inStatus;
+    struct stat outStatus;
+    if (fstat(fileno(inStream), &inStatus) != 0 || stat(outName, &outStatus) != 0) return false;
+    return inStatus.st_dev == outStatus.st_dev && inStatus.st_ino == outStatus.st_ino;
+#else
+    return strcmp(inName, outName) == 0;
+#endif
+}
+
+//Wraps an open stream of %size% bytes as a bitmap file, memory mapping it when %useMapping% is set and the platform allows
+//A writable file is first extended to %size% so every byte of the mapping is backed by the file
+//Streams that can't be mapped (pipes, special files) silently keep using stdio
+void attachFile(BitmapFile *file, FILE *stream, long size, bool writable, bool useMapping){
+    file->stream = stream;
+    file->mapping = NULL;
+    file->size = size;
+#ifdef HAVE_MMAP
+    if (!useMapping || size == 0) return;
+    fflush(stream);
+    if (writable && ftruncate(fileno(stream), size) != 0) return;
+    int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *mapping = mmap(NULL, size, protection, MAP_SHARED, fileno(stream), 0);
+    if (mapping == MAP_FAILED) return;
+    //Bands are visited in file order, so let the kernel read ahead
+    posix_madvise(mapping, size, POSIX_MADV_SEQUENTIAL);
+    file->mapping = mapping;
+#endif
+}
+
+//Releases the mapping of a bitmap file (the stream stays open)
+//For a writable file this hands the written pages back to the operating system to be stored
+void detachFile(BitmapFile *file){
+#ifdef HAVE_MMAP
+    if (file->mapping != NULL) munmap(file->mapping, file->size);
+#endif
+    file->mapping = NULL;
+}
+
+//Gives access to %count% bytes of a file starting at %offset%
+//A mapped file returns a pointer into the mapping without copying, otherwise the bytes are read into %buffer%
+Byte *readBytes(BitmapFile *file, long offset, long count, Byte buffer[]){
+    if (offset < 0 || offset + count > file->size){
+        printf("Bitmap file is smaller than its header describes\n");
         exit(1);
     }
+    if (file->mapping != NULL) return file->mapping + offset;
+    fseek(file->stream, offset, SEEK_SET);
+    if (fread(buffer, sizeof(Byte), count, file->stream) != count){
+        printf("Bitmap file is smaller than its header describes\n");
+        exit(1);
+    }
+    return buffer;
 }
 
-//Retrieves the byte pixel array from the image file and loads i
-void getPixelArray(const char fileName[], int pixelArrayIndex, int pixelArraySize, Byte rawPixelArray[]){
-    FILE *in = fopenCheck(fileName,"rb");
-    fseek(in, pixelArrayIndex, SEEK_SET);
-    fread(rawPixelArray, pixelArraySize, sizeof(Byte), in);
-    fclose(in);
+//Reads %count% bytes of a file starting at %offset% into %buffer%, for bytes that are going to be changed
+//Only a mapped file needs a copy, since otherwise readBytes has already read them into %buffer%
+void readCopy(BitmapFile *file, long offset, long count, Byte buffer[]){
+    Byte *bytes = readBytes(file, offset, count, buffer);
+    if (bytes != buffer) memcpy(buffer, bytes, count);
+}
+
+//Where the bytes starting at %offset% of a file should be produced before calling writeBytes
+//A mapped file lets them be produced in place, otherwise they are staged in %buffer%
+Byte *writableBytes(BitmapFile *file, long offset, Byte buffer[]){
+    if (file->mapping != NULL) return file->mapping + offset;
+    return buffer;
+}
+
+//Stores %count% bytes at %offset% of a file
+//Bytes already produced in place in the mapping need no copy at all
+void writeBytes(BitmapFile *file, long offset, long count, Byte const bytes[]){
+    if (file->mapping != NULL){
+        if (bytes != file->mapping + offset) memcpy(file->mapping + offset, bytes, count);
+        return;
+    }
+    fseek(file->stream, offset, SEEK_SET);
+    if (fwrite(bytes, sizeof(Byte), count, file->stream) != count){
+        printf("Can't write the output file\n");
+        exit(1);
+    }
+}
+
+//Copies %count% bytes starting at %inOffset% of one file to %outOffset% of another
+void copyBytes(BitmapFile *in, long inOffset, BitmapFile *out, long outOffset, long count){
+    Byte buffer[4096];
+    while (count > 0){
+        long chunk = count < (long) sizeof(buffer) ? count : (long) sizeof(buffer);
+        writeBytes(out, outOffset, chunk, readBytes(in, inOffset, chunk, buffer));
+        inOffset += chunk;
+        outOffset += chunk;
+        count -= chunk;
+    }
+}
+
+//Reads the header of a bitmap file into %header% and checks that the whole image can be processed
+//Returns NULL if it can, otherwise the reason it can't
+const char *readHeader(BitmapFile *in, ImageHeader *header){
+    Byte headerCopy[54];
+    if (in->size < sizeof(headerCopy)) return "Please use a bitmap file";
+    Byte *headerBytes = readBytes(in, 0, sizeof(headerCopy), headerCopy);
+    if (headerBytes[0] != 'B' || headerBytes[1] != 'M') return "Please use a bitmap file";
+    parseHeader(headerBytes, header);
+    const char *problem = imageProblem(header);
+    if (problem != NULL) return problem;
+    if (header->pixelDataIndex + header->height * rowBytes(header) > in->size) return "Bitmap file is smaller than its header describes";
+    return NULL;
+}
+
+//PIXEL BUFFER FUNCTIONS
+
+//Allocates a zeroed pixel buffer of %planeCount% planes whose rows are aligned to 64 bytes
+void createPlanes(PixelBuffer *buffer, int height, int width, int planeCount){
+    const long rowAlignment = 64;
+    buffer->height = height;
+    buffer->width = width;
+    buffer->stride = ((width + rowAlignment - 1) / rowAlignment) * rowAlignment;
+    buffer->planeCount = planeCount;
+    const size_t planeSize = buffer->stride * height;
+    //aligned_alloc may return NULL for 0 bytes, so an empty image still gets one row's worth and every plane a real address
+    const size_t size = planeSize * planeCount > 0 ? planeSize * planeCount : rowAlignment;
+    buffer->memory = aligned_alloc(rowAlignment, size);
+    if (buffer->memory == NULL){
+        fprintf(stderr, "Can't allocate %zu bytes\n", size);
+        exit(1);
+    }
+    memset(buffer->memory, 0, size);
+    for (int k = 0; k < 4; k++) buffer->planes[k] = k < planeCount ? buffer->memory + k * planeSize : NULL;
+}
+
+//Allocates a zeroed pixel buffer of the 3 colour planes
+void createBuffer(PixelBuffer *buffer, int height, int width){
+    createPlanes(buffer, height, width, channels);
+}
+
+//Releases the memory owned by a pixel buffer
+void freeBuffer(PixelBuffer *buffer){
+    free(buffer->memory);
+    buffer->memory = NULL;
+}
+
+//Gets a view of %count% rows of a buffer starting at row %first%, sharing the buffer's memory
+PixelBuffer bufferRows(PixelBuffer *buffer, int first, int count){
+    PixelBuffer view = *buffer;
+    view.height = count;
+    view.memory = NULL;
+    for (int k = 0; k < buffer->planeCount; k++) view.planes[k] += first * buffer->stride;
+    return view;
+}
+
+//Creates an empty workspace, which allocates nothing until an image reserves space in it
+void createWorkspace(Workspace *workspace){
+    PixelBuffer empty = {0, 0, 0, {NULL, NULL, NULL, NULL}, NULL, 0};
+    workspace->band = empty;
+    workspace->rawRows = NULL;
+    workspace->rawSize = 0;
+}
+
+//Makes sure the workspace holds a band of %rows% rows of %width% pixels in %planeCount% planes and %rawSize% bytes of raw rows
+//Returns a view of the band with exactly that many rows, pixels per row and planes (its stride may be wider)
+PixelBuffer reserveWorkspace(Workspace *workspace, int rows, int width, int planeCount, long rawSize){
+    PixelBuffer *band = &workspace->band;
+    if (rows > band->height || width > band->width || planeCount > band->planeCount){
+        int height = rows > band->height ? rows : band->height;
+        int widest = width > band->width ? width : band->width;
+        int planes = planeCount > band->planeCount ? planeCount : band->planeCount;
+        freeBuffer(band);
+        createPlanes(band, height, widest, planes);
+    }
+    if (rawSize > workspace->rawSize){
+        free(workspace->rawRows);
+        workspace->rawRows = mallocCheck(rawSize);
+        workspace->rawSize = rawSize;
+    }
+    PixelBuffer view = bufferRows(band, 0, rows);
+    view.width = width;
+    view.planeCount = planeCount;
+    return view;
+}
+
+//Frees the memory held by a workspace
+void freeWorkspace(Workspace *workspace){
+    freeBuffer(&workspace->band);
+    free(workspace->rawRows);
+    createWorkspace(workspace);
+}
+
+//Gets row %i% of colour plane %k%
+Byte *planeRow(PixelBuffer *buffer, int k, int i){
+    return buffer->planes[k] + i * buffer->stride;
 }
 
 //Parses the byte array represneting pixel data into a more convinient array struture for simplified processesing
-void parseRawPixelArray(int height, int width, Byte pixels[height][width][channels], Byte const rawPixelArray[], ImageHeader *header){
+//The interleaved channels of the bitmap are separated into planes, the alpha bytes of a 32 bit bitmap into a plane of their own
+//The colour indices of a palettized bitmap are copied as they are
+void parseRawPixelArray(PixelBuffer *pixels, Byte const rawPixelArray[], ImageHeader *header){
     const Byte bytesPerPixel = header->bitsPerPixel / 8;
     const Byte padding = 4;
-    const Byte paddingLength = (header->width * bytesPerPixel) % padding;
-    int index = 0;
-    for(int i = height - 1; i >= 0; i--){
-        for(int j = 0; j < width; j++){
-            for (Byte k = 0; k < channels; k++) pixels[i][j][k] = rawPixelArray[index + k];
-            index += bytesPerPixel;
+    const Byte paddingLength = (padding - (header->width * bytesPerPixel) % padding) % padding;
+    long index = 0;
+    for(int i = pixels->height - 1; i >= 0; i--){
+        const Byte *restrict source = rawPixelArray + index;
+        index += pixels->width * bytesPerPixel + paddingLength;
+        if (bytesPerPixel == 1){
+            memcpy(planeRow(pixels, 0, i), source, pixels->width);
+            continue;
+        }
+        Byte *restrict blue = planeRow(pixels, 0, i);
+        Byte *restrict green = planeRow(pixels, 1, i);
+        Byte *restrict red = planeRow(pixels, 2, i);
+        if (bytesPerPixel == 4){
+            Byte *restrict alpha = planeRow(pixels, 3, i);
+            for(int j = 0; j < pixels->width; j++){
+                blue[j] = source[j * 4];
+                green[j] = source[j * 4 + 1];
+                red[j] = source[j * 4 + 2];
+                alpha[j] = source[j * 4 + 3];
+            }
+        }
+        else {
+            for(int j = 0; j < pixels->width; j++){
+                blue[j] = source[j * 3];
+                green[j] = source[j * 3 + 1];
+                red[j] = source[j * 3 + 2];
+            }
         }
-        index += paddingLength;
     }
 }
 
 //Converts an array of processed pixels back into a one dimensional pixel array following the bitmap specificiation
-void generateRawPixelArray(int height, int width, Byte const pixels[height][width][channels], Byte rawPixelArray[], ImageHeader *header){
+//The planes are interleaved again and the padding at the end of each row is zeroed
+void generateRawPixelArray(PixelBuffer *pixels, Byte rawPixelArray[], ImageHeader *header){
     const Byte bytesPerPixel = header->bitsPerPixel / 8;
     const Byte padding = 4;
-    const Byte paddingLength = (header->width * bytesPerPixel) % padding;
-    int index = 0;
+    const Byte paddingLength = (padding - (header->width * bytesPerPixel) % padding) % padding;
+    long index = 0;
 
-    for(int i = height - 1; i >= 0; i--){
-        for(int j = 0; j < width; j++){
-            for (Byte k = 0; k < channels; k++) rawPixelArray[index + k] = pixels[i][j][k];
-            index += bytesPerPixel;
-        }
+    for(int i = pixels->height - 1; i >= 0; i--){
+        Byte *restrict destination = rawPixelArray + index;
+        index += pixels->width * bytesPerPixel;
+        for (Byte k = 0; k < paddingLength; k++) rawPixelArray[index + k] = 0;
         index += paddingLength;
+        if (bytesPerPixel == 1){
+            memcpy(destination, planeRow(pixels, 0, i), pixels->width);
+            continue;
+        }
+        const Byte *restrict blue = planeRow(pixels, 0, i);
+        const Byte *restrict green = planeRow(pixels, 1, i);
+        const Byte *restrict red = planeRow(pixels, 2, i);
+        if (bytesPerPixel == 4){
+            const Byte *restrict alpha = planeRow(pixels, 3, i);
+            for(int j = 0; j < pixels->width; j++){
+                destination[j * 4] = blue[j];
+                destination[j * 4 + 1] = green[j];
+                destination[j * 4 + 2] = red[j];
+                destination[j * 4 + 3] = alpha[j];
+            }
+        }
+        else {
+            for(int j = 0; j < pixels->width; j++){
+                destination[j * 3] = blue[j];
+                destination[j * 3 + 1] = green[j];
+                destination[j * 3 + 2] = red[j];
+            }
+        }
     }
 }
 
-//Writes bytes to new bitmap file
-void writeToFile(const char fileName[], int headerSize, Byte header[], int pixelArraySize, Byte pixelArray[]){
-    FILE *out = fopenCheck(fileName,"wb");
-    for (int i = 0; i < headerSize; i++) fputc(header[i], out);
-    for (int i = 0; i < pixelArraySize; i++) fputc(pixelArray[i], out);
-    fclose(out);
+//PER-PIXEL KERNELS
+//Each kernel works on a run of bytes from a plane (greyscale on the same run of every plane)
+//The scalar kernels are the reference: vector kernels must give bit-identical results
+
+//Inverts every byte
+void invertScalar(long length, Byte data[]){
+    const Byte maxBrightness = 255;
+    for (long i = 0; i < length; i++) data[i] = maxBrightness - data[i];
 }
-//IMAGE PROCESSING FUNCTIONS
 
-//Copies the contents of one array to another
-void copyPixels(int height, int width, Byte pixels1[height][width][channels], Byte pixels2[height][width][channels]){
-    for (int i = 0; i < height; i++){
-        for (int j = 0; j < width; j++){
-            for (int k = 0; k < channels; k++) pixels2[i][j][k] = pixels1[i][j][k];
-        }
+//Scales every byte down by the (already converted) scaling factor
+void darkenScalar(long length, Byte data[], float scaling){
+    for (long i = 0; i < length; i++) data[i] *= scaling;
+}
+
+//Moves every byte towards full brightness by the (already converted) scaling factor
+void brightenScalar(long length, Byte data[], float scaling){
+    const int maxBrightness = 255;
+    for (long i = 0; i < length; i++) data[i] += (maxBrightness - data[i]) * scaling;
+}
+
+//Replaces each colour channel with the average of the pixel's channels
+void greyscaleScalar(long length, Byte *planes[]){
+    int sum;
+    int average;
+    for (long i = 0; i < length; i++){
+        sum = 0;
+        for (Byte k = 0; k < channels; k++) sum += planes[k][i];
+        average = sum / channels;
+        for (Byte k = 0; k < channels; k++) planes[k][i] = average;
     }
 }
 
-//Flips the image around a centrally a X-axis
-void flipX(int height, int width, Byte pixels[height][width][channels]){
-    Byte pixelsCopy[height][width][channels];
-    int upperBound = height - 1;
-    copyPixels(height, width, pixels, pixelsCopy);
-    for (int i = 0; i < height; i++){
-        for (int j = 0; j < width; j++){
-            for (int k = 0; k < channels; k++) pixels[i][j][k] = pixelsCopy[upperBound - i][j][k];
-        }
+//Reverses the order of the bytes in place
+void reverseScalar(long length, Byte data[]){
+    for (long i = 0, j = length - 1; i < j; i++, j--){
+        Byte swap = data[i];
+        data[i] = data[j];
+        data[j] = swap;
     }
 }
 
-//Flips the image around a centrally a Y-axis
-void flipY(int height, int width, Byte pixels[height][width][channels]){
-    Byte pixelsCopy[height][width][channels];
-    int upperBound = width - 1;
-    copyPixels(height, width, pixels, pixelsCopy);
-    for (int i = 0; i < height; i++){
-        for (int j = 0; j < width; j++){
-            for (int k = 0; k < channels; k++) pixels[i][j][k] = pixelsCopy[i][upperBound - j][k];
-        }
+//Rounds a weighted sum of fixed point weights with %shift% fractional bits to the nearest integer and clamps it to a byte
+Byte weightedByte(Int4 sum, int shift){
+    const Int4 maxValue = 255;
+    sum += (1 << shift) >> 1;
+    if (sum < 0) return 0;
+    return sum >> shift > maxValue ? maxValue : sum >> shift;
+}
+
+//Sets bytes %first% up to %length% of %result% to the weighted sum of the bytes at the same position in %taps% source arrays
+//The weights are fixed point values with %shift% fractional bits
+//The vector kernels finish their rows with it, so the sources are indexed from %first% rather than offset by the caller
+void convolveFrom(long first, long length, Byte const *sources[], const Int2 weights[], int taps, int shift, Byte result[]){
+    for (long i = first; i < length; i++){
+        Int4 sum = 0;
+        for (int t = 0; t < taps; t++) sum += weights[t] * sources[t][i];
+        result[i] = weightedByte(sum, shift);
     }
 }
 
-//Darkens every pixel in the image across all colour channels
-void darken(int height, int width, Byte pixels[height][width][channels], float scaling){
-    scaling /= 100;
-    scaling = 1 - scaling;
-    for (int i = 0; i < height; i++){
-        for (int j = 0; j < width; j++){
-            for (Byte k = 0; k < channels; k++) pixels[i][j][k] *= scaling;
+//Sets every byte of %result% to the weighted sum of the bytes at the same position in %taps% source arrays
+void convolveScalar(long length, Byte const *sources[], const Int2 weights[], int taps, int shift, Byte result[]){
+    convolveFrom(0, length, sources, weights, taps, shift, result);
+}
+
+//Sets bytes %first% up to %length% of %result% to the weighted sum of %pairCount% pairs of taps
+//Pair m is an array holding the two taps of every byte next to each other as 16 bit values, weighted by weights[2m] and weights[2m + 1]
+//The first %mirroredCount% pairs have the pairs of their mirror image taps in %mirrors%, which have the same weights in a symmetric kernel,
+//so both are added together before they are weighted
+void convolvePairsFrom(long first, long length, Int2 const *pairs[], Int2 const *mirrors[], const Int2 weights[], int pairCount, int mirroredCount, int shift, Byte result[]){
+    for (long i = first; i < length; i++){
+        Int4 sum = 0;
+        for (int m = 0; m < pairCount; m++){
+            Int4 a = pairs[m][2 * i];
+            Int4 b = pairs[m][2 * i + 1];
+            if (m < mirroredCount){
+                a += mirrors[m][2 * i];
+                b += mirrors[m][2 * i + 1];
+            }
+            sum += weights[2 * m] * a + weights[2 * m + 1] * b;
         }
+        result[i] = weightedByte(sum, shift);
     }
 }
 
-//Brigtens every pixel in the image across all colour channels
-void brighten(int height, int width, Byte pixels[height][width][channels], float scaling){
-    scaling /= 100;
-    const int maxBrightness = 255;
-    for (int i = 0; i < height; i++){
-        for (int j = 0; j < width; j++){
-            for (Byte k = 0; k < channels; k++) pixels[i][j][k] += (maxBrightness - pixels[i][j][k]) * scaling;
-        }
+//Sets every byte of %result% to the weighted sum of %pairCount% pairs of taps, as convolvePairsFrom
+void convolvePairsScalar(long length, Int2 const *pairs[], Int2 const *mirrors[], const Int2 weights[], int pairCount, int mirroredCount, int shift, Byte result[]){
+    convolvePairsFrom(0, length, pairs, mirrors, weights, pairCount, mirroredCount, shift, result);
+}
+
+//Interleaves two byte arrays into an array of 16 bit tap pairs: first[0], second[0], first[1], second[1], ...
+void interleaveScalar(long length, Byte const first[], Byte const second[], Int2 pairs[]){
+    for (long i = 0; i < length; i++){
+        pairs[2 * i] = first[i];
+        pairs[2 * i + 1] = second[i];
     }
 }
 
-//Converts a colour image into greyscale
-void greyscale(int height, int width, Byte pixels[height][width][channels]){
-    int sum;
-    int average;
-    for (int i = 0; i < height; i++){
-        for (int j = 0; j < width; j++){
-            sum = 0;
-            for (Byte k = 0; k < channels; k++) sum += pixels[i][j][k];
-            average = sum / channels;
-            for (Byte k = 0; k < channels; k++) pixels[i][j][k] = average;
-        }
+//Packs the weights of two taps into the pairs of 16 bit values multiplied by a multiply-add instruction
+Int4 pairWeights(Int2 first, Int2 second){
+    return (Int4) ((uint32_t) (uint16_t) first | (uint32_t) (uint16_t) second << 16);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+//SSE2 is part of the x86-64 baseline, so these kernels need no CPU check there
+//32 bit x86 doesn't have to have it, so like the AVX2 kernels they are compiled for it on their own and picked at run time
+
+//Reads two adjacent weights as one packed pair
+//x86 is little endian, so the two 16 bit weights already are the packed pair in memory
+Int4 weightPair(const Int2 weights[2]){
+    Int4 pair;
+    memcpy(&pair, weights, sizeof(pair));
+    return pair;
+}
+
+//Inverts 16 bytes per instruction
+__attribute__((target("sse2")))
+void invertSSE2(long length, Byte data[]){
+    const __m128i ones = _mm_set1_epi8(-1);
+    long i = 0;
+    for (; i + 16 <= length; i += 16){
+        __m128i x = _mm_loadu_si128((__m128i *) &data[i]);
+        _mm_storeu_si128((__m128i *) &data[i], _mm_xor_si128(x, ones));
     }
+    invertScalar(length - i, &data[i]);
 }
 
-//Inverts all colours
-void invert(int height, int width, Byte pixels[height][width][channels]){
-    const Byte maxBrightness = 255;
-    for (int i = 0; i < height; i++){
-        for (int j = 0; j < width; j++){
-            for (int k = 0; k < channels; k++) pixels[i][j][k] = maxBrightness - pixels[i][j][k];
-        }
+//Widens 16 bytes to 4 vectors of floats
+__attribute__((target("sse2")))
+void bytesToFloats(__m128i x, __m128 f[4]){
+    const __m128i zero = _mm_setzero_si128();
+    __m128i low = _mm_unpacklo_epi8(x, zero);
+    __m128i high = _mm_unpackhi_epi8(x, zero);
+    f[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero));
+    f[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero));
+    f[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero));
+    f[3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero));
+}
+
+//Truncates 4 vectors of floats (all within 0 - 255) back to 16 bytes, as a conversion to Byte does
+__attribute__((target("sse2")))
+__m128i floatsToBytes(__m128 f[4]){
+    __m128i low = _mm_packs_epi32(_mm_cvttps_epi32(f[0]), _mm_cvttps_epi32(f[1]));
+    __m128i high = _mm_packs_epi32(_mm_cvttps_epi32(f[2]), _mm_cvttps_epi32(f[3]));
+    return _mm_packus_epi16(low, high);
+}
+
+//Darkens 16 bytes per iteration using the same single precision multiply as the scalar kernel
+__attribute__((target("sse2")))
+void darkenSSE2(long length, Byte data[], float scaling){
+    const __m128 scale = _mm_set1_ps(scaling);
+    __m128 f[4];
+    long i = 0;
+    for (; i + 16 <= length; i += 16){
+        bytesToFloats(_mm_loadu_si128((__m128i *) &data[i]), f);
+        for (int j = 0; j < 4; j++) f[j] = _mm_mul_ps(f[j], scale);
+        _mm_storeu_si128((__m128i *) &data[i], floatsToBytes(f));
     }
+    darkenScalar(length - i, &data[i], scaling);
 }
 
-//Calculates new pixel value for a single pixel in blurred image
-Byte blurKernel (int height, int width, Byte pixels[height][width][channels], int size, int i, int j, int k){
-    int lowerX = j - size;
-    int lowerY = i - size;
-    int upperX = j + size;
-    int upperY = i + size;
-    if (lowerX < 0) lowerX = 0;
-    if (lowerY < 0) lowerY = 0;
-    if (upperX >= width) upperX = width - 1;
-    if (upperY >= height) upperY = height - 1;
-    int sum = 0;
-    int pixelCount = 0;
-    for (int y = lowerY; y <= upperY; y++){
-        for (int x = lowerX; x <= upperX; x++){
-            sum += pixels[y][x][k];
-            pixelCount++;
+//Brightens 16 bytes per iteration, multiplying then adding separately to round exactly like the scalar kernel
+__attribute__((target("sse2")))
+void brightenSSE2(long length, Byte data[], float scaling){
+    const __m128 scale = _mm_set1_ps(scaling);
+    const __m128i ones = _mm_set1_epi8(-1);
+    __m128 f[4];
+    __m128 gap[4];
+    long i = 0;
+    for (; i + 16 <= length; i += 16){
+        __m128i x = _mm_loadu_si128((__m128i *) &data[i]);
+        bytesToFloats(x, f);
+        bytesToFloats(_mm_xor_si128(x, ones), gap);
+        for (int j = 0; j < 4; j++) f[j] = _mm_add_ps(f[j], _mm_mul_ps(gap[j], scale));
+        _mm_storeu_si128((__m128i *) &data[i], floatsToBytes(f));
+    }
+    brightenScalar(length - i, &data[i], scaling);
+}
+
+//Converts 16 pixels per iteration to greyscale
+//(sum * 43691) >> 17 equals sum / 3 for every sum of 3 bytes, and fits in a 16 bit multiply-high and shift
+__attribute__((target("sse2")))
+void greyscaleSSE2(long length, Byte *planes[]){
+    const __m128i third = _mm_set1_epi16((short) 43691);
+    const __m128i zero = _mm_setzero_si128();
+    long i = 0;
+    for (; i + 16 <= length; i += 16){
+        __m128i sumLow = zero;
+        __m128i sumHigh = zero;
+        for (Byte k = 0; k < channels; k++){
+            __m128i x = _mm_loadu_si128((__m128i *) &planes[k][i]);
+            sumLow = _mm_add_epi16(sumLow, _mm_unpacklo_epi8(x, zero));
+            sumHigh = _mm_add_epi16(sumHigh, _mm_unpackhi_epi8(x, zero));
         }
+        __m128i averageLow = _mm_srli_epi16(_mm_mulhi_epu16(sumLow, third), 1);
+        __m128i averageHigh = _mm_srli_epi16(_mm_mulhi_epu16(sumHigh, third), 1);
+        __m128i average = _mm_packus_epi16(averageLow, averageHigh);
+        for (Byte k = 0; k < channels; k++) _mm_storeu_si128((__m128i *) &planes[k][i], average);
     }
-    int averageColour = sum / pixelCount;
-    return averageColour;
+    Byte *tails[channels];
+    for (Byte k = 0; k < channels; k++) tails[k] = &planes[k][i];
+    greyscaleScalar(length - i, tails);
+}
 
+//Reverses the order of the 16 bytes of a vector
+//SSE2 has no byte shuffle, so the 32 bit, 16 bit and 8 bit parts are swapped in turn
+__attribute__((target("sse2")))
+__m128i reverseVectorSSE2(__m128i x){
+    x = _mm_shuffle_epi32(x, _MM_SHUFFLE(0, 1, 2, 3));
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+    x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
 }
 
-//Blurs the image
-void blur(int height, int width, Byte pixels[height][width][channels], int size){
-    Byte pixelsCopy[height][width][channels];
-    copyPixels(height, width, pixels, pixelsCopy);
-    for (int i = 0; i < height; i++){
-        for (int j = 0; j < width; j++){
-            for (Byte k = 0; k < channels; k++){
-                pixels[i][j][k] = blurKernel(height, width, pixelsCopy, size, i, j, k);
-            }
-        }
+//Reverses the bytes in place, swapping reversed vectors from both ends until they meet
+__attribute__((target("sse2")))
+void reverseSSE2(long length, Byte data[]){
+    long i = 0;
+    long j = length - 16;
+    for (; i + 16 <= j; i += 16, j -= 16){
+        __m128i front = _mm_loadu_si128((__m128i *) &data[i]);
+        __m128i back = _mm_loadu_si128((__m128i *) &data[j]);
+        _mm_storeu_si128((__m128i *) &data[i], reverseVectorSSE2(back));
+        _mm_storeu_si128((__m128i *) &data[j], reverseVectorSSE2(front));
     }
+    //Fewer than 32 bytes are left in the middle
+    reverseScalar(j + 16 - i, &data[i]);
 }
 
-//Converts a pixel array of unsigned bytes into a pixel array of 2-byte signed integers
-void byteToInt(int height, int width, Byte pixels1[height][width][channels], Int2 pixels2[height][width][channels]){
-    for (int i = 0; i < height; i++){
-        for (int j = 0; j < width; j++){
-            for (int k = 0; k < channels; k++) pixels2[i][j][k] = pixels1[i][j][k];
+//Convolves 16 bytes per iteration
+//The bytes of two taps are interleaved as 16 bit values so each multiply-add weights and sums both taps
+__attribute__((target("sse2")))
+void convolveSSE2(long length, Byte const *sources[], const Int2 weights[], int taps, int shift, Byte result[]){
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi32((1 << shift) >> 1);
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    long i = 0;
+    for (; i + 16 <= length; i += 16){
+        __m128i sums[4] = {rounding, rounding, rounding, rounding};
+        for (int t = 0; t < taps; t += 2){
+            //The last of an odd number of taps is paired with itself and a weight of 0
+            const int second = t + 1 < taps ? t + 1 : t;
+            const __m128i pair = _mm_set1_epi32(pairWeights(weights[t], t + 1 < taps ? weights[t + 1] : 0));
+            __m128i a = _mm_loadu_si128((__m128i *) &sources[t][i]);
+            __m128i b = _mm_loadu_si128((__m128i *) &sources[second][i]);
+            __m128i low = _mm_unpacklo_epi8(a, b);
+            __m128i high = _mm_unpackhi_epi8(a, b);
+            sums[0] = _mm_add_epi32(sums[0], _mm_madd_epi16(_mm_unpacklo_epi8(low, zero), pair));
+            sums[1] = _mm_add_epi32(sums[1], _mm_madd_epi16(_mm_unpackhi_epi8(low, zero), pair));
+            sums[2] = _mm_add_epi32(sums[2], _mm_madd_epi16(_mm_unpacklo_epi8(high, zero), pair));
+            sums[3] = _mm_add_epi32(sums[3], _mm_madd_epi16(_mm_unpackhi_epi8(high, zero), pair));
         }
+        for (int j = 0; j < 4; j++) sums[j] = _mm_sra_epi32(sums[j], count);
+        //Saturating packs clamp the sums to a byte
+        __m128i words = _mm_packus_epi16(_mm_packs_epi32(sums[0], sums[1]), _mm_packs_epi32(sums[2], sums[3]));
+        _mm_storeu_si128((__m128i *) &result[i], words);
     }
+    convolveFrom(i, length, sources, weights, taps, shift, result);
 }
 
-//Copies a pixel array of 2-byte signed integers into another array
-void copySignedVals(int height, int width, Int2 pixels1[height][width][channels], Int2 pixels2[height][width][channels]){
-    for (int i = 0; i < height; i++){
-        for (int j = 0; j < width; j++){
-            for (int k = 0; k < channels; k++) pixels2[i][j][k] = pixels1[i][j][k];
+//Convolves 16 bytes per iteration
+//The taps are already paired, so each pair of taps costs one multiply-add per 4 bytes and no shuffles
+__attribute__((target("sse2")))
+void convolvePairsSSE2(long length, Int2 const *pairs[], Int2 const *mirrors[], const Int2 weights[], int pairCount, int mirroredCount, int shift, Byte result[]){
+    const __m128i rounding = _mm_set1_epi32((1 << shift) >> 1);
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    long i = 0;
+    for (; i + 16 <= length; i += 16){
+        __m128i sums[4] = {rounding, rounding, rounding, rounding};
+        int m = 0;
+        //Both taps of a mirrored pair are at most 255, so their sum still fits in 16 bits
+        for (; m < mirroredCount; m++){
+            const __m128i pair = _mm_set1_epi32(weightPair(&weights[2 * m]));
+            const Int2 *taps = &pairs[m][2 * i];
+            const Int2 *mirrored = &mirrors[m][2 * i];
+            sums[0] = _mm_add_epi32(sums[0], _mm_madd_epi16(_mm_add_epi16(_mm_loadu_si128((__m128i *) &taps[0]), _mm_loadu_si128((__m128i *) &mirrored[0])), pair));
+            sums[1] = _mm_add_epi32(sums[1], _mm_madd_epi16(_mm_add_epi16(_mm_loadu_si128((__m128i *) &taps[8]), _mm_loadu_si128((__m128i *) &mirrored[8])), pair));
+            sums[2] = _mm_add_epi32(sums[2], _mm_madd_epi16(_mm_add_epi16(_mm_loadu_si128((__m128i *) &taps[16]), _mm_loadu_si128((__m128i *) &mirrored[16])), pair));
+            sums[3] = _mm_add_epi32(sums[3], _mm_madd_epi16(_mm_add_epi16(_mm_loadu_si128((__m128i *) &taps[24]), _mm_loadu_si128((__m128i *) &mirrored[24])), pair));
         }
+        for (; m < pairCount; m++){
+            const __m128i pair = _mm_set1_epi32(weightPair(&weights[2 * m]));
+            const Int2 *taps = &pairs[m][2 * i];
+            sums[0] = _mm_add_epi32(sums[0], _mm_madd_epi16(_mm_loadu_si128((__m128i *) &taps[0]), pair));
+            sums[1] = _mm_add_epi32(sums[1], _mm_madd_epi16(_mm_loadu_si128((__m128i *) &taps[8]), pair));
+            sums[2] = _mm_add_epi32(sums[2], _mm_madd_epi16(_mm_loadu_si128((__m128i *) &taps[16]), pair));
+            sums[3] = _mm_add_epi32(sums[3], _mm_madd_epi16(_mm_loadu_si128((__m128i *) &taps[24]), pair));
+        }
+        for (int j = 0; j < 4; j++) sums[j] = _mm_sra_epi32(sums[j], count);
+        __m128i words = _mm_packus_epi16(_mm_packs_epi32(sums[0], sums[1]), _mm_packs_epi32(sums[2], sums[3]));
+        _mm_storeu_si128((__m128i *) &result[i], words);
     }
+    convolvePairsFrom(i, length, pairs, mirrors, weights, pairCount, mirroredCount, shift, result);
 }
 
-//Convolves a single pixel with a kernel
-Int2 edgeKernel(int height, int width, Int2 pixels[height][width][channels], Int2 kernel[kSize][kSize], int y, int x, int k){
-    int sum = 0;
-    for (int i = 0; i < kSize ; i++){
-        for (int j = 0; j < kSize; j++){
-            sum += (pixels[y + i - 1][x + j - 1][k] * kernel[i][j]);
-        }
+//Interleaves 16 pairs of bytes per iteration, widening them to 16 bits by interleaving again with zero
+__attribute__((target("sse2")))
+void interleaveSSE2(long length, Byte const first[], Byte const second[], Int2 pairs[]){
+    const __m128i zero = _mm_setzero_si128();
+    long i = 0;
+    for (; i + 16 <= length; i += 16){
+        __m128i a = _mm_loadu_si128((__m128i *) &first[i]);
+        __m128i b = _mm_loadu_si128((__m128i *) &second[i]);
+        __m128i low = _mm_unpacklo_epi8(a, b);
+        __m128i high = _mm_unpackhi_epi8(a, b);
+        _mm_storeu_si128((__m128i *) &pairs[2 * i], _mm_unpacklo_epi8(low, zero));
+        _mm_storeu_si128((__m128i *) &pairs[2 * i + 8], _mm_unpackhi_epi8(low, zero));
+        _mm_storeu_si128((__m128i *) &pairs[2 * i + 16], _mm_unpacklo_epi8(high, zero));
+        _mm_storeu_si128((__m128i *) &pairs[2 * i + 24], _mm_unpackhi_epi8(high, zero));
     }
-    int averageColour = sum / (kSize * kSize);
-    return averageColour;
+    interleaveScalar(length - i, &first[i], &second[i], &pairs[2 * i]);
 }
 
-//Performs kernel convolution across an entire image and all colour channels
-void edgeConvolution(int height, int width, Int2 pixels[height][width][channels], Int2 kernel[kSize][kSize]){
-    Int2 pixelsCopy[height][width][channels];
-    copySignedVals(height, width, pixels, pixelsCopy);
-    for (int i = 1; i < height - 1; i++){
-        for (int j = 1; j < width - 1; j++){
-            for (int k = 0; k < channels; k++) {
-                pixels[i][j][k] = edgeKernel(height, width, pixelsCopy, kernel, i, j, k);
-            }
-        }
+//Inverts 32 bytes per instruction
+__attribute__((target("avx2")))
+void invertAVX2(long length, Byte data[]){
+    const __m256i ones = _mm256_set1_epi8(-1);
+    long i = 0;
+    for (; i + 32 <= length; i += 32){
+        __m256i x = _mm256_loadu_si256((__m256i *) &data[i]);
+        _mm256_storeu_si256((__m256i *) &data[i], _mm256_xor_si256(x, ones));
     }
+    invertScalar(length - i, &data[i]);
 }
 
-//Perorms Sobel edge detection across the image
-void edges(int height, int width, Byte pixels[height][width][channels]){
-    greyscale(height, width, pixels);
+//Truncates 4 vectors of 8 floats (all within 0 - 255) back to 32 bytes in their original order
+__attribute__((target("avx2")))
+__m256i floatsToBytesAVX2(__m256 f[4]){
+    __m256i low = _mm256_packs_epi32(_mm256_cvttps_epi32(f[0]), _mm256_cvttps_epi32(f[1]));
+    __m256i high = _mm256_packs_epi32(_mm256_cvttps_epi32(f[2]), _mm256_cvttps_epi32(f[3]));
+    //Packing works within each 128 bit lane, so the 4 byte groups come out interleaved
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    return _mm256_permutevar8x32_epi32(_mm256_packus_epi16(low, high), order);
+}
 
-    Int2 gradX[height][width][channels];
-    byteToInt(height, width, pixels, gradX);
-    Int2 xKernel[3][3] = {{-1,0,1},{-2,0,2},{-1,0,1}};
-    edgeConvolution(height, width, gradX, xKernel);
+//Widens 32 bytes to 4 vectors of 8 floats
+__attribute__((target("avx2")))
+void bytesToFloatsAVX2(const Byte data[], bool inverted, __m256 f[4]){
+    const __m256i ones = _mm256_set1_epi32(255);
+    for (int j = 0; j < 4; j++){
+        __m256i x = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *) &data[8 * j]));
+        if (inverted) x = _mm256_sub_epi32(ones, x);
+        f[j] = _mm256_cvtepi32_ps(x);
+    }
+}
 
+//Darkens 32 bytes per iteration
+__attribute__((target("avx2")))
+void darkenAVX2(long length, Byte data[], float scaling){
+    const __m256 scale = _mm256_set1_ps(scaling);
+    __m256 f[4];
+    long i = 0;
+    for (; i + 32 <= length; i += 32){
+        bytesToFloatsAVX2(&data[i], false, f);
+        for (int j = 0; j < 4; j++) f[j] = _mm256_mul_ps(f[j], scale);
+        _mm256_storeu_si256((__m256i *) &data[i], floatsToBytesAVX2(f));
+    }
+    darkenScalar(length - i, &data[i], scaling);
+}
 
-    Int2 gradY[height][width][channels];
-    byteToInt(height, width, pixels, gradY);
-    Int2 yKernel[3][3] = {{-1,-2,-1},{0,0,0},{1,2,1}};
-    edgeConvolution(height, width, gradY, yKernel);
+//Brightens 32 bytes per iteration (no fused multiply-add, which would round differently)
+__attribute__((target("avx2")))
+void brightenAVX2(long length, Byte data[], float scaling){
+    const __m256 scale = _mm256_set1_ps(scaling);
+    __m256 f[4];
+    __m256 gap[4];
+    long i = 0;
+    for (; i + 32 <= length; i += 32){
+        bytesToFloatsAVX2(&data[i], false, f);
+        bytesToFloatsAVX2(&data[i], true, gap);
+        for (int j = 0; j < 4; j++) f[j] = _mm256_add_ps(f[j], _mm256_mul_ps(gap[j], scale));
+        _mm256_storeu_si256((__m256i *) &data[i], floatsToBytesAVX2(f));
+    }
+    brightenScalar(length - i, &data[i], scaling);
+}
 
-    for (int i = 1; i < height - 1; i++){
-        for (int j = 1; j < width - 1; j++){
-            for (int k = 0; k < channels; k++){
-                 pixels[i][j][k] = sqrt((gradY[i][j][k] * gradY[i][j][k]) + (gradY[i][j][k] * gradY[i][j][k]));
-            }
+//Converts 32 pixels per iteration to greyscale
+//Unpacking and packing both work within 128 bit lanes, so the pixels come back out in their original order
+__attribute__((target("avx2")))
+void greyscaleAVX2(long length, Byte *planes[]){
+    const __m256i third = _mm256_set1_epi16((short) 43691);
+    const __m256i zero = _mm256_setzero_si256();
+    long i = 0;
+    for (; i + 32 <= length; i += 32){
+        __m256i sumLow = zero;
+        __m256i sumHigh = zero;
+        for (Byte k = 0; k < channels; k++){
+            __m256i x = _mm256_loadu_si256((__m256i *) &planes[k][i]);
+            sumLow = _mm256_add_epi16(sumLow, _mm256_unpacklo_epi8(x, zero));
+            sumHigh = _mm256_add_epi16(sumHigh, _mm256_unpackhi_epi8(x, zero));
         }
+        __m256i averageLow = _mm256_srli_epi16(_mm256_mulhi_epu16(sumLow, third), 1);
+        __m256i averageHigh = _mm256_srli_epi16(_mm256_mulhi_epu16(sumHigh, third), 1);
+        __m256i average = _mm256_packus_epi16(averageLow, averageHigh);
+        for (Byte k = 0; k < channels; k++) _mm256_storeu_si256((__m256i *) &planes[k][i], average);
     }
+    Byte *tails[channels];
+    for (Byte k = 0; k < channels; k++) tails[k] = &planes[k][i];
+    greyscaleScalar(length - i, tails);
+}
 
+//Reverses the bytes in place, swapping reversed vectors of 32 bytes from both ends until they meet
+//The byte shuffle works within 128 bit lanes, so the two lanes are swapped afterwards
+__attribute__((target("avx2")))
+void reverseAVX2(long length, Byte data[]){
+    const __m256i reversed = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    long i = 0;
+    long j = length - 32;
+    for (; i + 32 <= j; i += 32, j -= 32){
+        __m256i front = _mm256_loadu_si256((__m256i *) &data[i]);
+        __m256i back = _mm256_loadu_si256((__m256i *) &data[j]);
+        front = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(front, reversed), _MM_SHUFFLE(1, 0, 3, 2));
+        back = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(back, reversed), _MM_SHUFFLE(1, 0, 3, 2));
+        _mm256_storeu_si256((__m256i *) &data[i], back);
+        _mm256_storeu_si256((__m256i *) &data[j], front);
+    }
+    //Fewer than 64 bytes are left in the middle
+    reverseSSE2(j + 32 - i, &data[i]);
 }
 
-//Checks if the parameter following an effect is valid
-//Returns a valid parameter or 0 otherwise
-int parseNum(char arg[]){
-    int result = 0;
-    if (arg != NULL) {
-        result = atoi(arg);
-        for (int i = 0; i < strlen(arg);i++){
-            if (arg[i] < '0' || arg[i] > '9') {
-                result = 0;
-                break;
-            }
+//Convolves 32 bytes per iteration
+//The unpacks and packs both work within 128 bit lanes, so the bytes come out in their original order
+__attribute__((target("avx2")))
+void convolveAVX2(long length, Byte const *sources[], const Int2 weights[], int taps, int shift, Byte result[]){
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i rounding = _mm256_set1_epi32((1 << shift) >> 1);
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    long i = 0;
+    for (; i + 32 <= length; i += 32){
+        __m256i sums[4] = {rounding, rounding, rounding, rounding};
+        for (int t = 0; t < taps; t += 2){
+            const int second = t + 1 < taps ? t + 1 : t;
+            const __m256i pair = _mm256_set1_epi32(pairWeights(weights[t], t + 1 < taps ? weights[t + 1] : 0));
+            __m256i a = _mm256_loadu_si256((__m256i *) &sources[t][i]);
+            __m256i b = _mm256_loadu_si256((__m256i *) &sources[second][i]);
+            __m256i low = _mm256_unpacklo_epi8(a, b);
+            __m256i high = _mm256_unpackhi_epi8(a, b);
+            sums[0] = _mm256_add_epi32(sums[0], _mm256_madd_epi16(_mm256_unpacklo_epi8(low, zero), pair));
+            sums[1] = _mm256_add_epi32(sums[1], _mm256_madd_epi16(_mm256_unpackhi_epi8(low, zero), pair));
+            sums[2] = _mm256_add_epi32(sums[2], _mm256_madd_epi16(_mm256_unpacklo_epi8(high, zero), pair));
+            sums[3] = _mm256_add_epi32(sums[3], _mm256_madd_epi16(_mm256_unpackhi_epi8(high, zero), pair));
         }
-        if (result > 100 || result < 1) result = 0;
+        for (int j = 0; j < 4; j++) sums[j] = _mm256_sra_epi32(sums[j], count);
+        __m256i words = _mm256_packus_epi16(_mm256_packs_epi32(sums[0], sums[1]), _mm256_packs_epi32(sums[2], sums[3]));
+        _mm256_storeu_si256((__m256i *) &result[i], words);
     }
-    return result;
+    convolveFrom(i, length, sources, weights, taps, shift, result);
 }
 
-//Checks whether an effect argument is valid or not
-bool validArg(char arg[]){
-    bool result = false;
-    const Byte numOfFunctions = 3;
-    char validStrs[3][10] = {"darken","brighten","blur"};
-    for (int i = 0; i < numOfFunctions; i++){
-        if (strcmp(arg,validStrs[i]) == 0) {
-            result = true;
-            break;
+//Convolves 64 bytes per iteration
+//The packs work within 128 bit lanes, leaving groups of 4 bytes out of order until the final permute
+__attribute__((target("avx2")))
+void convolvePairsAVX2(long length, Int2 const *pairs[], Int2 const *mirrors[], const Int2 weights[], int pairCount, int mirroredCount, int shift, Byte result[]){
+    const __m256i rounding = _mm256_set1_epi32((1 << shift) >> 1);
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    long i = 0;
+    for (; i + 64 <= length; i += 64){
+        __m256i sums[8];
+        for (int j = 0; j < 8; j++) sums[j] = rounding;
+        int m = 0;
+        for (; m < mirroredCount; m++){
+            const __m256i pair = _mm256_set1_epi32(weightPair(&weights[2 * m]));
+            const Int2 *taps = &pairs[m][2 * i];
+            const Int2 *mirrored = &mirrors[m][2 * i];
+            sums[0] = _mm256_add_epi32(sums[0], _mm256_madd_epi16(_mm256_add_epi16(_mm256_loadu_si256((__m256i *) &taps[0]), _mm256_loadu_si256((__m256i *) &mirrored[0])), pair));
+            sums[1] = _mm256_add_epi32(sums[1], _mm256_madd_epi16(_mm256_add_epi16(_mm256_loadu_si256((__m256i *) &taps[16]), _mm256_loadu_si256((__m256i *) &mirrored[16])), pair));
+            sums[2] = _mm256_add_epi32(sums[2], _mm256_madd_epi16(_mm256_add_epi16(_mm256_loadu_si256((__m256i *) &taps[32]), _mm256_loadu_si256((__m256i *) &mirrored[32])), pair));
+            sums[3] = _mm256_add_epi32(sums[3], _mm256_madd_epi16(_mm256_add_epi16(_mm256_loadu_si256((__m256i *) &taps[48]), _mm256_loadu_si256((__m256i *) &mirrored[48])), pair));
+            sums[4] = _mm256_add_epi32(sums[4], _mm256_madd_epi16(_mm256_add_epi16(_mm256_loadu_si256((__m256i *) &taps[64]), _mm256_loadu_si256((__m256i *) &mirrored[64])), pair));
+            sums[5] = _mm256_add_epi32(sums[5], _mm256_madd_epi16(_mm256_add_epi16(_mm256_loadu_si256((__m256i *) &taps[80]), _mm256_loadu_si256((__m256i *) &mirrored[80])), pair));
+            sums[6] = _mm256_add_epi32(sums[6], _mm256_madd_epi16(_mm256_add_epi16(_mm256_loadu_si256((__m256i *) &taps[96]), _mm256_loadu_si256((__m256i *) &mirrored[96])), pair));
+            sums[7] = _mm256_add_epi32(sums[7], _mm256_madd_epi16(_mm256_add_epi16(_mm256_loadu_si256((__m256i *) &taps[112]), _mm256_loadu_si256((__m256i *) &mirrored[112])), pair));
+        }
+        for (; m < pairCount; m++){
+            const __m256i pair = _mm256_set1_epi32(weightPair(&weights[2 * m]));
+            const Int2 *taps = &pairs[m][2 * i];
+            sums[0] = _mm256_add_epi32(sums[0], _mm256_madd_epi16(_mm256_loadu_si256((__m256i *) &taps[0]), pair));
+            sums[1] = _mm256_add_epi32(sums[1], _mm256_madd_epi16(_mm256_loadu_si256((__m256i *) &taps[16]), pair));
+            sums[2] = _mm256_add_epi32(sums[2], _mm256_madd_epi16(_mm256_loadu_si256((__m256i *) &taps[32]), pair));
+            sums[3] = _mm256_add_epi32(sums[3], _mm256_madd_epi16(_mm256_loadu_si256((__m256i *) &taps[48]), pair));
+            sums[4] = _mm256_add_epi32(sums[4], _mm256_madd_epi16(_mm256_loadu_si256((__m256i *) &taps[64]), pair));
+            sums[5] = _mm256_add_epi32(sums[5], _mm256_madd_epi16(_mm256_loadu_si256((__m256i *) &taps[80]), pair));
+            sums[6] = _mm256_add_epi32(sums[6], _mm256_madd_epi16(_mm256_loadu_si256((__m256i *) &taps[96]), pair));
+            sums[7] = _mm256_add_epi32(sums[7], _mm256_madd_epi16(_mm256_loadu_si256((__m256i *) &taps[112]), pair));
+        }
+        for (int j = 0; j < 8; j++) sums[j] = _mm256_sra_epi32(sums[j], count);
+        for (int j = 0; j < 2; j++){
+            __m256i words = _mm256_packus_epi16(_mm256_packs_epi32(sums[4 * j], sums[4 * j + 1]), _mm256_packs_epi32(sums[4 * j + 2], sums[4 * j + 3]));
+            _mm256_storeu_si256((__m256i *) &result[i + 32 * j], _mm256_permutevar8x32_epi32(words, order));
         }
     }
-    return result;
+    convolvePairsFrom(i, length, pairs, mirrors, weights, pairCount, mirroredCount, shift, result);
 }
 
-//Produces an error message in the case that there is a syntax error with the user's program call
-void invalidArg(char arg[]) {
-    printf("\"%s\" is an invalid effect or has an invalid effect parameter\n", arg);
-    exit(1);
+//Interleaves 32 pairs of bytes per iteration
+//The byte pairs are made in 128 bit halves and widened across the whole register, so they stay in order
+__attribute__((target("avx2")))
+void interleaveAVX2(long length, Byte const first[], Byte const second[], Int2 pairs[]){
+    long i = 0;
+    for (; i + 32 <= length; i += 32){
+        for (int half = 0; half < 32; half += 16){
+            __m128i a = _mm_loadu_si128((__m128i *) &first[i + half]);
+            __m128i b = _mm_loadu_si128((__m128i *) &second[i + half]);
+            _mm256_storeu_si256((__m256i *) &pairs[2 * (i + half)], _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(a, b)));
+            _mm256_storeu_si256((__m256i *) &pairs[2 * (i + half) + 16], _mm256_cvtepu8_epi16(_mm_unpackhi_epi8(a, b)));
+        }
+    }
+    interleaveSSE2(length - i, &first[i], &second[i], &pairs[2 * i]);
 }
 
-//Calls the effects in the order specified in the program arguments
-void effectsChain(int height, int width, Byte pixels[height][width][channels], ImageHeader *header, int argNum, char *args[argNum]){
-    const Byte standardArgs = 3;
-    for (int i = standardArgs; i < argNum; i++){
-        if(strcmp(args[i], "flipX") == 0) flipX(height, width, pixels);
-        else if(strcmp(args[i], "flipY") == 0) flipY(height, width, pixels);
-        else if(strcmp(args[i], "greyscale") == 0) greyscale(height, width, pixels);
-        else if(strcmp(args[i], "invert") == 0) invert(height, width, pixels);
-        else if(strcmp(args[i], "edges") == 0) edges(height, width, pixels);
-        else if(parseNum(args[i + 1]) != 0 && validArg(args[i])){
-            if(strcmp(args[i], "darken") == 0) darken(height, width, pixels, parseNum(args[i + 1]));
-            else if(strcmp(args[i], "brighten") == 0) brighten(height, width, pixels, parseNum(args[i + 1]));
-            else if(strcmp(args[i], "blur") == 0) blur(height, width, pixels, parseNum(args[i + 1]));
-            i++;
-        } else invalidArg(args[i]);
+#endif
+
+//Replaces every byte with its entry in a 256 entry table
+//Four independent lookups per iteration keep several loads in flight
+void lookupScalar(long length, Byte data[], const Byte table[256]){
+    long i = 0;
+    for (; i + 4 <= length; i += 4){
+        Byte value0 = table[data[i]];
+        Byte value1 = table[data[i + 1]];
+        Byte value2 = table[data[i + 2]];
+        Byte value3 = table[data[i + 3]];
+        data[i] = value0;
+        data[i + 1] = value1;
+        data[i + 2] = value2;
+        data[i + 3] = value3;
     }
+    for (; i < length; i++) data[i] = table[data[i]];
 }
 
-//Main pipeline
-//Calls the main functions related to importing, applying effects and outputting
-void proccessImage(int argNum, char *args[argNum]){
+//Set of per-pixel kernels for one instruction set
+//%toneRun% is the shortest run of tone effects that is faster as one table lookup than as separate kernels
+struct PixelKernels{
+    const char *name;
+    void (*invert)(long length, Byte data[]);
+    void (*darken)(long length, Byte data[], float scaling);
+    void (*brighten)(long length, Byte data[], float scaling);
+    void (*greyscale)(long length, Byte *planes[]);
+    void (*lookup)(long length, Byte data[], const Byte table[256]);
+    void (*reverse)(long length, Byte data[]);
+    void (*convolve)(long length, Byte const *sources[], const Int2 weights[], int taps, int shift, Byte result[]);
+    void (*convolvePairs)(long length, Int2 const *pairs[], Int2 const *mirrors[], const Int2 weights[], int pairCount, int mirroredCount, int shift, Byte result[]);
+    void (*interleave)(long length, Byte const first[], Byte const second[], Int2 pairs[]);
+    int toneRun;
+};
+
+typedef struct PixelKernels PixelKernels;
+
+const PixelKernels scalarKernels = {"scalar", invertScalar, darkenScalar, brightenScalar, greyscaleScalar, lookupScalar, reverseScalar, convolveScalar, convolvePairsScalar, interleaveScalar, 1};
+#if defined(__x86_64__) || defined(__i386__)
+const PixelKernels sse2Kernels = {"sse2", invertSSE2, darkenSSE2, brightenSSE2, greyscaleSSE2, lookupScalar, reverseSSE2, convolveSSE2, convolvePairsSSE2, interleaveSSE2, 2};
+const PixelKernels avx2Kernels = {"avx2", invertAVX2, darkenAVX2, brightenAVX2, greyscaleAVX2, lookupScalar, reverseAVX2, convolveAVX2, convolvePairsAVX2, interleaveAVX2, 2};
+#endif
+
+//Kernels used by the effects, chosen by selectKernels for the CPU the program runs on
+PixelKernels kernels = {"scalar", invertScalar, darkenScalar, brightenScalar, greyscaleScalar, lookupScalar, reverseScalar, convolveScalar, convolvePairsScalar, interleaveScalar, 1};
+
+//Picks the fastest set of kernels the CPU supports
+void selectKernels(){
+    kernels = scalarKernels;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) kernels = sse2Kernels;
+    if (__builtin_cpu_supports("avx2")) kernels = avx2Kernels;
+#endif
+}
+
+//IMAGE PROCESSING FUNCTIONS
+
+//Copies the contents of one buffer to another of the same size
+//Only the planes both buffers have are copied
+void copyPixels(PixelBuffer *pixels1, PixelBuffer *pixels2){
+    const int planeCount = pixels1->planeCount < pixels2->planeCount ? pixels1->planeCount : pixels2->planeCount;
+    for (int k = 0; k < planeCount; k++){
+        for (int i = 0; i < pixels1->height; i++) memcpy(planeRow(pixels2, k, i), planeRow(pixels1, k, i), pixels1->width);
+    }
+}
+
+//Swaps two non-overlapping runs of bytes through a small buffer
+void swapBytes(long length, Byte first[], Byte second[]){
+    Byte buffer[256];
+    for (long i = 0; i < length; i += sizeof(buffer)){
+        long chunk = length - i < (long) sizeof(buffer) ? length - i : (long) sizeof(buffer);
+        memcpy(buffer, &first[i], chunk);
+        memcpy(&first[i], &second[i], chunk);
+        memcpy(&second[i], buffer, chunk);
+    }
+}
+
+//Flips the image around a centrally a X-axis
+//Swaps each row with its mirror in place, so no copy of the image is needed
+void flipX(PixelBuffer *pixels){
+    int upperBound = pixels->height - 1;
+    for (int k = 0; k < pixels->planeCount; k++){
+        for (int i = 0; i < pixels->height / 2; i++) swapBytes(pixels->width, planeRow(pixels, k, i), planeRow(pixels, k, upperBound - i));
+    }
+}
+
+//Flips the image around a centrally a Y-axis
+//Reverses each row in place
+void flipY(PixelBuffer *pixels){
+    for (int k = 0; k < pixels->planeCount; k++){
+        for (int i = 0; i < pixels->height; i++) kernels.reverse(pixels->width, planeRow(pixels, k, i));
+    }
+}
+
+//Writes the transpose of a %height% x %width% block of bytes (row i of the source becomes column i of the destination)
+//The block is walked in square tiles so the rows being read and the rows being written both stay in cache
+//Strides may be negative to read or write the rows in reverse order
+void transposeBytes(const Byte source[], long sourceStride, Byte destination[], long destinationStride, int height, int width){
+    const int tile = 64;
+    for (int i0 = 0; i0 < height; i0 += tile){
+        const int iEnd = i0 + tile < height ? i0 + tile : height;
+        for (int j0 = 0; j0 < width; j0 += tile){
+            const int jEnd = j0 + tile < width ? j0 + tile : width;
+            for (int j = j0; j < jEnd; j++){
+                Byte *out = destination + j * destinationStride;
+                const Byte *in = source + i0 * sourceStride + j;
+                for (int i = i0; i < iEnd; i++, in += sourceStride) out[i] = *in;
+            }
+        }
+    }
+}
+
+//Replaces the image with its transpose, or with the image turned 90 degrees clockwise when %clockwise% is set
+//Turning clockwise is the transpose of the image with its rows in reverse order, so no flip is needed
+//The image has to own its memory, which is replaced by a new buffer of the turned size
+void reorient(PixelBuffer *pixels, bool clockwise){
+    assert(pixels->memory != NULL);
+    PixelBuffer turned;
+    createPlanes(&turned, pixels->width, pixels->height, pixels->planeCount);
+    for (int k = 0; k < pixels->planeCount; k++){
+        const Byte *source = clockwise ? planeRow(pixels, k, pixels->height - 1) : planeRow(pixels, k, 0);
+        const long sourceStride = clockwise ? -pixels->stride : pixels->stride;
+        transposeBytes(source, sourceStride, turned.planes[k], turned.stride, pixels->height, pixels->width);
+    }
+    freeBuffer(pixels);
+    *pixels = turned;
+}
+
+//Swaps the rows and columns of the image
+void transpose(PixelBuffer *pixels){
+    reorient(pixels, false);
+}
+
+//Turns the image 90 degrees clockwise
+void rotate90(PixelBuffer *pixels){
+    reorient(pixels, true);
+}
+
+//Darkens every pixel in the image across all colour channels
+//Rows of a plane are contiguous, so each plane is one run of bytes (padding included)
+void darken(PixelBuffer *pixels, float scaling){
+    scaling /= 100;
+    scaling = 1 - scaling;
+    for (Byte k = 0; k < channels; k++) kernels.darken(pixels->height * pixels->stride, pixels->planes[k], scaling);
+}
+
+//Brigtens every pixel in the image across all colour channels
+void brighten(PixelBuffer *pixels, float scaling){
+    scaling /= 100;
+    for (Byte k = 0; k < channels; k++) kernels.brighten(pixels->height * pixels->stride, pixels->planes[k], scaling);
+}
+
+//Converts a colour image into greyscale
+void greyscale(PixelBuffer *pixels){
+    kernels.greyscale(pixels->height * pixels->stride, pixels->planes);
+}
+
+//Inverts all colours
+void invert(PixelBuffer *pixels){
+    for (Byte k = 0; k < channels; k++) kernels.invert(pixels->height * pixels->stride, pixels->planes[k]);
+}
+
+//Tone effects map every byte to a new value on its own, so any run of them is a single 256 entry lookup table
+bool isToneEffect(int type){
+    return type == InvertOp || type == DarkenOp || type == BrightenOp;
+}
+
+//Number of consecutive tone effects at the start of the chain
+int toneRun(int effectCount, Effect effects[effectCount]){
+    int run = 0;
+    while (run < effectCount && isToneEffect(effects[run].type)) run++;
+    return run;
+}
+
+//Builds the lookup table of a run of tone effects by applying the effects to every possible byte value
+//The values go through the effects themselves, so the table rounds exactly as they do
+void toneTable(int effectCount, Effect effects[effectCount], Byte table[256]){
+    _Alignas(64) Byte values[3][256];
+    PixelBuffer identity = {1, 256, 256, {values[0], values[1], values[2], NULL}, NULL, 3};
+    for (int v = 0; v < 256; v++) values[0][v] = values[1][v] = values[2][v] = v;
+    for (int i = 0; i < effectCount; i++){
+        switch (effects[i].type){
+            case InvertOp: invert(&identity); break;
+            case DarkenOp: darken(&identity, effects[i].param); break;
+            case BrightenOp: brighten(&identity, effects[i].param); break;
+        }
+    }
+    memcpy(table, values[0], 256);
+}
+
+//Applies a tone lookup table to every channel
+void applyTone(PixelBuffer *pixels, const Byte table[256]){
+    for (Byte k = 0; k < channels; k++) kernels.lookup(pixels->height * pixels->stride, pixels->planes[k], table);
+}
+
+//Replaces each run of tone effects worth a table (see PixelKernels) with a single ToneOp, in place
+//Table n of %tables% holds the composed table of the n-th run, so it needs room for one table per effect
+//Returns the new number of effects
+int composeToneEffects(int effectCount, Effect effects[effectCount], Byte tables[][256]){
+    int composedCount = 0;
+    int tableCount = 0;
+    for (int i = 0; i < effectCount; i++){
+        int run = toneRun(effectCount - i, &effects[i]);
+        if (run >= kernels.toneRun){
+            toneTable(run, &effects[i], tables[tableCount]);
+            Effect tone = {ToneOp, run, tables[tableCount++]};
+            effects[composedCount++] = tone;
+            i += run - 1;
+        }
+        else effects[composedCount++] = effects[i];
+    }
+    return composedCount;
+}
+
+//Histogram effects (autolevels and equalize) map each colour value through a table built from the histogram of the whole image
+bool isHistogramEffect(int type){
+    return type == AutoLevelsOp || type == EqualizeOp;
+}
+
+//Adds the colour values of rows %first% to %last% (exclusive) of each colour plane to the 256 bins of its channel
+//Neighbouring pixels often have the same value, so the counts go to 4 sets of bins in turn to keep successive increments independent
+void countHistogram(PixelBuffer *pixels, int first, int last, long bins[][256]){
+    const int width = pixels->width;
+    for (Byte k = 0; k < channels; k++){
+        Int4 counts[4][256];
+        memset(counts, 0, sizeof(counts));
+        for (int i = first; i < last; i++){
+            Byte const *row = planeRow(pixels, k, i);
+            int j = 0;
+            for (; j + 4 <= width; j += 4){
+                counts[0][row[j]]++;
+                counts[1][row[j + 1]]++;
+                counts[2][row[j + 2]]++;
+                counts[3][row[j + 3]]++;
+            }
+            for (; j < width; j++) counts[0][row[j]]++;
+        }
+        for (int v = 0; v < 256; v++) bins[k][v] += (long) counts[0][v] + counts[1][v] + counts[2][v] + counts[3][v];
+    }
+}
+
+//Builds the autolevels table of one channel from its histogram
+//The darkest and brightest values are stretched to 0 and 255, ignoring the 0.1% of pixels at either end so a few outliers don't hold the range
+void levelsTable(const long bins[256], Byte table[256]){
+    long total = 0;
+    for (int v = 0; v < 256; v++) total += bins[v];
+    const long clip = total / 1000;
+    int low = 0;
+    int high = 255;
+    for (long count = bins[low]; count <= clip && low < 255; count += bins[low]) low++;
+    for (long count = bins[high]; count <= clip && high > 0; count += bins[high]) high--;
+    for (int v = 0; v < 256; v++){
+        if (high <= low) table[v] = v;
+        else if (v <= low) table[v] = 0;
+        else if (v >= high) table[v] = 255;
+        else table[v] = (2 * 255 * (v - low) + high - low) / (2 * (high - low));
+    }
+}
+
+//Builds the equalize table of one channel from its histogram
+//Each value maps to the fraction of the other pixels at or below it, which spreads the values evenly over 0 - 255
+void equalizeTable(const long bins[256], Byte table[256]){
+    long total = 0;
+    for (int v = 0; v < 256; v++) total += bins[v];
+    int darkest = 0;
+    while (darkest < 255 && bins[darkest] == 0) darkest++;
+    const long below = bins[darkest];
+    long cumulative = 0;
+    for (int v = 0; v < 256; v++){
+        cumulative += bins[v];
+        if (total == below) table[v] = v;
+        else if (v < darkest) table[v] = 0;
+        else table[v] = (2 * 255 * (cumulative - below) + total - below) / (2 * (total - below));
+    }
+}
+
+//Builds the table of a histogram effect for every colour channel
+void histogramTables(int type, long bins[][256], Byte tables[][256]){
+    for (Byte k = 0; k < channels; k++){
+        if (type == AutoLevelsOp) levelsTable(bins[k], tables[k]);
+        else equalizeTable(bins[k], tables[k]);
+    }
+}
+
+//Maps rows %first% to %last% (exclusive) of each colour plane through the table of its channel
+void remapRows(PixelBuffer *pixels, int first, int last, Byte tables[][256]){
+    for (Byte k = 0; k < channels; k++){
+        for (int i = first; i < last; i++) kernels.lookup(pixels->width, planeRow(pixels, k, i), tables[k]);
+    }
+}
+
+//Applies autolevels or equalize on the calling thread (runHistogramEffect splits the same two passes across a thread pool)
+//One pass counts the histogram of every colour channel, and a second maps the image through the tables built from it
+void histogramEffect(PixelBuffer *pixels, int type){
+    long bins[channels][256];
+    Byte tables[channels][256];
+    memset(bins, 0, sizeof(bins));
+    countHistogram(pixels, 0, pixels->height, bins);
+    histogramTables(type, bins, tables);
+    remapRows(pixels, 0, pixels->height, tables);
+}
+
+//Calculates new pixel value for a single pixel in blurred image
+//Sums the whole window, so it is only used as the reference the sliding window blur is tested against
+Byte blurKernel (PixelBuffer *pixels, int size, int i, int j, int k){
+    int lowerX = j - size;
+    int lowerY = i - size;
+    int upperX = j + size;
+    int upperY = i + size;
+    if (lowerX < 0) lowerX = 0;
+    if (lowerY < 0) lowerY = 0;
+    if (upperX >= pixels->width) upperX = pixels->width - 1;
+    if (upperY >= pixels->height) upperY = pixels->height - 1;
+    int sum = 0;
+    int pixelCount = 0;
+    for (int y = lowerY; y <= upperY; y++){
+        for (int x = lowerX; x <= upperX; x++){
+            sum += planeRow(pixels, k, y)[x];
+            pixelCount++;
+        }
+    }
+    int averageColour = sum / pixelCount;
+    return averageColour;
+
+}
+
+//Sums a row over a window of %size% pixels either side, clamped to the edges of the row
+//The window slides along the row so each sum costs one add and one subtract whatever the size
+void horizontalSums(int width, Byte const row[], int size, Int4 sums[]){
+    Int4 sum = 0;
+    for (int x = 0; x <= size && x < width; x++) sum += row[x];
+    for (int x = 0; x < width; x++){
+        sums[x] = sum;
+        if (x + size + 1 < width) sum += row[x + size + 1];
+        if (x - size >= 0) sum -= row[x - size];
+    }
+}
+
+//Adds (sign = 1) or subtracts (sign = -1) a row of horizontal sums from the running column sums
+void accumulateSums(int width, Int4 columnSums[], Int4 const rowSums[], int sign){
+    for (int x = 0; x < width; x++) columnSums[x] += sign * rowSums[x];
+}
+
+//Number of positions in a window of %size% either side of %centre%, clamped to [0, length)
+int windowLength(int centre, int size, int length){
+    int lower = centre - size < 0 ? 0 : centre - size;
+    int upper = centre + size >= length ? length - 1 : centre + size;
+    return upper - lower + 1;
+}
+
+//Blurs one colour plane
+//Separable box filter: horizontal window sums are kept for the rows in the vertical window and slid down the image
+void blurPlane(PixelBuffer *pixels, int k, int size, int windowRows, Int4 rowSums[windowRows][pixels->width], Int4 columnSums[]){
+    const int height = pixels->height;
+    const int width = pixels->width;
+    memset(columnSums, 0, sizeof(Int4) * width);
+    for (int y = 0; y <= size && y < height; y++){
+        horizontalSums(width, planeRow(pixels, k, y), size, rowSums[y % windowRows]);
+        accumulateSums(width, columnSums, rowSums[y % windowRows], 1);
+    }
+
+    for (int i = 0; i < height; i++){
+        const int rowCount = windowLength(i, size, height);
+        Byte *row = planeRow(pixels, k, i);
+        for (int j = 0; j < width; j++) row[j] = columnSums[j] / (rowCount * windowLength(j, size, width));
+        //Slide the window down: the row leaving is removed before its slot is reused by the row entering
+        if (i - size >= 0) accumulateSums(width, columnSums, rowSums[(i - size) % windowRows], -1);
+        if (i + size + 1 < height){
+            horizontalSums(width, planeRow(pixels, k, i + size + 1), size, rowSums[(i + size + 1) % windowRows]);
+            accumulateSums(width, columnSums, rowSums[(i + size + 1) % windowRows], 1);
+        }
+    }
+}
+
+//Blurs the image
+//Gives exactly the same result as applying blurKernel to every pixel, in constant time per pixel whatever the size
+void blur(PixelBuffer *pixels, int size){
+    //Ring buffer holding the horizontal sums of every row currently inside the vertical window
+    const int width = pixels->width;
+    const int windowRows = 2 * size + 1 < pixels->height ? 2 * size + 1 : pixels->height;
+    Int4 (*rowSums)[width] = mallocCheck(sizeof(Int4[windowRows][width]));
+    Int4 *columnSums = mallocCheck(sizeof(Int4) * width);
+    for (Byte k = 0; k < channels; k++) blurPlane(pixels, k, size, windowRows, rowSums, columnSums);
+    free(rowSums);
+    free(columnSums);
+}
+
+//Number of columns the vertical pass of a separable kernel works on at once
+//The pairs of rows in the kernel's window are only kept for one strip, so they stay in the cache while every output row reuses them
+const int convolutionStrip = 512;
+
+//Smallest and largest row (or column) index, used to repeat the edge pixels beyond the edges of the image
+int clampIndex(int index, int length){
+    if (index < 0) return 0;
+    if (index >= length) return length - 1;
+    return index;
+}
+
+//Copies a row into %padded%, which has %radius% extra bytes on the left and %radius% + 1 on the right repeating the first and last bytes
+//The extra byte on the right gives the last byte of the padded row a neighbour to be paired with
+void padRow(int width, Byte const row[], int radius, Byte padded[]){
+    memset(padded, row[0], radius);
+    memcpy(padded + radius, row, width);
+    memset(padded + radius + width, row[width - 1], radius + 1);
+}
+
+//Whether the weights of a 1-D kernel are the same on both sides of the centre, as those of gaussian and sharpen are
+bool isSymmetric(int radius, const Int2 weights[]){
+    for (int t = 0; t < radius; t++){
+        if (weights[t] != weights[2 * radius - t]) return false;
+    }
+    return true;
+}
+
+//Number of tap pairs a 1-D kernel is applied with when %mirroredCount% of them are added to their mirror images first
+int kernelPairCount(int radius, int mirroredCount){
+    return radius + 1 - mirroredCount;
+}
+
+//Groups the 2 * radius + 1 weights of a 1-D kernel into the pairs of taps it is applied with, pair m weighting taps 2m and 2m + 1
+//The first %mirroredCount% pairs also weight their mirror images, taps 2 * radius - 2m and 2 * radius - 2m - 1, so the pairs that follow
+//only have to reach the centre, and a tap left on its own is paired with a weight of 0
+void pairWeightsOf(int radius, const Int2 weights[], int mirroredCount, Int2 paired[]){
+    const int lastTap = 2 * radius - 2 * mirroredCount;
+    for (int m = 0; m < kernelPairCount(radius, mirroredCount); m++){
+        paired[2 * m] = weights[2 * m];
+        paired[2 * m + 1] = 2 * m + 1 <= lastTap ? weights[2 * m + 1] : 0;
+    }
+}
+
+//Applies a 1-D kernel along every row of a plane in place
+//Each padded row is interleaved with itself shifted by one byte, so the tap pair starting at any tap is a contiguous array
+//A kernel with mirrored pairs also needs the row interleaved the other way round, in %rowMirrors%, for the pairs of its mirror image taps
+void convolveRows(PixelBuffer *pixels, int k, int radius, const Int2 paired[], int mirroredCount, int shift, Byte padded[], Int2 rowPairs[], Int2 rowMirrors[]){
+    const int pairCount = kernelPairCount(radius, mirroredCount);
+    const long pairedWidth = pixels->width + 2 * radius;
+    Int2 const *pairs[pairCount];
+    Int2 const *mirrors[mirroredCount + 1];
+    for (int m = 0; m < pairCount; m++) pairs[m] = rowPairs + 2 * 2 * m;
+    for (int m = 0; m < mirroredCount; m++) mirrors[m] = rowMirrors + 2 * (2 * radius - 2 * m - 1);
+    for (int i = 0; i < pixels->height; i++){
+        Byte *row = planeRow(pixels, k, i);
+        padRow(pixels->width, row, radius, padded);
+        kernels.interleave(pairedWidth, padded, padded + 1, rowPairs);
+        if (mirroredCount > 0) kernels.interleave(pairedWidth, padded + 1, padded, rowMirrors);
+        kernels.convolvePairs(pixels->width, pairs, mirrors, paired, pairCount, mirroredCount, shift, row);
+    }
+}
+
+//Applies a 1-D kernel down every column of a plane in place, one strip of columns at a time
+//Each row of the window is interleaved with the row below it in a ring of %taps% row pairs, made before either row is overwritten
+//Only every other pair (and the last) is used by an output row, the rest are used by the next output row
+//A kernel with mirrored pairs also keeps a ring of each row interleaved with the row below the other way round, in %mirrorRing%
+void convolveColumns(PixelBuffer *pixels, int k, int radius, const Int2 paired[], int mirroredCount, int shift, Int2 ring[], Int2 mirrorRing[]){
+    const int height = pixels->height;
+    const int taps = 2 * radius + 1;
+    const int pairCount = kernelPairCount(radius, mirroredCount);
+    const long pairSize = 2 * convolutionStrip;
+    Int2 const *pairs[pairCount];
+    Int2 const *mirrors[mirroredCount + 1];
+    for (int x = 0; x < pixels->width; x += convolutionStrip){
+        const int stripWidth = x + convolutionStrip < pixels->width ? convolutionStrip : pixels->width - x;
+        //Window rows are numbered from -radius so the ring slot of a row is never negative
+        for (int y = -radius; y < radius; y++){
+            Byte *first = planeRow(pixels, k, clampIndex(y, height)) + x;
+            Byte *second = planeRow(pixels, k, clampIndex(y + 1, height)) + x;
+            kernels.interleave(stripWidth, first, second, ring + ((y + radius) % taps) * pairSize);
+            if (mirroredCount > 0) kernels.interleave(stripWidth, second, first, mirrorRing + ((y + radius) % taps) * pairSize);
+        }
+        for (int i = 0; i < height; i++){
+            const int y = i + radius;
+            Byte *first = planeRow(pixels, k, clampIndex(y, height)) + x;
+            Byte *second = planeRow(pixels, k, clampIndex(y + 1, height)) + x;
+            kernels.interleave(stripWidth, first, second, ring + ((y + radius) % taps) * pairSize);
+            if (mirroredCount > 0) kernels.interleave(stripWidth, second, first, mirrorRing + ((y + radius) % taps) * pairSize);
+            //The pair starting at tap t of output row i is in ring slot (i + t) % taps
+            for (int m = 0; m < pairCount; m++) pairs[m] = ring + ((i + 2 * m) % taps) * pairSize;
+            for (int m = 0; m < mirroredCount; m++) mirrors[m] = mirrorRing + ((i + 2 * radius - 2 * m - 1) % taps) * pairSize;
+            kernels.convolvePairs(stripWidth, pairs, mirrors, paired, pairCount, mirroredCount, shift, planeRow(pixels, k, i) + x);
+        }
+    }
+}
+
+//Applies a square kernel to a plane in place
+//The rows of the window are kept padded in a ring of %size% rows, so every weight has a source row shifted by its column
+void convolveSquare(PixelBuffer *pixels, int k, int radius, const Int2 weights[], int shift, Byte ring[]){
+    const int height = pixels->height;
+    const int width = pixels->width;
+    const int size = 2 * radius + 1;
+    const int paddedWidth = width + 2 * radius + 1;
+    Byte const *sources[size * size];
+    for (int y = 0; y < radius && y < height; y++) padRow(width, planeRow(pixels, k, y), radius, ring + (y % size) * paddedWidth);
+    for (int i = 0; i < height; i++){
+        if (i + radius < height) padRow(width, planeRow(pixels, k, i + radius), radius, ring + ((i + radius) % size) * paddedWidth);
+        for (int dy = 0; dy < size; dy++){
+            Byte *source = ring + (clampIndex(i - radius + dy, height) % size) * paddedWidth;
+            for (int dx = 0; dx < size; dx++) sources[dy * size + dx] = source + dx;
+        }
+        kernels.convolve(width, sources, weights, size * size, shift, planeRow(pixels, k, i));
+    }
+}
+
+//Convolves every colour plane with the kernel, repeating the edge pixels beyond the edges of the image
+//A separable kernel costs 2 * (2 * radius + 1) multiplies per pixel rather than (2 * radius + 1)^2
+//%mirror% flips the kernel in the axes it names
+void convolve(PixelBuffer *pixels, Kernel *kernel, int mirror){
+    const int radius = kernel->radius;
+    const int size = 2 * radius + 1;
+    const int paddedWidth = pixels->width + 2 * radius + 1;
+    if (kernel->separable){
+        Int2 rowWeights[size];
+        Int2 columnWeights[size];
+        for (int t = 0; t < size; t++){
+            rowWeights[t] = kernel->weights[(mirror & MirrorColumns) ? size - 1 - t : t];
+            columnWeights[t] = kernel->weights[(mirror & MirrorRows) ? size - 1 - t : t];
+        }
+        //A symmetric kernel adds each tap to its mirror image before weighting them, which halves the multiply-adds
+        const int mirroredCount = isSymmetric(radius, kernel->weights) ? radius / 2 : 0;
+        Int2 rowPaired[size + 1];
+        Int2 columnPaired[size + 1];
+        pairWeightsOf(radius, rowWeights, mirroredCount, rowPaired);
+        pairWeightsOf(radius, columnWeights, mirroredCount, columnPaired);
+        Byte *padded = mallocCheck(paddedWidth);
+        Int2 *rowPairs = mallocCheck(sizeof(Int2) * 2 * 2 * paddedWidth);
+        Int2 *ring = mallocCheck(sizeof(Int2) * 2 * 2 * convolutionStrip * size);
+        for (Byte k = 0; k < channels; k++){
+            convolveRows(pixels, k, radius, rowPaired, mirroredCount, kernel->shift, padded, rowPairs, rowPairs + 2 * paddedWidth);
+            convolveColumns(pixels, k, radius, columnPaired, mirroredCount, kernel->shift, ring, ring + 2 * convolutionStrip * size);
+        }
+        free(padded);
+        free(rowPairs);
+        free(ring);
+        return;
+    }
+    Int2 weights[size * size];
+    for (int dy = 0; dy < size; dy++){
+        for (int dx = 0; dx < size; dx++){
+            const int y = (mirror & MirrorRows) ? size - 1 - dy : dy;
+            const int x = (mirror & MirrorColumns) ? size - 1 - dx : dx;
+            weights[dy * size + dx] = kernel->weights[y * size + x];
+        }
+    }
+    Byte *ring = mallocCheck(size * paddedWidth);
+    for (Byte k = 0; k < channels; k++) convolveSquare(pixels, k, radius, weights, kernel->shift, ring);
+    free(ring);
+}
+
+//Radius of the gaussian kernel with standard deviation %sigma%; weights more than 3 standard deviations out are negligible
+int gaussianRadius(int sigma){
+    return 3 * sigma;
+}
+
+//Fills in the weights of a gaussian kernel with standard deviation %sigma%
+//The weights are rounded down, then the weights that lost the most are rounded up (in symmetric pairs) until they add up to exactly 1
+//So flat areas stay flat and the kernel stays symmetric and peaks in the centre
+void gaussianWeights(int sigma, Int2 weights[]){
+    const int radius = gaussianRadius(sigma);
+    const int one = 1 << WeightBits;
+    double values[radius + 1];
+    double total = 0;
+    for (int t = 0; t <= radius; t++){
+        values[t] = exp(-(double) ((radius - t) * (radius - t)) / (2.0 * sigma * sigma));
+        total += t < radius ? 2 * values[t] : values[t];
+    }
+    int sum = 0;
+    for (int t = 0; t <= radius; t++){
+        values[t] = values[t] / total * one;
+        weights[t] = weights[2 * radius - t] = values[t];
+        values[t] -= weights[t];
+        sum += t < radius ? 2 * weights[t] : weights[t];
+    }
+    while (sum < one){
+        //A single unit left over can only go to the centre
+        int largest = radius;
+        for (int t = 0; t < radius && one - sum >= 2; t++){
+            if (values[t] > values[largest]) largest = t;
+        }
+        if (largest < radius){
+            weights[largest]++;
+            weights[2 * radius - largest]++;
+            sum += 2;
+        }
+        else {
+            //The centre has no partner, so it takes 2 units unless that would leave one over
+            const int extra = (one - sum) % 2 == 1 ? 1 : 2;
+            weights[radius] += extra;
+            sum += extra;
+        }
+        values[largest] = -1;
+    }
+}
+
+//Blurs the image with a gaussian of standard deviation %sigma%
+void gaussian(PixelBuffer *pixels, int sigma){
+    Int2 weights[2 * gaussianRadius(sigma) + 1];
+    gaussianWeights(sigma, weights);
+    Kernel kernel = {gaussianRadius(sigma), true, weights, WeightBits};
+    convolve(pixels, &kernel, 0);
+}
+
+//Sharpens the image by adding the difference between each pixel and its 4 neighbours
+void sharpen(PixelBuffer *pixels){
+    const int one = 1 << WeightBits;
+    Int2 weights[] = {0, -one, 0, -one, 5 * one, -one, 0, -one, 0};
+    Kernel kernel = {1, false, weights, WeightBits};
+    convolve(pixels, &kernel, 0);
+}
+
+//Convolves the image by summing the weights of every pixel directly
+//Only used as the reference the convolution engine is tested against, so it rounds between the two passes of a separable kernel as convolve does
+void convolveReference(PixelBuffer *pixels, Kernel *kernel, int mirror){
+    const int height = pixels->height;
+    const int width = pixels->width;
+    const int radius = kernel->radius;
+    const int size = 2 * radius + 1;
+    PixelBuffer original;
+    createBuffer(&original, height, width);
+    for (int pass = 0; pass < (kernel->separable ? 2 : 1); pass++){
+        copyPixels(pixels, &original);
+        for (Byte k = 0; k < channels; k++){
+            for (int i = 0; i < height; i++){
+                for (int j = 0; j < width; j++){
+                    Int4 sum = 0;
+                    for (int dy = -radius; dy <= radius; dy++){
+                        for (int dx = -radius; dx <= radius; dx++){
+                            const int y = clampIndex(i + ((mirror & MirrorRows) ? -dy : dy), height);
+                            const int x = clampIndex(j + ((mirror & MirrorColumns) ? -dx : dx), width);
+                            Int4 weight;
+                            if (!kernel->separable) weight = kernel->weights[(dy + radius) * size + dx + radius];
+                            else if (pass == 0) weight = dy == 0 ? kernel->weights[dx + radius] : 0;
+                            else weight = dx == 0 ? kernel->weights[dy + radius] : 0;
+                            sum += weight * planeRow(&original, k, y)[x];
+                        }
+                    }
+                    planeRow(pixels, k, i)[j] = weightedByte(sum, kernel->shift);
+                }
+            }
+        }
+    }
+    freeBuffer(&original);
+}
+
+//Resampling object definition
+//Output pixel %o% along an axis is the sum of %taps% input pixels starting at %starts[o]%, weighted by %weights[o * taps]% onwards
+//The weights of each output pixel are fixed point values summing to exactly 1 << WeightBits
+struct Resampling{
+    int taps;
+    int *starts;
+    Int2 *weights;
+};
+
+typedef struct Resampling Resampling;
+
+//Distance from its centre, in pixels of the smaller image, beyond which a filter is 0
+double filterSupport(int filter){
+    if (filter == BoxFilter) return 0.5;
+    if (filter == BilinearFilter) return 1;
+    return 3;
+}
+
+//Value of a filter at distance %x% from its centre
+//The box is half open so a pixel on the boundary between two output pixels counts towards only one of them
+//Lanczos is a sinc windowed by a wider sinc, which keeps edges sharp at the cost of slight ringing
+double filterValue(int filter, double x){
+    const double pi = 3.14159265358979323846;
+    if (filter == BoxFilter) return x >= -0.5 && x < 0.5 ? 1 : 0;
+    if (filter == BilinearFilter) return fabs(x) < 1 ? 1 - fabs(x) : 0;
+    if (x == 0) return 1;
+    if (fabs(x) >= 3) return 0;
+    return 3 * sin(pi * x) * sin(pi * x / 3) / (pi * pi * x * x);
+}
+
+//Works out the weights for resampling %inLength% pixels to %outLength% pixels
+//The centres of the output pixels are spread evenly over the input, and when shrinking the filter is stretched by the scale so every input pixel counts
+//Taps beyond the edges repeat the edge pixels, so their weights are added to the edge pixels to keep the taps of each output pixel in one run
+void createResampling(Resampling *resampling, int inLength, int outLength, int filter){
+    const int one = 1 << WeightBits;
+    const double scale = (double) inLength / outLength;
+    const double filterScale = scale > 1 ? scale : 1;
+    const double support = filterSupport(filter) * filterScale;
+    int taps = (int) ceil(2 * support) + 1;
+    if (taps > inLength) taps = inLength;
+    resampling->taps = taps;
+    resampling->starts = mallocCheck(sizeof(int) * outLength);
+    resampling->weights = mallocCheck(sizeof(Int2) * outLength * taps);
+    double *values = mallocCheck(sizeof(double) * taps);
+    for (int o = 0; o < outLength; o++){
+        const double centre = (o + 0.5) * scale - 0.5;
+        const int first = (int) ceil(centre - support);
+        const int last = (int) floor(centre + support);
+        int start = clampIndex(first, inLength);
+        if (start + taps > inLength) start = inLength - taps;
+        for (int t = 0; t < taps; t++) values[t] = 0;
+        double total = 0;
+        for (int i = first; i <= last; i++){
+            const double value = filterValue(filter, (i - centre) / filterScale);
+            values[clampIndex(i, inLength) - start] += value;
+            total += value;
+        }
+        //As for gaussianWeights, the rounding error is added to the largest weight
+        Int2 *weights = &resampling->weights[o * taps];
+        Int4 sum = 0;
+        int largest = 0;
+        for (int t = 0; t < taps; t++){
+            weights[t] = lround(values[t] / total * one);
+            sum += weights[t];
+            if (values[t] > values[largest]) largest = t;
+        }
+        weights[largest] += one - sum;
+        resampling->starts[o] = start;
+    }
+    free(values);
+}
+
+//Releases the memory held by a resampling
+void freeResampling(Resampling *resampling){
+    free(resampling->starts);
+    free(resampling->weights);
+}
+
+//Resamples every row of %source% into the narrower or wider rows of %result%, which has the same number of rows
+void resampleRows(PixelBuffer *source, PixelBuffer *result, Resampling *resampling){
+    const int taps = resampling->taps;
+    for (int k = 0; k < source->planeCount; k++){
+        for (int i = 0; i < source->height; i++){
+            Byte const *row = planeRow(source, k, i);
+            Byte *resultRow = planeRow(result, k, i);
+            for (int j = 0; j < result->width; j++){
+                Byte const *in = &row[resampling->starts[j]];
+                const Int2 *weights = &resampling->weights[j * taps];
+                Int4 sum = 0;
+                for (int t = 0; t < taps; t++) sum += weights[t] * in[t];
+                resultRow[j] = weightedByte(sum, WeightBits);
+            }
+        }
+    }
+}
+
+//Resamples the columns of %source% into %result%, which has the same width
+//Every output row is a weighted sum of whole input rows, so the vector convolution kernels do the work
+void resampleColumns(PixelBuffer *source, PixelBuffer *result, Resampling *resampling){
+    const int taps = resampling->taps;
+    Byte const **sources = mallocCheck(sizeof(Byte *) * taps);
+    for (int k = 0; k < source->planeCount; k++){
+        for (int i = 0; i < result->height; i++){
+            for (int t = 0; t < taps; t++) sources[t] = planeRow(source, k, resampling->starts[i] + t);
+            kernels.convolve(result->width, sources, &resampling->weights[i * taps], taps, WeightBits, planeRow(result, k, i));
+        }
+    }
+    free(sources);
+}
+
+//Resamples the image to %height% x %width% pixels with the given filter in a single pass over each axis
+//The rows are resampled first and then the columns, each with fixed point weights as in convolve
+//The image has to own its memory, which is replaced by a new buffer of the new size
+void resamplePixels(PixelBuffer *pixels, int height, int width, int filter){
+    assert(pixels->memory != NULL);
+    Resampling across;
+    Resampling down;
+    createResampling(&across, pixels->width, width, filter);
+    createResampling(&down, pixels->height, height, filter);
+    PixelBuffer narrowed;
+    PixelBuffer resized;
+    createPlanes(&narrowed, pixels->height, width, pixels->planeCount);
+    createPlanes(&resized, height, width, pixels->planeCount);
+    resampleRows(pixels, &narrowed, &across);
+    resampleColumns(&narrowed, &resized, &down);
+    freeResampling(&across);
+    freeResampling(&down);
+    freeBuffer(&narrowed);
+    freeBuffer(pixels);
+    *pixels = resized;
+}
+
+//Resamples the image to %height% x %width% pixels with the given filter
+//A shrink by more than maxShrink is first made in box filtered steps of maxShrink until what is left is within it
+//Each step rounds every pixel, so the steps are as large as they can be rather than halvings
+void resizeTo(PixelBuffer *pixels, int height, int width, int filter){
+    while (pixels->height > height * maxShrink || pixels->width > width * maxShrink){
+        const int stepHeight = pixels->height > height * maxShrink ? pixels->height / maxShrink : pixels->height;
+        const int stepWidth = pixels->width > width * maxShrink ? pixels->width / maxShrink : pixels->width;
+        resamplePixels(pixels, stepHeight, stepWidth, BoxFilter);
+    }
+    resamplePixels(pixels, height, width, filter);
+}
+
+//Works out the size a resize produces from a %height% x %width% image
+//A target of 0 takes the size that keeps the aspect ratio of the image
+void resizeShape(Effect *effect, int *height, int *width){
+    int newHeight = effect->height;
+    int newWidth = effect->width;
+    if (newHeight == 0) newHeight = lround((double) *height * newWidth / *width);
+    if (newWidth == 0) newWidth = lround((double) *width * newHeight / *height);
+    *height = newHeight < 1 ? 1 : newHeight > maxResize ? maxResize : newHeight;
+    *width = newWidth < 1 ? 1 : newWidth > maxResize ? maxResize : newWidth;
+}
+
+//Resizes the image as given by a resize effect
+void resize(PixelBuffer *pixels, Effect *effect){
+    int height = pixels->height;
+    int width = pixels->width;
+    resizeShape(effect, &height, &width);
+    resizeTo(pixels, height, width, effect->param);
+}
+
+//Exact integer square root (rounded down)
+int isqrt(int n){
+    int root = 0;
+    int bit = 1 << 30;
+    while (bit > n) bit >>= 2;
+    while (bit != 0){
+        if (n >= root + bit){
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        } else root >>= 1;
+        bit >>= 2;
+    }
+    return root;
+}
+
+//Fills the table of gradient magnitudes, floor(sqrt(gx^2 + gy^2)) for every |gx| and |gy| a Sobel kernel can produce
+void initialiseEdgeTable(){
+    for (int x = 0; x <= MaxGradient; x++){
+        for (int y = 0; y <= MaxGradient; y++) edgeMagnitudes[x][y] = isqrt(x * x + y * y);
+    }
+}
+
+//Converts a colour plane of unsigned bytes into an array of 2-byte signed integers
+void byteToInt(PixelBuffer *pixels, int k, Int2 values[pixels->height][pixels->width]){
+    for (int i = 0; i < pixels->height; i++){
+        Byte *row = planeRow(pixels, k, i);
+        for (int j = 0; j < pixels->width; j++) values[i][j] = row[j];
+    }
+}
+
+//Copies an array of 2-byte signed integers into another array
+void copySignedVals(int height, int width, Int2 pixels1[height][width], Int2 pixels2[height][width]){
+    for (int i = 0; i < height; i++){
+        for (int j = 0; j < width; j++) pixels2[i][j] = pixels1[i][j];
+    }
+}
+
+//Convolves a single pixel with a kernel
+//The kernel and convolution functions are the reference the single pass Sobel engine is tested and benchmarked against
+Int2 edgeKernel(int height, int width, Int2 pixels[height][width], Int2 kernel[kSize][kSize], int y, int x){
+    int sum = 0;
+    for (int i = 0; i < kSize ; i++){
+        for (int j = 0; j < kSize; j++){
+            sum += (pixels[y + i - 1][x + j - 1] * kernel[i][j]);
+        }
+    }
+    int averageColour = sum / (kSize * kSize);
+    return averageColour;
+}
+
+//Performs kernel convolution across an entire colour plane
+void edgeConvolution(int height, int width, Int2 pixels[height][width], Int2 kernel[kSize][kSize]){
+    Int2 (*pixelsCopy)[width] = mallocCheck(sizeof(Int2[height][width]));
+    copySignedVals(height, width, pixels, pixelsCopy);
+    for (int i = 1; i < height - 1; i++){
+        for (int j = 1; j < width - 1; j++) pixels[i][j] = edgeKernel(height, width, pixelsCopy, kernel, i, j);
+    }
+    free(pixelsCopy);
+}
+
+//Reference Sobel edge detection: one full convolution (and copy) per gradient per channel, then a floating point magnitude
+void edgesReference(PixelBuffer *pixels){
+    greyscale(pixels);
+
+    const int height = pixels->height;
+    const int width = pixels->width;
+    Int2 (*gradX)[width] = mallocCheck(sizeof(Int2[height][width]));
+    Int2 (*gradY)[width] = mallocCheck(sizeof(Int2[height][width]));
+    Int2 xKernel[3][3] = {{-1,0,1},{-2,0,2},{-1,0,1}};
+    Int2 yKernel[3][3] = {{-1,-2,-1},{0,0,0},{1,2,1}};
+
+    for (Byte k = 0; k < channels; k++){
+        byteToInt(pixels, k, gradX);
+        edgeConvolution(height, width, gradX, xKernel);
+
+        byteToInt(pixels, k, gradY);
+        edgeConvolution(height, width, gradY, yKernel);
+
+        for (int i = 1; i < height - 1; i++){
+            Byte *row = planeRow(pixels, k, i);
+            for (int j = 1; j < width - 1; j++){
+                 row[j] = sqrt((gradX[i][j] * gradX[i][j]) + (gradY[i][j] * gradY[i][j]));
+            }
+        }
+    }
+    free(gradX);
+    free(gradY);
+}
+
+//Computes one row of Sobel gradient magnitudes from the greyscale rows above, at and below it
+//Both gradients are formed together from the same 6 neighbours and looked up in the magnitude table
+void sobelRow(int width, Byte const above[], Byte const centre[], Byte const below[], Byte result[]){
+    const int normalisation = 9;
+    result[0] = centre[0];
+    for (int j = 1; j < width - 1; j++){
+        int gradX = ((above[j + 1] - above[j - 1]) + 2 * (centre[j + 1] - centre[j - 1]) + (below[j + 1] - below[j - 1])) / normalisation;
+        int gradY = ((below[j - 1] + 2 * below[j] + below[j + 1]) - (above[j - 1] + 2 * above[j] + above[j + 1])) / normalisation;
+        result[j] = edgeMagnitudes[abs(gradX)][abs(gradY)];
+    }
+    if (width > 1) result[width - 1] = centre[width - 1];
+}
+
+//Perorms Sobel edge detection across the image
+//Single pass: each row is converted to greyscale in place and kept in a ring of 3 rows, and once the row below is known
+//the magnitudes for the row above it are written straight back to every plane (edge rows and columns stay greyscale)
+void edges(PixelBuffer *pixels){
+    const int height = pixels->height;
+    const int width = pixels->width;
+    Byte (*grey)[width] = mallocCheck(sizeof(Byte[3][width]));
+
+    for (int i = 0; i < height; i++){
+        Byte *rowPlanes[channels];
+        for (Byte k = 0; k < channels; k++) rowPlanes[k] = planeRow(pixels, k, i);
+        kernels.greyscale(width, rowPlanes);
+        memcpy(grey[i % 3], rowPlanes[0], width);
+
+        if (i >= 2){
+            Byte *result = planeRow(pixels, 0, i - 1);
+            sobelRow(width, grey[(i - 2) % 3], grey[(i - 1) % 3], grey[i % 3], result);
+            for (Byte k = 1; k < channels; k++) memcpy(planeRow(pixels, k, i - 1), result, width);
+        }
+    }
+    free(grey);
+}
+
+//Checks if the parameter following an effect is valid
+//Returns a valid parameter or 0 otherwise
+int parseNum(char arg[]){
+    int result = 0;
+    if (arg != NULL) {
+        result = atoi(arg);
+        for (int i = 0; i < strlen(arg);i++){
+            if (arg[i] < '0' || arg[i] > '9') {
+                result = 0;
+                break;
+            }
+        }
+        if (result > 100 || result < 1) result = 0;
+    }
+    return result;
+}
+
+//Checks whether an effect argument is valid or not
+bool validArg(char arg[]){
+    bool result = false;
+    const Byte numOfFunctions = 4;
+    char validStrs[4][10] = {"darken","brighten","blur","gaussian"};
+    for (int i = 0; i < numOfFunctions; i++){
+        if (strcmp(arg,validStrs[i]) == 0) {
+            result = true;
+            break;
+        }
+    }
+    return result;
+}
+
+//Produces an error message in the case that there is a syntax error with the user's program call
+void invalidArg(char arg[]) {
+    printf("\"%s\" is an invalid effect or has an invalid effect parameter\n", arg);
+    exit(1);
+}
+
+//Converts integer kernel weights to fixed point with %shift% fractional bits, dividing them by their sum unless it is 0 or less
+//Returns false if a weight doesn't fit in 16 bits
+bool scaleKernel(int count, const int values[count], int shift, Int2 weights[count]){
+    const int one = 1 << shift;
+    Int4 sum = 0;
+    for (int i = 0; i < count; i++) sum += values[i];
+    const Int4 divisor = sum > 0 ? sum : 1;
+    Int4 weightSum = 0;
+    for (int i = 0; i < count; i++){
+        //Round to the nearest fixed point value, halves away from zero
+        Int4 scaled = values[i] * one;
+        Int4 weight = (scaled + (scaled < 0 ? -divisor : divisor) / 2) / divisor;
+        if (weight < INT16_MIN || weight > INT16_MAX) return false;
+        weights[i] = weight;
+        weightSum += weight;
+    }
+    //As for gaussianWeights, a kernel that averages has its rounding error added to the centre weight
+    if (sum > 0){
+        Int4 centre = weights[count / 2] + one - weightSum;
+        if (centre < INT16_MIN || centre > INT16_MAX) return false;
+        weights[count / 2] = centre;
+    }
+    return true;
+}
+
+//Reads a kernel given as comma separated integer weights, with the rows of a square kernel separated by '/'
+//A single row is separable: it is applied along the rows and then down the columns
+//The weights are divided by their sum (unless it is 0 or less) and converted to fixed point
+//Large weights such as the 8 of a Laplacian don't fit in 16 bits with WeightBits fractional bits, so they get as many as fit
+//Weights that don't divide by the sum are integers, so these kernels lose nothing
+//Returns NULL if the kernel is not valid
+Kernel *parseKernel(char arg[]){
+    if (arg == NULL) return NULL;
+    const int maxSize = 2 * MaxKernelRadius + 1;
+    const int maxWeight = 1000;
+    int values[maxSize * maxSize];
+    int count = 0;
+    int rowCount = 1;
+    int rowLength = 0;
+    int columnCount = 0;
+    char *position = arg;
+    while (true){
+        char *end;
+        long value = strtol(position, &end, 10);
+        if (end == position || value < -maxWeight || value > maxWeight || count == maxSize * maxSize) return NULL;
+        values[count++] = value;
+        rowLength++;
+        if (*end == '/' || *end == '\0'){
+            if (rowCount == 1) columnCount = rowLength;
+            else if (rowLength != columnCount) return NULL;
+            rowLength = 0;
+            if (*end == '\0') break;
+            rowCount++;
+        }
+        else if (*end != ',') return NULL;
+        position = end + 1;
+    }
+    if (columnCount % 2 == 0 || columnCount > maxSize || (rowCount > 1 && rowCount != columnCount)) return NULL;
+
+    //With no fractional bits every weight is at most maxWeight, so some shift always fits
+    Int2 weights[count];
+    int shift = WeightBits;
+    while (!scaleKernel(count, values, shift, weights)) shift--;
+
+    Kernel *kernel = mallocCheck(sizeof(Kernel));
+    kernel->radius = columnCount / 2;
+    kernel->separable = rowCount == 1;
+    kernel->shift = shift;
+    kernel->weights = mallocCheck(sizeof(Int2) * count);
+    memcpy(kernel->weights, weights, sizeof(Int2) * count);
+    return kernel;
+}
+
+//Reads the size given to resize as WIDTHxHEIGHT, where one of them may be 0 to keep the aspect ratio of the image
+//Returns false if the size is not valid
+bool parseSize(char arg[], int *width, int *height){
+    if (arg == NULL || arg[0] < '0' || arg[0] > '9') return false;
+    char *end;
+    long newWidth = strtol(arg, &end, 10);
+    if (*end != 'x' || end[1] < '0' || end[1] > '9') return false;
+    long newHeight = strtol(end + 1, &end, 10);
+    if (*end != '\0' || newWidth > maxResize || newHeight > maxResize || (newWidth == 0 && newHeight == 0)) return false;
+    *width = newWidth;
+    *height = newHeight;
+    return true;
+}
+
+//Names of the resampling filters, indexed by filter
+const char *filterNames[] = {"", "box", "bilinear", "lanczos"};
+
+//Checks if an argument names a resampling filter
+//Returns the filter or 0 otherwise
+int parseFilter(char arg[]){
+    for (int filter = BoxFilter; arg != NULL && filter <= LanczosFilter; filter++){
+        if (strcmp(arg, filterNames[filter]) == 0) return filter;
+    }
+    return 0;
+}
+
+//Converts the effect arguments of the program call into a list of effect operations
+//Returns the number of effects in the chain
+int parseEffects(int argNum, char *args[argNum], Effect effects[]){
+    const Byte standardArgs = 3;
+    int effectCount = 0;
+    for (int i = standardArgs; i < argNum; i++){
+        Effect effect = {0, 0, NULL};
+        if(strcmp(args[i], "flipX") == 0) effect.type = FlipXOp;
+        else if(strcmp(args[i], "flipY") == 0) effect.type = FlipYOp;
+        else if(strcmp(args[i], "greyscale") == 0) effect.type = GreyscaleOp;
+        else if(strcmp(args[i], "invert") == 0) effect.type = InvertOp;
+        else if(strcmp(args[i], "edges") == 0) effect.type = EdgesOp;
+        else if(strcmp(args[i], "transpose") == 0) effect.type = TransposeOp;
+        else if(strcmp(args[i], "rotate90") == 0) effect.type = Rotate90Op;
+        else if(strcmp(args[i], "sharpen") == 0) effect.type = SharpenOp;
+        else if(strcmp(args[i], "autolevels") == 0) effect.type = AutoLevelsOp;
+        else if(strcmp(args[i], "equalize") == 0) effect.type = EqualizeOp;
+        else if(strcmp(args[i], "kernel") == 0 && (effect.kernel = parseKernel(args[i + 1])) != NULL){
+            effect.type = KernelOp;
+            i++;
+        }
+        //The filter is optional and defaults to Lanczos
+        else if(strcmp(args[i], "resize") == 0 && parseSize(args[i + 1], &effect.width, &effect.height)){
+            effect.type = ResizeOp;
+            effect.param = parseFilter(args[i + 2]) != 0 ? parseFilter(args[i + 2]) : LanczosFilter;
+            i += parseFilter(args[i + 2]) != 0 ? 2 : 1;
+        }
+        else if(parseNum(args[i + 1]) != 0 && validArg(args[i])){
+            if(strcmp(args[i], "darken") == 0) effect.type = DarkenOp;
+            else if(strcmp(args[i], "brighten") == 0) effect.type = BrightenOp;
+            else if(strcmp(args[i], "blur") == 0) effect.type = BlurOp;
+            else if(strcmp(args[i], "gaussian") == 0) effect.type = GaussianOp;
+            effect.param = parseNum(args[i + 1]);
+            i++;
+        } else invalidArg(args[i]);
+        effects[effectCount++] = effect;
+    }
+    return effectCount;
+}
+
+//Frees the kernels given on the command line
+void freeEffects(int effectCount, Effect effects[effectCount]){
+    for (int i = 0; i < effectCount; i++){
+        if (effects[i].kernel == NULL) continue;
+        free(effects[i].kernel->weights);
+        free(effects[i].kernel);
+    }
+}
+
+//Produces an error message in the case that an option before the file names is not recognised
+void invalidOption(char arg[]) {
+    printf("\"%s\" is an invalid option or has an invalid option parameter\n", arg);
+    exit(1);
+}
+
+//Calls the effects in the order specified in the effect list
+//A run of tone effects is composed into one lookup table and applied in a single pass
+void effectsChain(PixelBuffer *pixels, int effectCount, Effect effects[effectCount]){
+    for (int i = 0; i < effectCount; i++){
+        int run = toneRun(effectCount - i, &effects[i]);
+        if (run >= kernels.toneRun){
+            Byte table[256];
+            toneTable(run, &effects[i], table);
+            applyTone(pixels, table);
+            i += run - 1;
+            continue;
+        }
+        switch (effects[i].type){
+            case FlipXOp: flipX(pixels); break;
+            case FlipYOp: flipY(pixels); break;
+            case GreyscaleOp: greyscale(pixels); break;
+            case InvertOp: invert(pixels); break;
+            case EdgesOp: edges(pixels); break;
+            case DarkenOp: darken(pixels, effects[i].param); break;
+            case BrightenOp: brighten(pixels, effects[i].param); break;
+            case BlurOp: blur(pixels, effects[i].param); break;
+            case ToneOp: applyTone(pixels, effects[i].table); break;
+            case TransposeOp: transpose(pixels); break;
+            case Rotate90Op: rotate90(pixels); break;
+            case GaussianOp: gaussian(pixels, effects[i].param); break;
+            case SharpenOp: sharpen(pixels); break;
+            case KernelOp: convolve(pixels, effects[i].kernel, effects[i].param); break;
+            case ResizeOp: resize(pixels, &effects[i]); break;
+            case AutoLevelsOp: histogramEffect(pixels, AutoLevelsOp); break;
+            case EqualizeOp: histogramEffect(pixels, EqualizeOp); break;
+            case RemapOp: remapRows(pixels, 0, pixels->height, (Byte (*)[256]) effects[i].table); break;
+        }
+    }
+}
+
+//THREAD POOL FUNCTIONS
+
+//Task run for each tile of a job
+typedef void (*TileTask)(void *context, int tile);
+
+//Thread pool object definition
+//Worker threads wait for a job, then take tiles from it one at a time until none are left
+struct ThreadPool{
+    int threadCount;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t workReady;
+    pthread_cond_t workDone;
+    TileTask task;
+    void *context;
+    int tileCount;
+    int nextTile;
+    int tilesDone;
+    long generation;
+    bool stopping;
+};
+
+typedef struct ThreadPool ThreadPool;
+
+//Runs tiles of the current job until none are left to take
+//Called with the pool locked, the lock is released while each tile runs
+void runTiles(ThreadPool *pool){
+    while (pool->nextTile < pool->tileCount){
+        int tile = pool->nextTile++;
+        pthread_mutex_unlock(&pool->lock);
+        pool->task(pool->context, tile);
+        pthread_mutex_lock(&pool->lock);
+        pool->tilesDone++;
+        if (pool->tilesDone == pool->tileCount) pthread_cond_broadcast(&pool->workDone);
+    }
+}
+
+//Main loop of each worker thread
+void *workerLoop(void *arg){
+    ThreadPool *pool = arg;
+    long seenGeneration = 0;
+    pthread_mutex_lock(&pool->lock);
+    while (true){
+        while (!pool->stopping && pool->generation == seenGeneration) pthread_cond_wait(&pool->workReady, &pool->lock);
+        if (pool->stopping) break;
+        seenGeneration = pool->generation;
+        runTiles(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+//Starts a pool of %threadCount% threads, counting the calling thread which also runs tiles
+void createPool(ThreadPool *pool, int threadCount){
+    pool->threadCount = threadCount;
+    pool->threads = mallocCheck(sizeof(pthread_t) * threadCount);
+    pool->tileCount = 0;
+    pool->nextTile = 0;
+    pool->tilesDone = 0;
+    pool->generation = 0;
+    pool->stopping = false;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->workReady, NULL);
+    pthread_cond_init(&pool->workDone, NULL);
+    for (int i = 1; i < threadCount; i++){
+        if (pthread_create(&pool->threads[i], NULL, workerLoop, pool) != 0){
+            fprintf(stderr, "Can't start thread %d\n", i);
+            exit(1);
+        }
+    }
+}
+
+//Stops the worker threads and releases the pool
+void destroyPool(ThreadPool *pool){
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->workReady);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 1; i < pool->threadCount; i++) pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->workReady);
+    pthread_cond_destroy(&pool->workDone);
+    free(pool->threads);
+}
+
+//Runs a task for every tile across the pool and waits until all of them have finished
+void runTasks(ThreadPool *pool, int tileCount, TileTask task, void *context){
+    if (pool->threadCount == 1 || tileCount == 1){
+        for (int tile = 0; tile < tileCount; tile++) task(context, tile);
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->context = context;
+    pool->tileCount = tileCount;
+    pool->nextTile = 0;
+    pool->tilesDone = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->workReady);
+    runTiles(pool);
+    while (pool->tilesDone < pool->tileCount) pthread_cond_wait(&pool->workDone, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+//PLAN FUNCTIONS
+
+//Checks whether an effect only depends on the pixel it is changing
+bool isPixelEffect(int type){
+    return type == GreyscaleOp || isToneEffect(type) || type == ToneOp || type == RemapOp;
+}
+
+//Groups the effect chain into stages, fusing each run of consecutive per-pixel effects into a single stage
+//Neighbourhood and geometric effects act as fusion barriers and get a stage of their own
+//Returns the number of stages
+int compilePlan(int effectCount, Effect effects[effectCount], Stage stages[]){
+    int stageCount = 0;
+    for (int i = 0; i < effectCount; i++){
+        bool pixelEffect = isPixelEffect(effects[i].type);
+        if (pixelEffect && stageCount > 0 && stages[stageCount - 1].fused) stages[stageCount - 1].count++;
+        else {
+            Stage stage = {pixelEffect, i, 1};
+            stages[stageCount++] = stage;
+        }
+    }
+    return stageCount;
+}
+
+//Number of rows above and below a band (or tile) that the chain reads to produce exact results inside it
+//Each neighbourhood effect widens the region the following effects depend on
+int chainHalo(int effectCount, Effect effects[effectCount]){
+    int halo = 0;
+    for (int i = 0; i < effectCount; i++){
+        if (effects[i].type == BlurOp) halo += effects[i].param;
+        else if (effects[i].type == EdgesOp || effects[i].type == SharpenOp) halo += 1;
+        else if (effects[i].type == GaussianOp) halo += gaussianRadius(effects[i].param);
+        else if (effects[i].type == KernelOp) halo += effects[i].kernel->radius;
+    }
+    return halo;
+}
+
+//Work shared by the tiles of one stage
+//Tiles are bands of whole rows; a stage with a halo gathers the rows around each tile before any tile writes back
+struct TileJob{
+    PixelBuffer *pixels;
+    int effectCount;
+    Effect *effects;
+    int tileRows;
+    int halo;
+    PixelBuffer *scratch;
+};
+
+typedef struct TileJob TileJob;
+
+//First and last (exclusive) rows of a tile, optionally widened by the halo and clamped to the image
+void tileBounds(TileJob *job, int tile, int halo, int *first, int *last){
+    *first = tile * job->tileRows - halo;
+    *last = (tile + 1) * job->tileRows + halo;
+    if (*first < 0) *first = 0;
+    if (*last > job->pixels->height) *last = job->pixels->height;
+}
+
+//Applies the stage's effects to the rows of one tile in place
+void pixelTileTask(void *context, int tile){
+    TileJob *job = context;
+    int first;
+    int last;
+    tileBounds(job, tile, 0, &first, &last);
+    for (int i = first; i < last; i++){
+        PixelBuffer row = bufferRows(job->pixels, i, 1);
+        effectsChain(&row, job->effectCount, job->effects);
+    }
+}
+
+//Copies a tile and its halo rows into the tile's scratch buffer
+void gatherTileTask(void *context, int tile){
+    TileJob *job = context;
+    int first;
+    int last;
+    tileBounds(job, tile, job->halo, &first, &last);
+    PixelBuffer rows = bufferRows(job->pixels, first, last - first);
+    createBuffer(&job->scratch[tile], last - first, job->pixels->width);
+    copyPixels(&rows, &job->scratch[tile]);
+}
+
+//Applies the stage's effects to a gathered tile and writes the rows the tile owns back to the image
+//The halo rows are clamped at the image edges exactly as the whole image would be
+void haloTileTask(void *context, int tile){
+    TileJob *job = context;
+    int first;
+    int last;
+    int haloFirst;
+    int haloLast;
+    tileBounds(job, tile, 0, &first, &last);
+    tileBounds(job, tile, job->halo, &haloFirst, &haloLast);
+    PixelBuffer *scratch = &job->scratch[tile];
+    effectsChain(scratch, job->effectCount, job->effects);
+    PixelBuffer ownRows = bufferRows(scratch, first - haloFirst, last - first);
+    PixelBuffer imageRows = bufferRows(job->pixels, first, last - first);
+    copyPixels(&ownRows, &imageRows);
+    freeBuffer(scratch);
+}
+
+//Runs one stage of the plan across the thread pool and waits for every tile to finish
+//Per-pixel stages split into independent tiles; blur and edges tiles read %halo% extra rows from their neighbours
+void runStageTiled(ThreadPool *pool, PixelBuffer *pixels, int effectCount, Effect effects[effectCount]){
+    const int height = pixels->height;
+    const int tilesPerThread = 4;
+    TileJob job = {pixels, effectCount, effects, 0, chainHalo(effectCount, effects), NULL};
+    job.tileRows = (height + pool->threadCount * tilesPerThread - 1) / (pool->threadCount * tilesPerThread);
+    //Keep the rows recomputed in the halo small relative to the rows produced
+    if (job.tileRows < 2 * job.halo) job.tileRows = 2 * job.halo;
+    if (job.tileRows < 1) job.tileRows = 1;
+    const int tileCount = (height + job.tileRows - 1) / job.tileRows;
+
+    if (job.halo == 0) runTasks(pool, tileCount, pixelTileTask, &job);
+    else if (tileCount == 1) effectsChain(pixels, effectCount, effects);
+    else {
+        job.scratch = mallocCheck(sizeof(PixelBuffer) * tileCount);
+        runTasks(pool, tileCount, gatherTileTask, &job);
+        runTasks(pool, tileCount, haloTileTask, &job);
+        free(job.scratch);
+    }
+}
+
+//Runs a compiled plan over the image, one stage at a time
+//Each stage is split into tiles across the thread pool, and all tiles finish before the next stage starts
+//Within a fused stage each tile applies all of its effects to one row while that row is in cache, so the stage sweeps memory once
+void runPlan(ThreadPool *pool, PixelBuffer *pixels, int stageCount, Stage stages[stageCount], Effect effects[]){
+    for (int s = 0; s < stageCount; s++) runStageTiled(pool, pixels, stages[s].count, &effects[stages[s].first]);
+}
+
+//Work shared by the tiles of a histogram effect
+//Each tile counts its rows into bins of its own, so no atomics or locks are needed and the bins are summed once every tile has finished
+struct HistogramJob{
+    PixelBuffer *pixels;
+    int tileRows;
+    long (*bins)[256];
+    Byte (*tables)[256];
+};
+
+typedef struct HistogramJob HistogramJob;
+
+//Counts the rows of one tile into the tile's own bins
+void histogramTileTask(void *context, int tile){
+    HistogramJob *job = context;
+    const int first = tile * job->tileRows;
+    const int last = first + job->tileRows < job->pixels->height ? first + job->tileRows : job->pixels->height;
+    long (*bins)[256] = &job->bins[tile * channels];
+    memset(bins, 0, sizeof(long) * 256 * channels);
+    countHistogram(job->pixels, first, last, bins);
+}
+
+//Maps the rows of one tile through the tables
+void remapTileTask(void *context, int tile){
+    HistogramJob *job = context;
+    const int first = tile * job->tileRows;
+    const int last = first + job->tileRows < job->pixels->height ? first + job->tileRows : job->pixels->height;
+    remapRows(job->pixels, first, last, job->tables);
+}
+
+//Splits the rows of the image into tiles for the thread pool
+//Returns the number of tiles
+int histogramTiles(ThreadPool *pool, HistogramJob *job){
+    const int tilesPerThread = 4;
+    const int height = job->pixels->height;
+    job->tileRows = (height + pool->threadCount * tilesPerThread - 1) / (pool->threadCount * tilesPerThread);
+    if (job->tileRows < 1) job->tileRows = 1;
+    return (height + job->tileRows - 1) / job->tileRows;
+}
+
+//Adds the colour values of the image to %bins% across the thread pool
+//Each tile counts into its own bins, which are then reduced into one histogram per channel
+void countHistogramTiled(ThreadPool *pool, PixelBuffer *pixels, long bins[][256]){
+    HistogramJob job = {pixels, 0, NULL, NULL};
+    const int tileCount = histogramTiles(pool, &job);
+    job.bins = mallocCheck(sizeof(long) * 256 * channels * tileCount);
+    runTasks(pool, tileCount, histogramTileTask, &job);
+    for (int tile = 0; tile < tileCount; tile++){
+        for (Byte k = 0; k < channels; k++){
+            for (int v = 0; v < 256; v++) bins[k][v] += job.bins[tile * channels + k][v];
+        }
+    }
+    free(job.bins);
+}
+
+//Applies autolevels or equalize across the thread pool in two passes over the image
+//The first pass counts the histogram of every channel, which is turned into tables
+//The second pass maps every tile through the tables
+void runHistogramEffect(ThreadPool *pool, PixelBuffer *pixels, int type){
+    long bins[channels][256];
+    Byte tables[channels][256];
+    memset(bins, 0, sizeof(bins));
+    countHistogramTiled(pool, pixels, bins);
+    histogramTables(type, bins, tables);
+    HistogramJob job = {pixels, 0, NULL, tables};
+    runTasks(pool, histogramTiles(pool, &job), remapTileTask, &job);
+}
+
+//Gets the name of an effect as used in the program arguments
+const char *effectName(int type){
+    const char *names[] = {"", "flipX", "flipY", "greyscale", "invert", "edges", "darken", "brighten", "blur", "tone table of", "transpose", "rotate90", "gaussian", "sharpen", "kernel", "resize", "autolevels", "equalize", "tables of"};
+    return names[type];
+}
+
+//Displays an effect and its parameter
+void printEffect(Effect effect){
+    printf("%s", effectName(effect.type));
+    if (effect.type == KernelOp){
+        const int size = 2 * effect.kernel->radius + 1;
+        printf(" %dx%d%s", size, effect.kernel->separable ? 1 : size, effect.kernel->separable ? " separable" : "");
+    }
+    else if (effect.type == ResizeOp) printf(" %dx%d %s", effect.width, effect.height, filterNames[effect.param]);
+    else if (effect.type == RemapOp) printf(" %s", effectName(effect.param));
+    else if (effect.param != 0) printf(" %d", effect.param);
+    if (effect.type == ToneOp) printf(" effects");
+}
+
+//Displays the compiled plan, one line per memory sweep
+void explainPlan(int stageCount, Stage stages[stageCount], Effect effects[], bool flipRows, bool flipColumns, int bandHeight, int halo, int threadCount){
+    printf("Plan: %d stage(s), bands of %d rows with %d halo rows, %d thread(s)\n", stageCount, bandHeight, halo, threadCount);
+    for (int s = 0; s < stageCount; s++){
+        printf("  Stage %d: %s", s + 1, stages[s].fused ? "fused " : "");
+        for (int i = 0; i < stages[s].count; i++){
+            if (i != 0) printf(" -> ");
+            printEffect(effects[stages[s].first + i]);
+        }
+        printf("\n");
+    }
+    if (flipRows || flipColumns){
+        printf("  On output:%s%s\n", flipRows ? " flipX" : "", flipColumns ? " flipY" : "");
+    }
+}
+
+//STREAMING FUNCTIONS
+
+//Every effect commutes with flipX and flipY (blur, edges, gaussian and sharpen are symmetric and clamp identically at opposite edges)
+//So the flips are removed from the chain and only their parity is kept, to be applied once as each band is written out
+//A kernel given on the command line need not be symmetric, so moving a flip past it mirrors the kernel instead
+//Returns the number of effects left in the chain
+int separateFlips(int effectCount, Effect effects[effectCount], Effect chain[], bool *flipRows, bool *flipColumns){
+    int chainLength = 0;
+    *flipRows = false;
+    *flipColumns = false;
+    for (int i = 0; i < effectCount; i++){
+        if (effects[i].type == FlipXOp) *flipRows = !*flipRows;
+        else if (effects[i].type == FlipYOp) *flipColumns = !*flipColumns;
+        else chain[chainLength++] = effects[i];
+        if (effects[i].type == KernelOp) chain[chainLength - 1].param ^= (*flipRows ? MirrorRows : 0) | (*flipColumns ? MirrorColumns : 0);
+    }
+    return chainLength;
+}
+
+//Shape effects change the width and height of the image: turns (transpose and rotate90) swap them and resize replaces them
+bool isShapeEffect(int type){
+    return type == TransposeOp || type == Rotate90Op || type == ResizeOp;
+}
+
+//Shape effects move pixels across the whole image and histogram effects depend on every pixel of it
+//Once the image has to be held whole for a shape effect, both are applied to all of it at once
+bool isWholeImageEffect(int type){
+    return isShapeEffect(type) || isHistogramEffect(type);
+}
+
+//Number of shape effects in the chain
+int shapeCount(int effectCount, Effect effects[effectCount]){
+    int count = 0;
+    for (int i = 0; i < effectCount; i++) count += isShapeEffect(effects[i].type);
+    return count;
+}
+
+//Works out the height and width of the image the chain produces from the image described by %header%
+void outputShape(ImageHeader *header, int effectCount, Effect effects[effectCount], int *height, int *width){
+    *height = header->height;
+    *width = header->width;
+    for (int i = 0; i < effectCount; i++){
+        if (effects[i].type == ResizeOp) resizeShape(&effects[i], height, width);
+        else if (isShapeEffect(effects[i].type)){
+            int turnedHeight = *width;
+            *width = *height;
+            *height = turnedHeight;
+        }
+    }
+}
+
+//Size of the bitmap file the chain produces from an input file of %inputSize% bytes
+//Only the pixel array changes size, when the shape effects change the width and height (and so the padded rows)
+long outputFileSize(ImageHeader *header, long inputSize, int effectCount, Effect effects[effectCount]){
+    int height;
+    int width;
+    outputShape(header, effectCount, effects, &height, &width);
+    ImageHeader shaped = *header;
+    shaped.width = width;
+    shaped.height = height;
+    return inputSize - header->height * rowBytes(header) + shaped.height * rowBytes(&shaped);
+}
+
+//Blur, edges, the convolutions and resize mix the colours of neighbouring pixels, which the colour table of a palettized image can't hold
+bool mixesColours(int effectCount, Effect effects[effectCount]){
+    for (int i = 0; i < effectCount; i++){
+        if (effects[i].type == ResizeOp) return true;
+    }
+    return chainHalo(effectCount, effects) > 0;
+}
+
+//Runs a part of a chain that keeps the shape of the image over the whole image
+//Like a band of streamImage, the flips are reduced to their parity and applied after the other effects
+void runSegment(ThreadPool *pool, PixelBuffer *pixels, int effectCount, Effect effects[effectCount], bool explain){
+    Effect chain[effectCount + 1];
+    bool flipRows;
+    bool flipColumns;
+    int chainLength = separateFlips(effectCount, effects, chain, &flipRows, &flipColumns);
+    Byte toneTables[chainLength + 1][256];
+    chainLength = composeToneEffects(chainLength, chain, toneTables);
+    Stage stages[chainLength + 1];
+    const int stageCount = compilePlan(chainLength, chain, stages);
+    if (explain && effectCount > 0) explainPlan(stageCount, stages, chain, flipRows, flipColumns, pixels->height, chainHalo(chainLength, chain), pool->threadCount);
+
+    runPlan(pool, pixels, stageCount, stages, chain);
+    Effect flipColumnsEffect = {FlipYOp, 0, NULL};
+    if (flipRows) flipX(pixels);
+    if (flipColumns) runStageTiled(pool, pixels, 1, &flipColumnsEffect);
+}
+
+//Reads the whole pixel array of a bitmap into a new pixel buffer
+void loadImage(BitmapFile *in, ImageHeader *header, PixelBuffer *pixels){
+    const long rowSize = rowBytes(header);
+    createPlanes(pixels, header->height, header->width, formatPlanes(header));
+    Byte *inputBuffer = in->mapping != NULL ? NULL : mallocCheck(header->height * rowSize);
+    parseRawPixelArray(pixels, readBytes(in, header->pixelDataIndex, header->height * rowSize, inputBuffer), header);
+    free(inputBuffer);
+}
+
+//Copies the header of the input (with its colour table and anything else before the pixel array) for an image of the shape in %shaped%
+//Returns the %header->pixelDataIndex% bytes of the new header, which the caller frees
+Byte *shapedHeader(BitmapFile *in, ImageHeader *header, ImageHeader *shaped, long fileSize){
+    Byte *headerBytes = mallocCheck(header->pixelDataIndex);
+    readCopy(in, 0, header->pixelDataIndex, headerBytes);
+    unpackBytes(headerBytes, Size, 4, fileSize);
+    unpackBytes(headerBytes, Width, 4, shaped->width);
+    unpackBytes(headerBytes, Height, 4, shaped->height);
+    unpackBytes(headerBytes, ImageSize, 4, shaped->height * rowBytes(shaped));
+    return headerBytes;
+}
+
+//Applies a chain containing shape effects and writes the result with the width and height in the header changed as needed
+//These need every row of the image at once, so the image is processed as a single band (and any histogram effects are applied to it whole)
+//The pixel array is followed by any bytes that were stored after it in the input
+void reshapeImage(BitmapFile *in, BitmapFile *out, ImageHeader *header, int effectCount, Effect effects[effectCount], Options *options, ThreadPool *pool){
+    const long rowSize = rowBytes(header);
+    const long pixelArrayEnd = header->pixelDataIndex + header->height * rowSize;
+    PixelBuffer pixels;
+    loadImage(in, header, &pixels);
+
+    //Each whole image effect ends a segment of the chain that can be run as a plan of its own
+    int segmentStart = 0;
+    for (int i = 0; i <= effectCount; i++){
+        if (i < effectCount && !isWholeImageEffect(effects[i].type)) continue;
+        runSegment(pool, &pixels, i - segmentStart, &effects[segmentStart], options->explain);
+        if (i < effectCount){
+            if (options->explain){
+                printf("  Whole image: ");
+                printEffect(effects[i]);
+                printf("\n");
+            }
+            if (isHistogramEffect(effects[i].type)) runHistogramEffect(pool, &pixels, effects[i].type);
+            else effectsChain(&pixels, 1, &effects[i]);
+        }
+        segmentStart = i + 1;
+    }
+
+    ImageHeader shaped = *header;
+    shaped.width = pixels.width;
+    shaped.height = pixels.height;
+    const long shapedArraySize = shaped.height * rowBytes(&shaped);
+    Byte *headerBytes = shapedHeader(in, header, &shaped, out->size);
+    writeBytes(out, 0, header->pixelDataIndex, headerBytes);
+    free(headerBytes);
+
+    Byte *outputBuffer = out->mapping != NULL ? NULL : mallocCheck(shapedArraySize);
+    Byte *outputRows = writableBytes(out, header->pixelDataIndex, outputBuffer);
+    generateRawPixelArray(&pixels, outputRows, &shaped);
+    writeBytes(out, header->pixelDataIndex, shapedArraySize, outputRows);
+    copyBytes(in, pixelArrayEnd, out, header->pixelDataIndex + shapedArraySize, in->size - pixelArrayEnd);
+
+    free(outputBuffer);
+    freeBuffer(&pixels);
+}
+
+//Counts how many pixels of a palettized bitmap use each colour index, reading the pixel array a band of rows at a time
+void countIndices(BitmapFile *in, ImageHeader *header, long counts[256]){
+    const long rowSize = rowBytes(header);
+    const int bandRows = defaultBandHeight;
+    Byte *buffer = in->mapping != NULL ? NULL : mallocCheck(bandRows * rowSize);
+    memset(counts, 0, sizeof(long) * 256);
+    for (int first = 0; first < header->height; first += bandRows){
+        const int rows = first + bandRows < header->height ? bandRows : header->height - first;
+        Byte *indices = readBytes(in, header->pixelDataIndex + first * rowSize, rows * rowSize, buffer);
+        for (int i = 0; i < rows; i++){
+            for (int j = 0; j < header->width; j++) counts[indices[i * rowSize + j]]++;
+        }
+    }
+    free(buffer);
+}
+
+//Applies the per-pixel and histogram effects of the chain to the colour table of a palettized bitmap that has been copied to %out%
+//The colours are stored as blue, green, red and an unused byte, so they are processed as a single row of pixels
+//A histogram effect counts each colour once for every pixel using its index, and then remaps the colours rather than the pixels
+void recolourPalette(BitmapFile *in, BitmapFile *out, ImageHeader *header, int effectCount, Effect effects[effectCount]){
+    const long tableSize = 4 * header->colourCount;
+    Byte *buffer = mallocCheck(tableSize);
+    readCopy(in, header->paletteIndex, tableSize, buffer);
+    PixelBuffer colours;
+    createBuffer(&colours, 1, header->colourCount);
+    for (int j = 0; j < header->colourCount; j++){
+        for (Byte k = 0; k < channels; k++) colours.planes[k][j] = buffer[j * 4 + k];
+    }
+
+    Effect chain[effectCount + 1];
+    int chainLength = 0;
+    long indexCounts[256];
+    bool counted = false;
+    for (int i = 0; i < effectCount; i++){
+        if (isPixelEffect(effects[i].type)) chain[chainLength++] = effects[i];
+        if (!isHistogramEffect(effects[i].type)) continue;
+        if (!counted) countIndices(in, header, indexCounts);
+        counted = true;
+        effectsChain(&colours, chainLength, chain);
+        chainLength = 0;
+        long bins[channels][256];
+        Byte tables[channels][256];
+        memset(bins, 0, sizeof(bins));
+        for (int j = 0; j < header->colourCount; j++){
+            for (Byte k = 0; k < channels; k++) bins[k][colours.planes[k][j]] += indexCounts[j];
+        }
+        histogramTables(effects[i].type, bins, tables);
+        remapRows(&colours, 0, 1, tables);
+    }
+    effectsChain(&colours, chainLength, chain);
+
+    for (int j = 0; j < header->colourCount; j++){
+        for (Byte k = 0; k < channels; k++) buffer[j * 4 + k] = colours.planes[k][j];
+    }
+    writeBytes(out, header->paletteIndex, tableSize, buffer);
+    freeBuffer(&colours);
+    free(buffer);
+}
+
+//Runs a chain without flips or shape effects over a bitmap one band of rows at a time
+//With %out% each band is written to the new bitmap, applying the flips as it goes; without it the bands are only counted into %bins%
+//Peak memory depends on the band height (plus the halo rows the chain needs), not on the size of the image
+//Bands are visited in the order their rows appear in the output file so the output is written sequentially
+void streamBands(BitmapFile *in, BitmapFile *out, ImageHeader *header, int effectCount, Effect effects[effectCount], bool flipRows, bool flipColumns,
+                 long bins[][256], Options *options, ThreadPool *pool, Workspace *workspace){
+    const int height = header->height;
+    const int width = header->width;
+    const long rowSize = rowBytes(header);
+
+    Effect chain[effectCount + 1];
+    memcpy(chain, effects, sizeof(Effect) * effectCount);
+    Byte toneTables[effectCount + 1][256];
+    const int chainLength = composeToneEffects(effectCount, chain, toneTables);
+    const int halo = chainHalo(chainLength, chain);
+    Effect flipColumnsEffect = {FlipYOp, 0};
+    Stage stages[chainLength + 1];
+    const int stageCount = compilePlan(chainLength, chain, stages);
+    int bandHeight = options->bandHeight != 0 ? options->bandHeight : defaultBandHeight * pool->threadCount;
+
+    //Keep the rows recomputed in the halo small relative to the rows produced
+    if (options->bandHeight == 0 && bandHeight < haloBandRatio * halo) bandHeight = haloBandRatio * halo;
+    if (bandHeight < 2 * halo) bandHeight = 2 * halo;
+    if (bandHeight > height) bandHeight = height;
+    //An image with no rows still needs a band height to divide by
+    if (bandHeight < 1) bandHeight = 1;
+    int maxRows = bandHeight + 2 * halo;
+    if (maxRows > height) maxRows = height;
+    if (options->explain) explainPlan(stageCount, stages, chain, flipRows, flipColumns, bandHeight, halo, pool->threadCount);
+
+    //Rows are only staged in memory when one of the files is not mapped
+    const bool staged = in->mapping == NULL || (out != NULL && out->mapping == NULL);
+    PixelBuffer band = reserveWorkspace(workspace, maxRows, width, formatPlanes(header), staged ? maxRows * rowSize : 0);
+    Byte *rawRows = workspace->rawRows;
+
+    if (out != NULL) copyBytes(in, 0, out, 0, header->pixelDataIndex);
+
+    const int bandCount = (height + bandHeight - 1) / bandHeight;
+    for (int b = 0; b < bandCount; b++){
+        //The bottom row is stored first, which after flipX is the top row of the processed image
+        int bandIndex = flipRows ? b : bandCount - 1 - b;
+        int first = bandIndex * bandHeight;
+        int last = first + bandHeight < height ? first + bandHeight : height;
+        int haloFirst = first - halo > 0 ? first - halo : 0;
+        int haloLast = last + halo < height ? last + halo : height;
+        int rows = haloLast - haloFirst;
+
+        Byte *inputRows = readBytes(in, rowsOffset(header, rowSize, haloFirst, rows), rows * rowSize, rawRows);
+        PixelBuffer bandRows = bufferRows(&band, 0, rows);
+        parseRawPixelArray(&bandRows, inputRows, header);
+        runPlan(pool, &bandRows, stageCount, stages, chain);
+
+        int coreRows = last - first;
+        PixelBuffer core = bufferRows(&band, first - haloFirst, coreRows);
+        if (out == NULL){
+            countHistogramTiled(pool, &core, bins);
+            continue;
+        }
+        if (flipRows) flipX(&core);
+        if (flipColumns) runStageTiled(pool, &core, 1, &flipColumnsEffect);
+
+        //Produce the output rows in place in the output mapping, or else over the staged input rows
+        //The input mapping is read only, so a mapped input with an unmapped output stages them in the raw buffer instead
+        //After flipX the band lands at the mirrored position of the image
+        const int outputFirst = flipRows ? height - last : first;
+        const long coreOffset = rowsOffset(header, rowSize, outputFirst, coreRows);
+        Byte *coreInput = inputRows + (haloLast - last) * rowSize;
+        Byte *coreOutput = writableBytes(out, coreOffset, in->mapping != NULL ? rawRows : coreInput);
+        generateRawPixelArray(&core, coreOutput, header);
+        writeBytes(out, coreOffset, coreRows * rowSize, coreOutput);
+    }
+
+    if (out == NULL) return;
+
+    //Preserve any bytes stored after the pixel array
+    const long pixelArrayEnd = header->pixelDataIndex + height * rowSize;
+    copyBytes(in, pixelArrayEnd, out, pixelArrayEnd, in->size - pixelArrayEnd);
+}
+
+//Applies the effect chain to a bitmap and writes the result to a new bitmap, streaming it one band of rows at a time
+//Chains with shape effects can't be split into bands and are handed to reshapeImage
+//A palettized bitmap is recoloured through its colour table, so only the effects that move pixels touch its indices
+void streamImage(BitmapFile *in, BitmapFile *out, ImageHeader *header, int effectCount, Effect effects[effectCount], Options *options, ThreadPool *pool, Workspace *workspace){
+    if (header->bitsPerPixel == 8){
+        Effect moves[effectCount + 1];
+        int moveCount = 0;
+        for (int i = 0; i < effectCount; i++){
+            if (!isPixelEffect(effects[i].type) && !isHistogramEffect(effects[i].type)) moves[moveCount++] = effects[i];
+        }
+        if (moveCount < effectCount){
+            streamImage(in, out, header, moveCount, moves, options, pool, workspace);
+            recolourPalette(in, out, header, effectCount, effects);
+            return;
+        }
+    }
+    if (shapeCount(effectCount, effects) > 0){
+        reshapeImage(in, out, header, effectCount, effects, options, pool);
+        return;
+    }
+
+    Effect chain[effectCount + 1];
+    bool flipRows;
+    bool flipColumns;
+    const int chainLength = separateFlips(effectCount, effects, chain, &flipRows, &flipColumns);
+
+    //A histogram effect needs the histogram of the image the chain before it produces, so that part of the chain is first streamed just to count it
+    //The effect then becomes a lookup through the tables built from the count, which works on each band alone
+    Byte remapTables[chainLength + 1][channels][256];
+    for (int i = 0; i < chainLength; i++){
+        if (!isHistogramEffect(chain[i].type)) continue;
+        long bins[channels][256];
+        memset(bins, 0, sizeof(bins));
+        if (options->explain){
+            printf("Counting pass for ");
+            printEffect(chain[i]);
+            printf("\n");
+        }
+        streamBands(in, NULL, header, i, chain, false, false, bins, options, pool, workspace);
+        histogramTables(chain[i].type, bins, remapTables[i]);
+        Effect remap = {RemapOp, chain[i].type, &remapTables[i][0][0]};
+        chain[i] = remap;
+    }
+    streamBands(in, out, header, chainLength, chain, flipRows, flipColumns, NULL, options, pool, workspace);
+}
+
+//Checks if an option parameter is a valid positive integer
+//Returns the value or 0 otherwise
+int parseCount(char arg[]){
+    int result = 0;
+    if (arg != NULL && strlen(arg) > 0 && strlen(arg) < 10) {
+        result = atoi(arg);
+        for (int i = 0; i < strlen(arg); i++){
+            if (arg[i] < '0' || arg[i] > '9') {
+                result = 0;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+//Reads the options given before the file names
+//Returns the index of the first argument that is not an option
+int parseOptions(int argNum, char *args[argNum], Options *options){
+    options->bandHeight = 0;
+    options->explain = false;
+    options->threadCount = 1;
+    options->benchmarkThreads = 0;
+    options->benchmarkEdges = false;
+    options->useMapping = true;
+    options->benchmarkIO = 0;
+    options->batch = false;
+    options->benchmarkTone = false;
+    options->benchmarkSuite = false;
+    options->mipCache = NULL;
+    int i = 1;
+    while (i < argNum && strncmp(args[i], "--", 2) == 0){
+        if (strcmp(args[i], "--band") == 0 && parseCount(args[i + 1]) != 0){
+            options->bandHeight = parseCount(args[i + 1]);
+            i++;
+        }
+        else if (strcmp(args[i], "--explain") == 0){
+            options->explain = true;
+        }
+        else if (strcmp(args[i], "--threads") == 0 && parseCount(args[i + 1]) != 0 && parseCount(args[i + 1]) <= maxThreads){
+            options->threadCount = parseCount(args[i + 1]);
+            i++;
+        }
+        else if (strcmp(args[i], "--bench-threads") == 0 && parseCount(args[i + 1]) != 0 && parseCount(args[i + 1]) <= maxThreads){
+            options->benchmarkThreads = parseCount(args[i + 1]);
+            i++;
+        }
+        else if (strcmp(args[i], "--bench-edges") == 0){
+            options->benchmarkEdges = true;
+        }
+        else if (strcmp(args[i], "--bench-tone") == 0){
+            options->benchmarkTone = true;
+        }
+        else if (strcmp(args[i], "--bench") == 0){
+            options->benchmarkSuite = true;
+        }
+        else if (strcmp(args[i], "--no-mmap") == 0){
+            options->useMapping = false;
+        }
+        else if (strcmp(args[i], "--batch") == 0){
+            options->batch = true;
+        }
+        else if (strcmp(args[i], "--mip-cache") == 0 && i + 1 < argNum){
+            options->mipCache = args[i + 1];
+            i++;
+        }
+        else if (strcmp(args[i], "--bench-io") == 0){
+            //The largest image size in megabytes is optional
+            options->benchmarkIO = defaultBenchmarkMegabytes;
+            if (i + 1 < argNum && parseCount(args[i + 1]) != 0){
+                options->benchmarkIO = parseCount(args[i + 1]);
+                i++;
+            }
+        }
+        else invalidOption(args[i]);
+        i++;
+    }
+    return i;
+}
+
+//Writes a 24 bit copy of a palettized bitmap to a temporary file, looking every pixel up in the colour table
+//Indices past the end of the colour table become black
+//Returns NULL if the temporary file can't be created
+FILE *expandPalette(BitmapFile *in, ImageHeader *header){
+    ImageHeader expanded = *header;
+    expanded.bitsPerPixel = 24;
+    const long rowSize = rowBytes(header);
+    const long expandedRowSize = rowBytes(&expanded);
+    Byte colours[256][channels];
+    memset(colours, 0, sizeof(colours));
+    Byte table[4 * 256];
+    Byte *tableBytes = readBytes(in, header->paletteIndex, 4 * header->colourCount, table);
+    for (int c = 0; c < header->colourCount; c++){
+        for (Byte k = 0; k < channels; k++) colours[c][k] = tableBytes[c * 4 + k];
+    }
+
+    FILE *stream = tmpfile();
+    if (stream == NULL) return NULL;
+    Byte headerBytes[54];
+    createHeader(headerBytes, header->height, header->width, 24);
+    fwrite(headerBytes, 1, sizeof(headerBytes), stream);
+    Byte *rowBuffer = mallocCheck(rowSize);
+    Byte *expandedRow = mallocCheck(expandedRowSize);
+    memset(expandedRow, 0, expandedRowSize);
+    for (int i = 0; i < header->height; i++){
+        Byte *indices = readBytes(in, header->pixelDataIndex + i * rowSize, rowSize, rowBuffer);
+        for (int j = 0; j < header->width; j++){
+            for (Byte k = 0; k < channels; k++) expandedRow[j * channels + k] = colours[indices[j]][k];
+        }
+        fwrite(expandedRow, 1, expandedRowSize, stream);
+    }
+    free(expandedRow);
+    free(rowBuffer);
+    fflush(stream);
+    return stream;
+}
+
+//MIP CACHE FUNCTIONS
+
+//Hash of the contents of a file, which names the cached mip levels of an image
+//64 bit FNV-1a taken 8 bytes at a time, with the high bits folded back in so every byte affects the whole hash
+uint64_t fileHash(BitmapFile *file){
+    const long chunk = 1 << 20;
+    const uint64_t prime = 1099511628211ULL;
+    uint64_t hash = 14695981039346656037ULL;
+    Byte *buffer = file->mapping != NULL ? NULL : mallocCheck(chunk);
+    for (long offset = 0; offset < file->size; offset += chunk){
+        const long count = offset + chunk < file->size ? chunk : file->size - offset;
+        Byte *bytes = readBytes(file, offset, count, buffer);
+        for (long i = 0; i < count; i += 8){
+            uint64_t word = 0;
+            memcpy(&word, &bytes[i], count - i < 8 ? count - i : 8);
+            hash = (hash ^ word) * prime;
+            hash ^= hash >> 32;
+        }
+    }
+    free(buffer);
+    return (hash ^ (uint64_t) file->size) * prime;
+}
+
+//Number of times a %imageHeight% x %imageWidth% image can be halved (rounding down) and still be at least %height% x %width%
+int mipLevel(int imageHeight, int imageWidth, int height, int width){
+    int level = 0;
+    while (imageHeight / 2 >= height && imageWidth / 2 >= width){
+        imageHeight /= 2;
+        imageWidth /= 2;
+        level++;
+    }
+    return level;
+}
+
+//Name of the file in the cache directory holding mip level %level% of the image with the given hash
+//Returns false if the name doesn't fit in %nameSize% characters
+bool mipName(const char directory[], uint64_t hash, int level, char name[], size_t nameSize){
+    const size_t length = strlen(directory);
+    const char *separator = length > 0 && directory[length - 1] == '/' ? "" : "/";
+    return snprintf(name, nameSize, "%s%s%016llx-%d.bmp", directory, separator, (unsigned long long) hash, level) < (int) nameSize;
+}
+
+//Writes a pixel buffer to a new bitmap file with the header of the input, changed to the size of the buffer
+//The file is written under a temporary name and then renamed, so a file with the final name is always complete
+//Returns false if the file can't be written
+bool writeBitmap(const char name[], PixelBuffer *pixels, BitmapFile *in, ImageHeader *header){
+    ImageHeader shaped = *header;
+    shaped.width = pixels->width;
+    shaped.height = pixels->height;
+    const long pixelArraySize = shaped.height * rowBytes(&shaped);
+    Byte *headerBytes = shapedHeader(in, header, &shaped, header->pixelDataIndex + pixelArraySize);
+    Byte *rawPixelArray = mallocCheck(pixelArraySize);
+    memset(rawPixelArray, 0, pixelArraySize);
+    generateRawPixelArray(pixels, rawPixelArray, &shaped);
+
+    //The bitmap is written under a temporary name, so another process making the same level never sees it half written
+    char temporaryName[FILENAME_MAX];
+    FILE *stream = createTemporary(name, temporaryName, sizeof(temporaryName));
+    bool written = stream != NULL;
+    if (written){
+        written = fwrite(headerBytes, 1, header->pixelDataIndex, stream) == header->pixelDataIndex;
+        written = fwrite(rawPixelArray, 1, pixelArraySize, stream) == pixelArraySize && written;
+        written = fclose(stream) == 0 && written;
+        written = written && rename(temporaryName, name) == 0;
+        if (!written) remove(temporaryName);
+    }
+    free(headerBytes);
+    free(rawPixelArray);
+    return written;
+}
+
+//Opens mip level %level% of an image, which is the image halved %level% times with the box filter
+//Any levels missing from the cache are made from the deepest level that is there (or from the image itself) and written to it
+//Returns the level file opened for reading, or NULL with the reason in %problem% if the cache can't be read or written
+FILE *openMipLevel(BitmapFile *in, ImageHeader *header, uint64_t hash, int level, const char directory[], const char **problem){
+    char name[FILENAME_MAX];
+    int cached = level;
+    FILE *stream = NULL;
+    for (; cached > 0; cached--){
+        if (!mipName(directory, hash, cached, name, sizeof(name))){
+            *problem = "Mip cache directory name is too long";
+            return NULL;
+        }
+        stream = fopen(name, "rb");
+        if (stream != NULL) break;
+    }
+    if (cached == level) return stream;
+
+    PixelBuffer pixels;
+    if (stream == NULL) loadImage(in, header, &pixels);
+    else {
+        BitmapFile levelFile;
+        ImageHeader levelHeader;
+        attachFile(&levelFile, stream, streamSize(stream), false, in->mapping != NULL);
+        *problem = readHeader(&levelFile, &levelHeader);
+        if (*problem == NULL) loadImage(&levelFile, &levelHeader, &pixels);
+        detachFile(&levelFile);
+        fclose(stream);
+        if (*problem != NULL) return NULL;
+    }
+    for (int l = cached + 1; l <= level; l++){
+        resizeTo(&pixels, pixels.height / 2, pixels.width / 2, BoxFilter);
+        mipName(directory, hash, l, name, sizeof(name));
+        if (!writeBitmap(name, &pixels, in, header)){
+            freeBuffer(&pixels);
+            *problem = "Can't write to the mip cache";
+            return NULL;
+        }
+    }
+    freeBuffer(&pixels);
+    stream = fopen(name, "rb");
+    if (stream == NULL) *problem = "Can't read from the mip cache";
+    return stream;
+}
+
+//Replaces the input of processFile with another bitmap, whose header is read into %header%
+//Returns NULL if it can be processed, otherwise the reason it can't
+const char *replaceInput(BitmapFile *in, FILE **inStream, FILE *replacement, ImageHeader *header, bool useMapping){
+    detachFile(in);
+    fclose(*inStream);
+    *inStream = replacement;
+    attachFile(in, replacement, streamSize(replacement), false, useMapping);
+    return readHeader(in, header);
+}
+
+//Streams one bitmap file through the effect chain into a new bitmap file
+//Returns the size of the input file in bytes, or -1 with the reason in %problem% if the files can't be opened or the input isn't a usable bitmap
+long processFile(const char inName[], const char outName[], int effectCount, Effect effects[effectCount], Options *options, ThreadPool *pool, Workspace *workspace,
+                 const char **problem){
     ImageHeader headerData;
     ImageHeader *header = &headerData;
 
-    Byte headerSize = 54;
-    Byte headerCopy[headerSize];
+    //The input is opened once: the header and every band are read from the same (usually mapped) file
+    FILE *inStream = fopen(inName, "rb");
+    if (inStream == NULL){
+        *problem = "Can't open the input file";
+        return -1;
+    }
+    BitmapFile in;
+    attachFile(&in, inStream, streamSize(inStream), false, options->useMapping);
+    *problem = readHeader(&in, header);
+    if (*problem != NULL){
+        detachFile(&in);
+        fclose(inStream);
+        return -1;
+    }
+    const long inputSize = in.size;
+    const bool inPlace = sameFile(inStream, inName, outName);
+
+    //A chain that starts by shrinking the image can start from the smallest cached mip level that is still big enough
+    //The size of the resize is worked out from the input first, as a level may not have quite the same aspect ratio
+    Effect chain[effectCount + 1];
+    memcpy(chain, effects, sizeof(Effect) * effectCount);
+    int level = 0;
+    uint64_t hash = 0;
+    if (options->mipCache != NULL && effectCount > 0 && chain[0].type == ResizeOp){
+        int height = header->height;
+        int width = header->width;
+        resizeShape(&chain[0], &height, &width);
+        chain[0].height = height;
+        chain[0].width = width;
+        level = mipLevel(header->height, header->width, height, width);
+        if (level > 0) hash = fileHash(&in);
+    }
+
+    //The colours mixed by blur, edges, the convolutions and resize can't be held in a colour table, so the image is expanded to 24 bits for them
+    if (header->bitsPerPixel == 8 && mixesColours(effectCount, chain)){
+        FILE *expanded = expandPalette(&in, header);
+        if (expanded == NULL) *problem = "Can't create a temporary file";
+        else *problem = replaceInput(&in, &inStream, expanded, header, options->useMapping);
+    }
+    if (*problem == NULL && level > 0){
+        FILE *levelStream = openMipLevel(&in, header, hash, level, options->mipCache, problem);
+        if (levelStream != NULL) *problem = replaceInput(&in, &inStream, levelStream, header, options->useMapping);
+    }
+    if (*problem != NULL){
+        detachFile(&in);
+        fclose(inStream);
+        return -1;
+    }
+
+    //The size of the output is known from the header and the chain, so it can be created at its final size and mapped up front
+    //Creating it over the input would empty the input before its bands are read, so then it is written to a temporary file that replaces the input at the end
+    char temporaryName[FILENAME_MAX];
+    FILE *outStream = inPlace ? createTemporary(outName, temporaryName, sizeof(temporaryName)) : fopen(outName, "w+b");
+    if (outStream == NULL){
+        *problem = "Can't create the output file";
+        detachFile(&in);
+        fclose(inStream);
+        return -1;
+    }
+    BitmapFile out;
+    attachFile(&out, outStream, outputFileSize(header, in.size, effectCount, chain), true, options->useMapping);
+    streamImage(&in, &out, header, effectCount, chain, options, pool, workspace);
+    detachFile(&out);
+    fclose(outStream);
+    detachFile(&in);
+    fclose(inStream);
+    if (inPlace && rename(temporaryName, outName) != 0){
+        remove(temporaryName);
+        *problem = "Can't replace the input file";
+        return -1;
+    }
+    return inputSize;
+}
+
+//Main pipeline
+//Calls the main functions related to importing, applying effects and outputting
+void proccessImage(int argNum, char *args[argNum], Options *options){
+    if (argNum <= outFile){
+        printf("Please provide an input and an output file\n");
+        exit(1);
+    }
+
+    Effect effects[argNum];
+    int effectCount = parseEffects(argNum, args, effects);
+
+    ThreadPool pool;
+    createPool(&pool, options->threadCount);
+    Workspace workspace;
+    createWorkspace(&workspace);
+    const char *problem;
+    if (processFile(args[inFile], args[outFile], effectCount, effects, options, &pool, &workspace, &problem) < 0){
+        printf("%s: %s\n", args[inFile], problem);
+        exit(1);
+    }
+    freeWorkspace(&workspace);
+    destroyPool(&pool);
+    freeEffects(effectCount, effects);
+
+    printf("SUCCESS: %s -> %s\n", args[inFile], args[outFile]);
+
+}
+
+//BENCHMARK FUNCTIONS
+
+//Fills a buffer with pseudo random pixel values
+void randomPixels(PixelBuffer *pixels, unsigned seed){
+    srand(seed);
+    for (Byte k = 0; k < channels; k++){
+        for (int i = 0; i < pixels->height; i++){
+            Byte *row = planeRow(pixels, k, i);
+            for (int j = 0; j < pixels->width; j++) row[j] = rand() % 256;
+        }
+    }
+}
+
+//Current time in seconds from a monotonic clock
+double nowSeconds(){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+//Next thread count to benchmark: doubling, but always finishing on the maximum
+int nextThreadCount(int threadCount, int maxThreadCount){
+    if (threadCount < maxThreadCount && threadCount * 2 > maxThreadCount) return maxThreadCount;
+    return threadCount * 2;
+}
+
+//Times a few chains on a large synthetic image with 1 up to %maxThreadCount% threads and reports the speedup over 1 thread
+void benchmarkThreads(int maxThreadCount){
+    const int height = 2048;
+    const int width = 2048;
+    const int repeats = 3;
+    char *chains[] = {"blur 10", "edges", "greyscale invert darken 40 brighten 10"};
+    const int chainCount = sizeof(chains) / sizeof(chains[0]);
+
+    PixelBuffer original;
+    PixelBuffer pixels;
+    createBuffer(&original, height, width);
+    createBuffer(&pixels, height, width);
+    randomPixels(&original, 4);
+
+    printf("%dx%d image, best of %d runs\n", width, height, repeats);
+    for (int c = 0; c < chainCount; c++){
+        //Split the chain into the argument list it would have on the command line
+        char words[64];
+        strcpy(words, chains[c]);
+        char *args[16] = {"image", "in.bmp", "out.bmp"};
+        int argNum = 3;
+        for (char *word = strtok(words, " "); word != NULL; word = strtok(NULL, " ")) args[argNum++] = word;
+        Effect effects[argNum];
+        int effectCount = parseEffects(argNum, args, effects);
+        Byte toneTables[effectCount + 1][256];
+        effectCount = composeToneEffects(effectCount, effects, toneTables);
+        Stage stages[effectCount];
+        int stageCount = compilePlan(effectCount, effects, stages);
+
+        double singleThreadTime = 0;
+        for (int threadCount = 1; threadCount <= maxThreadCount; threadCount = nextThreadCount(threadCount, maxThreadCount)){
+            ThreadPool pool;
+            createPool(&pool, threadCount);
+            double best = 0;
+            for (int r = 0; r < repeats; r++){
+                copyPixels(&original, &pixels);
+                double start = nowSeconds();
+                runPlan(&pool, &pixels, stageCount, stages, effects);
+                double elapsed = nowSeconds() - start;
+                if (r == 0 || elapsed < best) best = elapsed;
+            }
+            destroyPool(&pool);
+            if (threadCount == 1) singleThreadTime = best;
+            printf("%-40s threads %3d  %9.2f ms  speedup %5.2fx\n", chains[c], threadCount, best * 1000, singleThreadTime / best);
+        }
+    }
+    freeBuffer(&original);
+    freeBuffer(&pixels);
+}
+
+//Times the single pass Sobel engine against the reference convolutions on a large synthetic image
+void benchmarkEdges(){
+    const int height = 2048;
+    const int width = 2048;
+    const int repeats = 3;
+    void (*versions[])(PixelBuffer *pixels) = {edgesReference, edges};
+    const char *names[] = {"reference (5 copies, sqrt)", "single pass (integer)"};
+
+    PixelBuffer original;
+    PixelBuffer pixels;
+    createBuffer(&original, height, width);
+    createBuffer(&pixels, height, width);
+    randomPixels(&original, 5);
+
+    printf("%dx%d image, best of %d runs\n", width, height, repeats);
+    double referenceTime = 0;
+    for (int v = 0; v < 2; v++){
+        double best = 0;
+        for (int r = 0; r < repeats; r++){
+            copyPixels(&original, &pixels);
+            double start = nowSeconds();
+            versions[v](&pixels);
+            double elapsed = nowSeconds() - start;
+            if (r == 0 || elapsed < best) best = elapsed;
+        }
+        if (v == 0) referenceTime = best;
+        printf("%-28s %9.2f ms  %7.1f MB/s  speedup %5.2fx\n", names[v], best * 1000, height * width * channels / best / 1e6, referenceTime / best);
+    }
+    freeBuffer(&original);
+    freeBuffer(&pixels);
+}
+
+//Times runs of tone effects applied by their own kernels against the same runs composed into one lookup table
+//The effects go through the plan, so like a real chain they are applied to one row at a time
+void benchmarkTone(){
+    const int height = 2048;
+    const int width = 2048;
+    const int repeats = 3;
+    Effect runs[][4] = {{{InvertOp, 0, NULL}}, {{DarkenOp, 40, NULL}}, {{DarkenOp, 40, NULL}, {BrightenOp, 10, NULL}}, {{InvertOp, 0, NULL}, {DarkenOp, 40, NULL}, {BrightenOp, 10, NULL}}, {{InvertOp, 0, NULL}, {DarkenOp, 40, NULL}, {BrightenOp, 10, NULL}, {DarkenOp, 5, NULL}}};
+    const int runLengths[] = {1, 1, 2, 3, 4};
+    const int runCount = sizeof(runLengths) / sizeof(runLengths[0]);
+    const int toneRun = kernels.toneRun;
+    ThreadPool pool;
+    createPool(&pool, 1);
+
+    PixelBuffer original;
+    PixelBuffer pixels;
+    createBuffer(&original, height, width);
+    createBuffer(&pixels, height, width);
+    randomPixels(&original, 6);
+
+    printf("%dx%d image, %s kernels, best of %d runs\n", width, height, kernels.name, repeats);
+    for (int r = 0; r < runCount; r++){
+        double times[2];
+        for (int composed = 0; composed <= 1; composed++){
+            Effect chain[4];
+            memcpy(chain, runs[r], sizeof(chain));
+            Byte tables[4][256];
+            int chainLength = runLengths[r];
+            kernels.toneRun = composed ? 1 : 5;
+            chainLength = composeToneEffects(chainLength, chain, tables);
+            Stage stages[4];
+            int stageCount = compilePlan(chainLength, chain, stages);
+            double best = 0;
+            for (int repeat = 0; repeat < repeats; repeat++){
+                copyPixels(&original, &pixels);
+                double start = nowSeconds();
+                runPlan(&pool, &pixels, stageCount, stages, chain);
+                double elapsed = nowSeconds() - start;
+                if (repeat == 0 || elapsed < best) best = elapsed;
+            }
+            times[composed] = best;
+        }
+        printf("run of %d: ", runLengths[r]);
+        for (int i = 0; i < runLengths[r]; i++){
+            printEffect(runs[r][i]);
+            printf(i + 1 < runLengths[r] ? ", " : "");
+        }
+        printf("\n    kernels %8.2f ms  table %8.2f ms\n", times[0] * 1000, times[1] * 1000);
+    }
+    kernels.toneRun = toneRun;
+    freeBuffer(&original);
+    freeBuffer(&pixels);
+    destroyPool(&pool);
+}
+
+//Writes a synthetic 24 bit bitmap of %height% x %width% pixels to a temporary file
+FILE *benchmarkBitmap(int height, int width, ImageHeader *header){
+    Byte headerBytes[54];
+    createHeader(headerBytes, height, width, 24);
+    parseHeader(headerBytes, header);
+    const long rowSize = rowBytes(header);
+
+    FILE *file = tmpfile();
+    if (file == NULL){
+        perror("Can't create a temporary file");
+        exit(1);
+    }
+    fwrite(headerBytes, sizeof(Byte), header->pixelDataIndex, file);
+    Byte *row = mallocCheck(rowSize);
+    for (int i = 0; i < height; i++){
+        for (long j = 0; j < rowSize; j++) row[j] = (i * 31 + j * 7) % 256;
+        fwrite(row, sizeof(Byte), rowSize, file);
+    }
+    free(row);
+    fflush(file);
+    return file;
+}
+
+//Times streaming a bitmap through the stdio path and the memory mapped path for images of 10 MB up to %maxMegabytes%
+//Each run includes mapping and unmapping the files, with a plain copy and with an inexpensive effect
+void benchmarkIO(int maxMegabytes){
+    const int repeats = 2;
+    Effect invertChain[] = {{InvertOp, 0}};
+    const char *modes[] = {"stdio", "mmap"};
+    ThreadPool pool;
+    createPool(&pool, 1);
+    Workspace workspace;
+    createWorkspace(&workspace);
+
+    printf("best of %d runs\n", repeats);
+    for (int megabytes = maxMegabytes < 10 ? maxMegabytes : 10; megabytes <= maxMegabytes; megabytes *= 10){
+        const int width = 4096;
+        const int height = megabytes * 1000000L / (width * channels) > 0 ? megabytes * 1000000L / (width * channels) : 1;
+        ImageHeader header;
+        FILE *in = benchmarkBitmap(height, width, &header);
+        const long size = streamSize(in);
+        for (int effectCount = 0; effectCount <= 1; effectCount++){
+            for (int m = 0; m < 2; m++){
+                Options options = {0, false, 1, 0, false, m == 1, 0, false, false, false};
+                double best = 0;
+                for (int r = 0; r < repeats; r++){
+                    FILE *out = tmpfile();
+                    assert(out != NULL);
+                    double start = nowSeconds();
+                    BitmapFile inFile;
+                    BitmapFile outFile;
+                    attachFile(&inFile, in, size, false, options.useMapping);
+                    attachFile(&outFile, out, size, true, options.useMapping);
+                    streamImage(&inFile, &outFile, &header, effectCount, invertChain, &options, &pool, &workspace);
+                    detachFile(&outFile);
+                    detachFile(&inFile);
+                    fflush(out);
+                    double elapsed = nowSeconds() - start;
+                    fclose(out);
+                    if (r == 0 || elapsed < best) best = elapsed;
+                }
+                printf("%5d MB  %-6s %-6s %9.2f ms  %8.1f MB/s\n", megabytes, effectCount == 0 ? "copy" : "invert", modes[m], best * 1000, size / best / 1e6);
+            }
+        }
+        fclose(in);
+    }
+    freeWorkspace(&workspace);
+    destroyPool(&pool);
+}
+
+//Measurement of one benchmark of the suite
+//Runs are repeated until at least %minimumRuns% runs and %minimumTime% seconds have been measured, and the best is kept
+struct Measurement{
+    int runs;
+    double total;
+    double best;
+};
+
+typedef struct Measurement Measurement;
+
+const int minimumRuns = 3;
+const int maximumRuns = 1000;
+const double minimumTime = 0.25;
+
+//Checks whether a measurement needs more runs
+bool measuring(Measurement *measurement){
+    return measurement->runs < minimumRuns || (measurement->total < minimumTime && measurement->runs < maximumRuns);
+}
+
+//Adds the time of one run to a measurement
+void addRun(Measurement *measurement, double elapsed){
+    if (measurement->runs == 0 || elapsed < measurement->best) measurement->best = elapsed;
+    measurement->total += elapsed;
+    measurement->runs++;
+}
+
+//Displays one benchmark result as a JSON object, preceded by a comma unless it is the first
+//%bytes% is the number of bytes the benchmark reads, which gives its throughput
+void printMeasurement(bool *first, const char group[], const char name[], int height, int width, double bytes, Measurement *measurement){
+    const double pixelCount = (double) height * width;
+    printf("%s\n    {\"group\": \"%s\", \"name\": \"%s\", \"width\": %d, \"height\": %d, ", *first ? "" : ",", group, name, width, height);
+    printf("\"runs\": %d, \"seconds\": %.6f, \"ns_per_pixel\": %.3f, \"gb_per_second\": %.3f}", measurement->runs, measurement->best, measurement->best * 1e9 / pixelCount, bytes / measurement->best / 1e9);
+    *first = false;
+}
+
+//Times every effect and the I/O functions on synthetic images of several sizes and displays the results as JSON
+//Effects are called directly on one thread, so the numbers measure the effects themselves rather than the plan
+void benchmarkSuite(Options *options){
+    const int sizes[][2] = {{256, 256}, {1024, 1024}, {4096, 4096}};
+    const int sizeCount = sizeof(sizes) / sizeof(sizes[0]);
+    char *chains[] = {"flipX", "flipY", "greyscale", "invert", "darken 40", "brighten 40", "invert darken 40 brighten 10", "blur 1", "blur 10", "blur 100", "edges", "transpose", "rotate90", "gaussian 1", "gaussian 10", "sharpen", "kernel 1,4,6,4,1", "kernel 1,2,1/0,0,0/-1,-2,-1", "resize 128x128 box", "resize 128x128 bilinear", "resize 128x128 lanczos", "resize 0x1000 lanczos", "autolevels", "equalize"};
+    const int chainCount = sizeof(chains) / sizeof(chains[0]);
+    bool first = true;
+
+    printf("{\n  \"kernels\": \"%s\",\n  \"threads\": 1,\n  \"results\": [", kernels.name);
+    for (int n = 0; n < sizeCount; n++){
+        const int height = sizes[n][0];
+        const int width = sizes[n][1];
+        const double pixelBytes = (double) height * width * channels;
+        PixelBuffer original;
+        PixelBuffer pixels;
+        createBuffer(&original, height, width);
+        createBuffer(&pixels, height, width);
+        randomPixels(&original, n);
+
+        for (int c = 0; c < chainCount; c++){
+            //Split the chain into the argument list it would have on the command line
+            char words[64];
+            strcpy(words, chains[c]);
+            char *args[16] = {"image", "in.bmp", "out.bmp"};
+            int argNum = 3;
+            for (char *word = strtok(words, " "); word != NULL; word = strtok(NULL, " ")) args[argNum++] = word;
+            Effect effects[argNum];
+            int effectCount = parseEffects(argNum, args, effects);
+
+            Measurement measurement = {0, 0, 0};
+            while (measuring(&measurement)){
+                //Turns and resizes leave the buffer with another width and height
+                if (pixels.height != height || pixels.width != width){
+                    freeBuffer(&pixels);
+                    createBuffer(&pixels, height, width);
+                }
+                copyPixels(&original, &pixels);
+                double start = nowSeconds();
+                effectsChain(&pixels, effectCount, effects);
+                addRun(&measurement, nowSeconds() - start);
+            }
+            printMeasurement(&first, "effect", chains[c], height, width, pixelBytes, &measurement);
+            freeEffects(effectCount, effects);
+        }
+
+        //Converting between the interleaved file rows and the planes of the buffer
+        ImageHeader header;
+        FILE *in = benchmarkBitmap(height, width, &header);
+        const long size = streamSize(in);
+        const long arraySize = height * rowBytes(&header);
+        Byte *raw = mallocCheck(arraySize);
+        BitmapFile inFile;
+        attachFile(&inFile, in, size, false, false);
+        readBytes(&inFile, header.pixelDataIndex, arraySize, raw);
+        Measurement parse = {0, 0, 0};
+        while (measuring(&parse)){
+            double start = nowSeconds();
+            parseRawPixelArray(&original, raw, &header);
+            addRun(&parse, nowSeconds() - start);
+        }
+        printMeasurement(&first, "io", "parseRawPixelArray", height, width, arraySize, &parse);
+        Measurement generate = {0, 0, 0};
+        while (measuring(&generate)){
+            double start = nowSeconds();
+            generateRawPixelArray(&original, raw, &header);
+            addRun(&generate, nowSeconds() - start);
+        }
+        printMeasurement(&first, "io", "generateRawPixelArray", height, width, arraySize, &generate);
+
+        //Streaming the whole file with no effects, through stdio and through memory mapped files
+        ThreadPool pool;
+        createPool(&pool, 1);
+        Workspace workspace;
+        createWorkspace(&workspace);
+        for (int m = 0; m < 2; m++){
+            Options streamOptions = *options;
+            streamOptions.bandHeight = 0;
+            streamOptions.explain = false;
+            streamOptions.threadCount = 1;
+            streamOptions.useMapping = m == 1;
+            Measurement stream = {0, 0, 0};
+            while (measuring(&stream)){
+                FILE *out = tmpfile();
+                assert(out != NULL);
+                double start = nowSeconds();
+                BitmapFile outFile;
+                attachFile(&inFile, in, size, false, streamOptions.useMapping);
+                attachFile(&outFile, out, size, true, streamOptions.useMapping);
+                streamImage(&inFile, &outFile, &header, 0, NULL, &streamOptions, &pool, &workspace);
+                detachFile(&outFile);
+                detachFile(&inFile);
+                fflush(out);
+                addRun(&stream, nowSeconds() - start);
+                fclose(out);
+            }
+            printMeasurement(&first, "io", m == 1 ? "stream mmap" : "stream stdio", height, width, size, &stream);
+        }
+        freeWorkspace(&workspace);
+        destroyPool(&pool);
+        free(raw);
+        fclose(in);
+        freeBuffer(&original);
+        freeBuffer(&pixels);
+    }
+    printf("\n  ]\n}\n");
+}
+
+//BATCH FUNCTIONS
 
-    getHeaderData(args[inFile], headerSize, headerCopy);
-    bitmapCheck(headerCopy);
-    parseHeader(headerCopy, header);
-    validateImage(header);
+//Batch object definition
+//The list of files and the effect chain shared by every worker of a batch
+//Workers take the next file under the lock, so a slow image never holds up the others
+//A file that can't be processed is reported to %report% and counted in %failedCount%, and the batch carries on
+//%outNames% and %problems% are worked out by nameOutputs before the workers start
+struct Batch{
+    char **fileNames;
+    int fileCount;
+    const char *outDirectory;
+    int effectCount;
+    Effect *effects;
+    Options *options;
+    FILE *report;
+    pthread_mutex_t lock;
+    int nextFile;
+    int failedCount;
+    long long totalBytes;
+    char **outNames;
+    const char **problems;
+};
 
-    const int rawPixelArraySize = header->size - header->pixelDataIndex;
-    Byte rawPixelArray[rawPixelArraySize];
-    getPixelArray(args[inFile], header->pixelDataIndex, rawPixelArraySize, rawPixelArray);
+typedef struct Batch Batch;
 
-    Byte pixels[header->height][header->width][channels];
-    parseRawPixelArray(header->height, header->width, pixels, rawPixelArray, header);
+//Output file of one file of a batch
+struct BatchOutput{
+    const char *name;
+    int file;
+};
 
-    effectsChain(header->height, header->width, pixels, header, argNum, args);
+typedef struct BatchOutput BatchOutput;
 
-    Byte newRawPixelArray[rawPixelArraySize];
-    generateRawPixelArray(header->height, header->width, pixels, newRawPixelArray, header);
-    writeToFile(args[outFile], header->pixelDataIndex, headerCopy, rawPixelArraySize, newRawPixelArray);
+//Reads the names of the files to process, one per line (blank lines are ignored)
+//Returns the number of names and sets %fileNames% to a new array of them
+int readFileList(const char listName[], char ***fileNames){
+    FILE *list = fopenCheck(listName, "r");
+    int capacity = 64;
+    int count = 0;
+    char **names = mallocCheck(capacity * sizeof(char *));
+    char line[4096];
+    while (fgets(line, sizeof(line), list) != NULL){
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strlen(line) == 0) continue;
+        if (count == capacity){
+            capacity *= 2;
+            char **grown = realloc(names, capacity * sizeof(char *));
+            if (grown == NULL){
+                fprintf(stderr, "Can't allocate %zu bytes\n", capacity * sizeof(char *));
+                exit(1);
+            }
+            names = grown;
+        }
+        names[count] = mallocCheck(strlen(line) + 1);
+        strcpy(names[count], line);
+        count++;
+    }
+    fclose(list);
+    *fileNames = names;
+    return count;
+}
 
-    printf("SUCCESS: %s -> %s\n", args[inFile], args[outFile]);
+//Builds the name of the output file for %inName%: the file of the same name in %outDirectory%
+//Returns false if the name doesn't fit in %outSize% characters
+bool batchOutputName(const char outDirectory[], const char inName[], char outName[], size_t outSize){
+    const char *baseName = strrchr(inName, '/') != NULL ? strrchr(inName, '/') + 1 : inName;
+    const size_t length = strlen(outDirectory);
+    const char *separator = length > 0 && outDirectory[length - 1] == '/' ? "" : "/";
+    return snprintf(outName, outSize, "%s%s%s", outDirectory, separator, baseName) < (int) outSize;
+}
+
+//Orders the outputs of a batch by name, and outputs of the same name by the place of their file in the list
+int compareOutputs(const void *first, const void *second){
+    const BatchOutput *a = first;
+    const BatchOutput *b = second;
+    const int order = strcmp(a->name, b->name);
+    return order != 0 ? order : a->file - b->file;
+}
+
+//Works out the output name of every file of a batch, or the reason the file can't be processed
+//Files in different directories can have the same name, and so the same output: only the first of them in the list is processed,
+//since the others would overwrite its output (or write it at the same time on another worker)
+void nameOutputs(Batch *batch){
+    batch->outNames = mallocCheck(sizeof(char *) * batch->fileCount);
+    batch->problems = mallocCheck(sizeof(const char *) * batch->fileCount);
+    BatchOutput *sorted = mallocCheck(sizeof(BatchOutput) * batch->fileCount);
+    int namedCount = 0;
+    for (int f = 0; f < batch->fileCount; f++){
+        char outName[4096];
+        batch->outNames[f] = NULL;
+        batch->problems[f] = NULL;
+        if (!batchOutputName(batch->outDirectory, batch->fileNames[f], outName, sizeof(outName))){
+            batch->problems[f] = "Output file name is too long";
+            continue;
+        }
+        batch->outNames[f] = mallocCheck(strlen(outName) + 1);
+        strcpy(batch->outNames[f], outName);
+        sorted[namedCount].name = batch->outNames[f];
+        sorted[namedCount].file = f;
+        namedCount++;
+    }
+    qsort(sorted, namedCount, sizeof(BatchOutput), compareOutputs);
+    for (int n = 1; n < namedCount; n++){
+        if (strcmp(sorted[n].name, sorted[n - 1].name) == 0) batch->problems[sorted[n].file] = "Another file in the batch has the same output name";
+    }
+    free(sorted);
+}
+
+//Releases the output names of a batch
+void freeOutputs(Batch *batch){
+    for (int f = 0; f < batch->fileCount; f++) free(batch->outNames[f]);
+    free(batch->outNames);
+    free(batch->problems);
+}
+
+//Worker of a batch: processes files until the list runs out
+//Each worker keeps its own workspace, so buffers are allocated once per worker rather than once per file
+//While one worker waits on a read or write the others keep processing, which overlaps the I/O with the effects
+void *batchWorker(void *argument){
+    Batch *batch = argument;
+    ThreadPool pool;
+    createPool(&pool, 1);
+    Workspace workspace;
+    createWorkspace(&workspace);
+    Options options = *batch->options;
+    long long bytes = 0;
+    int failed = 0;
+    while (true){
+        pthread_mutex_lock(&batch->lock);
+        int file = batch->nextFile++;
+        pthread_mutex_unlock(&batch->lock);
+        if (file >= batch->fileCount) break;
+
+        //Explain the plan once for the whole batch
+        options.explain = batch->options->explain && file == 0;
+        const char *problem = batch->problems[file];
+        long size = -1;
+        if (problem == NULL){
+            size = processFile(batch->fileNames[file], batch->outNames[file], batch->effectCount, batch->effects, &options, &pool, &workspace, &problem);
+        }
+        if (size >= 0) bytes += size;
+        else {
+            failed++;
+            pthread_mutex_lock(&batch->lock);
+            fprintf(batch->report, "FAILED: %s: %s\n", batch->fileNames[file], problem);
+            pthread_mutex_unlock(&batch->lock);
+        }
+    }
+    pthread_mutex_lock(&batch->lock);
+    batch->totalBytes += bytes;
+    batch->failedCount += failed;
+    pthread_mutex_unlock(&batch->lock);
+    freeWorkspace(&workspace);
+    destroyPool(&pool);
+    return NULL;
+}
+
+//Processes every file of a batch on %threadCount% workers (no more than there are files)
+//Returns the time taken in seconds
+double runBatch(Batch *batch, int threadCount){
+    const int workerCount = threadCount < batch->fileCount ? threadCount : batch->fileCount;
+    double start = nowSeconds();
+    nameOutputs(batch);
+    pthread_t workers[maxThreads];
+    for (int t = 1; t < workerCount; t++){
+        if (pthread_create(&workers[t], NULL, batchWorker, batch) != 0){
+            printf("Can't create a worker thread\n");
+            exit(1);
+        }
+    }
+    //The calling thread is the first worker
+    batchWorker(batch);
+    for (int t = 1; t < workerCount; t++) pthread_join(workers[t], NULL);
+    freeOutputs(batch);
+    return nowSeconds() - start;
+}
+
+//Displays how many images a batch processed and how many failed, and the throughput of the ones processed
+void reportBatch(const Batch *batch, double elapsed){
+    const int processed = batch->fileCount - batch->failedCount;
+    fprintf(batch->report, "SUCCESS: %d images -> %s\n", processed, batch->outDirectory);
+    if (batch->failedCount > 0) fprintf(batch->report, "FAILED: %d images\n", batch->failedCount);
+    fprintf(batch->report, "%.2f s, %.1f images/s, %.1f MB/s\n", elapsed, processed / elapsed, batch->totalBytes / elapsed / 1e6);
+}
+
+//Applies one effect chain to every file named in a list, writing the results to a directory
+//The chain is parsed once and the files are shared between %threadCount% workers
+//Files that can't be processed are reported and skipped, and the program exits with an error once the rest are done
+void processBatch(int argNum, char *args[argNum], Options *options){
+    if (argNum <= outFile){
+        printf("Please provide a file list and an output directory\n");
+        exit(1);
+    }
 
+    Effect effects[argNum];
+    int effectCount = parseEffects(argNum, args, effects);
+    Batch batch = {NULL, 0, args[outFile], effectCount, effects, options, stdout, PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, NULL, NULL};
+    batch.fileCount = readFileList(args[inFile], &batch.fileNames);
+    reportBatch(&batch, runBatch(&batch, options->threadCount));
+
+    for (int i = 0; i < batch.fileCount; i++) free(batch.fileNames[i]);
+    free(batch.fileNames);
+    freeEffects(effectCount, effects);
+    if (batch.failedCount > 0) exit(1);
 }
 
 //TESTING FUNCTIONS
@@ -449,11 +3905,34 @@ bool checkPixels(int height, int width, Byte correct[height][width][channels], B
     return valid;
 }
 
+//Copies an interleaved test image into a new pixel buffer
+void loadPixels(int height, int width, Byte pixels[height][width][channels], PixelBuffer *buffer){
+    createBuffer(buffer, height, width);
+    for (int i = 0; i < height; i++){
+        for (int j = 0; j < width; j++){
+            for (Byte k = 0; k < channels; k++) planeRow(buffer, k, i)[j] = pixels[i][j][k];
+        }
+    }
+}
+
+//Copies a pixel buffer back into an interleaved test image and releases the buffer
+void storePixels(PixelBuffer *buffer, int height, int width, Byte pixels[height][width][channels]){
+    for (int i = 0; i < height; i++){
+        for (int j = 0; j < width; j++){
+            for (Byte k = 0; k < channels; k++) pixels[i][j][k] = planeRow(buffer, k, i)[j];
+        }
+    }
+    freeBuffer(buffer);
+}
+
 //Tests the flipX effect function
 void testFlipX(){
     Byte pixels[2][1][3] = {{{0, 0, 0}},{{125, 255, 63}}};
     Byte correct[2][1][3] = {{{125,255,63}},{{0, 0, 0}}};
-    flipX(2,1,pixels);
+    PixelBuffer buffer;
+    loadPixels(2, 1, pixels, &buffer);
+    flipX(&buffer);
+    storePixels(&buffer, 2, 1, pixels);
     assert(checkPixels(2, 1, correct, pixels));
 }
 
@@ -461,7 +3940,10 @@ void testFlipX(){
 void testFlipY(){
     Byte pixels[1][2][3] = {{{0, 0, 0},{125, 255, 63}}};
     Byte correct[1][2][3] = {{{125,255,63},{0, 0, 0}}};
-    flipY(1,2,pixels);
+    PixelBuffer buffer;
+    loadPixels(1, 2, pixels, &buffer);
+    flipY(&buffer);
+    storePixels(&buffer, 1, 2, pixels);
     assert(checkPixels(1, 2, correct, pixels));
 }
 
@@ -469,7 +3951,10 @@ void testFlipY(){
 void testGreyscale(){
     Byte pixel[1][1][3] = {{{43,254,137}}};
     Byte correct[1][1][3] = {{{144,144,144}}};
-    greyscale(1,1,pixel);
+    PixelBuffer buffer;
+    loadPixels(1, 1, pixel, &buffer);
+    greyscale(&buffer);
+    storePixels(&buffer, 1, 1, pixel);
     assert(checkPixels(1, 1, correct, pixel));
 }
 
@@ -477,7 +3962,10 @@ void testGreyscale(){
 void testDarken(){
     Byte pixel[1][1][3] = {{{0, 255, 125}}};
     Byte correct[1][1][3] = {{{0,89,43}}};
-    darken(1,1,pixel,65);
+    PixelBuffer buffer;
+    loadPixels(1, 1, pixel, &buffer);
+    darken(&buffer, 65);
+    storePixels(&buffer, 1, 1, pixel);
     assert(checkPixels(1, 1, correct, pixel));
 }
 
@@ -485,7 +3973,10 @@ void testDarken(){
 void testBrighten(){
     Byte pixel[1][1][3] = {{{0, 255, 125}}};
     Byte correct[1][1][3] = {{{191,255,222}}};
-    brighten(1,1,pixel,75);
+    PixelBuffer buffer;
+    loadPixels(1, 1, pixel, &buffer);
+    brighten(&buffer, 75);
+    storePixels(&buffer, 1, 1, pixel);
     assert(checkPixels(1, 1, correct, pixel));
 }
 
@@ -493,7 +3984,10 @@ void testBrighten(){
 void testInvert(){
     Byte pixel[1][1][3] = {{{0, 255, 64}}};
     Byte correct[1][1][3] = {{{255, 0, 191}}};
-    invert(1,1,pixel);
+    PixelBuffer buffer;
+    loadPixels(1, 1, pixel, &buffer);
+    invert(&buffer);
+    storePixels(&buffer, 1, 1, pixel);
     assert(checkPixels(1, 1, correct, pixel));
 }
 
@@ -501,10 +3995,1346 @@ void testInvert(){
 void testBlur(){
     Byte pixels[2][2][3] = {{{255,0,0},{24,1,1}},{{95,2,2},{183,3,3}}};
     Byte correct[2][2][3] = {{{139,1,1},{139,1,1}},{{139,1,1},{139,1,1}}};
-    blur(2,2,pixels,1);
+    PixelBuffer buffer;
+    loadPixels(2, 2, pixels, &buffer);
+    blur(&buffer, 1);
+    storePixels(&buffer, 2, 2, pixels);
     assert(checkPixels(2, 2, correct, pixels));
 }
 
+//Writes a small bitmap filled with pseudo random pixel values to a temporary file
+FILE *syntheticBitmap(int height, int width, int bitsPerPixel, Byte headerBytes[54], ImageHeader *header){
+    createHeader(headerBytes, height, width, bitsPerPixel);
+    parseHeader(headerBytes, header);
+    const long rowSize = rowBytes(header);
+    FILE *file = tmpfile();
+    assert(file != NULL);
+    fwrite(headerBytes, sizeof(Byte), 54, file);
+    srand(height * width);
+    for (long i = 54; i < header->pixelDataIndex; i++) fputc(rand() % 256, file);
+    const long usedBytes = width * header->bitsPerPixel / 8;
+    for (long i = 0; i < height * rowSize; i++) fputc(i % rowSize < usedBytes ? rand() % 256 : 0, file);
+    return file;
+}
+
+//Tests that every row of every plane is 64 byte aligned and that parsing then generating a bitmap is lossless
+void testPixelBuffer(){
+    const int height = 5;
+    const int width = 70;
+    Byte headerBytes[54];
+    ImageHeader header;
+    FILE *in = syntheticBitmap(height, width, 24, headerBytes, &header);
+    const long rowSize = rowBytes(&header);
+    Byte raw[height * rowSize];
+    Byte generated[height * rowSize];
+    BitmapFile file;
+    attachFile(&file, in, streamSize(in), false, false);
+    readBytes(&file, header.pixelDataIndex, height * rowSize, raw);
+    fclose(in);
+
+    PixelBuffer pixels;
+    createBuffer(&pixels, height, width);
+    assert(pixels.stride == 128);
+    for (Byte k = 0; k < channels; k++){
+        for (int i = 0; i < height; i++) assert((uintptr_t) planeRow(&pixels, k, i) % 64 == 0);
+    }
+    parseRawPixelArray(&pixels, raw, &header);
+    generateRawPixelArray(&pixels, generated, &header);
+    assert(memcmp(raw, generated, sizeof(raw)) == 0);
+    freeBuffer(&pixels);
+
+    //Images with no rows or no columns still get memory, so their planes are never null pointers
+    const int emptySizes[][2] = {{0, 70}, {5, 0}, {0, 0}};
+    for (int n = 0; n < 3; n++){
+        createBuffer(&pixels, emptySizes[n][0], emptySizes[n][1]);
+        assert(pixels.memory != NULL && pixels.planes[2] != NULL);
+        invert(&pixels);
+        freeBuffer(&pixels);
+    }
+}
+
+//Tests the sliding window blur against the window sums of blurKernel on random images
+//Includes sizes larger than the image to check the window is clamped the same way
+void testBlurKernel(){
+    const int height = 13;
+    const int width = 10;
+    Byte pixels[height][width][channels];
+    Byte original[height][width][channels];
+    Byte correct[height][width][channels];
+    int sizes[] = {1, 2, 4, 9, 14, 100};
+    srand(2);
+    for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++){
+        for (int i = 0; i < height; i++){
+            for (int j = 0; j < width; j++){
+                for (int k = 0; k < channels; k++) pixels[i][j][k] = original[i][j][k] = rand() % 256;
+            }
+        }
+        PixelBuffer originalBuffer;
+        loadPixels(height, width, original, &originalBuffer);
+        for (int i = 0; i < height; i++){
+            for (int j = 0; j < width; j++){
+                for (int k = 0; k < channels; k++) correct[i][j][k] = blurKernel(&originalBuffer, sizes[s], i, j, k);
+            }
+        }
+        freeBuffer(&originalBuffer);
+        PixelBuffer buffer;
+        loadPixels(height, width, pixels, &buffer);
+        blur(&buffer, sizes[s]);
+        storePixels(&buffer, height, width, pixels);
+        assert(checkPixels(height, width, correct, pixels));
+    }
+}
+
+//Tests the convolution engine against convolveReference, including images narrower and shorter than the kernel,
+//images wider than a strip, mirrored kernels and the weights of the gaussian and command line kernels
+void testConvolution(){
+    const int sizes[][2] = {{9, 1040}, {3, 5}};
+    const int one = 1 << WeightBits;
+    Int2 gaussianTable[2 * gaussianRadius(2) + 1];
+    gaussianWeights(2, gaussianTable);
+    Int2 sharpenTable[] = {0, -one, 0, -one, 5 * one, -one, 0, -one, 0};
+    Kernel gaussianKernel = {gaussianRadius(2), true, gaussianTable, WeightBits};
+    Kernel sharpenKernel = {1, false, sharpenTable, WeightBits};
+    Kernel *separable = parseKernel("1,-2,5,3,1");
+    Kernel *square = parseKernel("1,2,3/0,-1,0/2,0,-7");
+    Kernel *identity = parseKernel("1");
+    Kernel *laplacian = parseKernel("-1,-1,-1/-1,8,-1/-1,-1,-1");
+    Kernel *tests[] = {&gaussianKernel, &sharpenKernel, separable, square, identity, laplacian};
+    for (int n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++){
+        const int height = sizes[n][0];
+        const int width = sizes[n][1];
+        PixelBuffer original;
+        PixelBuffer correct;
+        PixelBuffer pixels;
+        createBuffer(&original, height, width);
+        createBuffer(&correct, height, width);
+        createBuffer(&pixels, height, width);
+        randomPixels(&original, n);
+        for (int t = 0; t < sizeof(tests) / sizeof(tests[0]); t++){
+            for (int mirror = 0; mirror <= (MirrorRows | MirrorColumns); mirror++){
+                copyPixels(&original, &correct);
+                copyPixels(&original, &pixels);
+                convolveReference(&correct, tests[t], mirror);
+                convolve(&pixels, tests[t], mirror);
+                for (Byte k = 0; k < channels; k++){
+                    for (int i = 0; i < height; i++) assert(memcmp(planeRow(&correct, k, i), planeRow(&pixels, k, i), width) == 0);
+                }
+            }
+        }
+        copyPixels(&original, &pixels);
+        convolve(&pixels, identity, 0);
+        for (int i = 0; i < height; i++) assert(memcmp(planeRow(&original, 0, i), planeRow(&pixels, 0, i), width) == 0);
+        freeBuffer(&original);
+        freeBuffer(&correct);
+        freeBuffer(&pixels);
+    }
+
+    //The gaussian weights are symmetric, peak in the centre and add up to exactly 1, so a flat image stays flat
+    for (int sigma = 1; sigma <= 100; sigma++){
+        const int radius = gaussianRadius(sigma);
+        Int2 weights[2 * radius + 1];
+        gaussianWeights(sigma, weights);
+        int sum = 0;
+        for (int t = 0; t <= 2 * radius; t++){
+            sum += weights[t];
+            assert(weights[t] == weights[2 * radius - t]);
+            if (t < radius) assert(weights[t] <= weights[t + 1]);
+        }
+        assert(sum == one);
+    }
+    PixelBuffer flat;
+    createBuffer(&flat, 20, 30);
+    memset(flat.memory, 77, flat.stride * flat.height * channels);
+    gaussian(&flat, 4);
+    for (Byte k = 0; k < channels; k++){
+        for (int i = 0; i < flat.height; i++){
+            for (int j = 0; j < flat.width; j++) assert(planeRow(&flat, k, i)[j] == 77);
+        }
+    }
+    freeBuffer(&flat);
+
+    //Kernels are divided by their sum unless it is not positive
+    assert(separable->radius == 2 && separable->separable && separable->weights[0] == one / 8 && separable->weights[1] == -one / 4);
+    assert(square->radius == 1 && !square->separable && square->weights[4] == -one && square->weights[8] == -7 * one);
+    Kernel *binomial = parseKernel("1,2,1");
+    assert(binomial->weights[0] == one / 4 && binomial->weights[1] == one / 2 && binomial->weights[2] == one / 4);
+    assert(separable->shift == WeightBits && binomial->shift == WeightBits);
+
+    //Weights too large for WeightBits fractional bits get fewer, down to plain integers at the limit of the readme
+    assert(laplacian->shift == 11 && laplacian->weights[4] == 8 << 11 && laplacian->weights[0] == -(1 << 11));
+    Kernel *extreme = parseKernel("1000,-1000,-1000");
+    assert(extreme->shift == 5 && extreme->weights[1] == -1000 * (1 << 5));
+    Kernel *sharp = parseKernel("1,-100,1");
+    assert(sharp->shift == 8 && sharp->weights[0] == 1 << 8);
+    char *invalid[] = {"", "1,2", "1,,2", "1,2,", "a", "1,2,1/1,2", "1,2,1/1,2,1", "1,2,1/1,2,1/1,2,1/1,2,1", "9999", "-1001", "1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1"};
+    for (int i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) assert(parseKernel(invalid[i]) == NULL);
+    Effect parsed[] = {{KernelOp, 0, NULL, separable}, {KernelOp, 0, NULL, square}, {KernelOp, 0, NULL, identity}, {KernelOp, 0, NULL, binomial},
+        {KernelOp, 0, NULL, laplacian}, {KernelOp, 0, NULL, extreme}, {KernelOp, 0, NULL, sharp}};
+    freeEffects(7, parsed);
+}
+
+//Compares every available set of vector kernels with the scalar kernels on random data
+//Lengths that are not a multiple of the vector width check the scalar tails as well
+void testKernels(){
+    const long length = 1000;
+    Byte data[channels][length];
+    Byte correct[channels][length];
+    Byte test[channels][length];
+    Byte *correctPlanes[] = {correct[0], correct[1], correct[2]};
+    Byte *testPlanes[] = {test[0], test[1], test[2]};
+    PixelKernels available[3] = {scalarKernels};
+    int availableCount = 1;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) available[availableCount++] = sse2Kernels;
+    if (__builtin_cpu_supports("avx2")) available[availableCount++] = avx2Kernels;
+#endif
+    srand(3);
+    for (int trial = 0; trial < 50; trial++){
+        for (Byte k = 0; k < channels; k++){
+            for (long i = 0; i < length; i++) data[k][i] = rand() % 256;
+        }
+        const long testLength = length - trial;
+        float scaling = (rand() % 101) / 100.0f;
+        for (int s = 1; s < availableCount; s++){
+            memcpy(correct, data, sizeof(data));
+            memcpy(test, data, sizeof(data));
+            switch (trial % 5){
+                case 0: scalarKernels.invert(testLength, correct[0]); available[s].invert(testLength, test[0]); break;
+                case 1: scalarKernels.darken(testLength, correct[0], scaling); available[s].darken(testLength, test[0], scaling); break;
+                case 2: scalarKernels.brighten(testLength, correct[0], scaling); available[s].brighten(testLength, test[0], scaling); break;
+                case 3: scalarKernels.greyscale(testLength, correctPlanes); available[s].greyscale(testLength, testPlanes); break;
+                case 4: scalarKernels.reverse(testLength, correct[0]); available[s].reverse(testLength, test[0]); break;
+            }
+            assert(memcmp(correct, test, sizeof(data)) == 0);
+        }
+    }
+
+    //The reversal kernels meet in the middle, so check every short length
+    for (long testLength = 0; testLength <= 100; testLength++){
+        for (int s = 1; s < availableCount; s++){
+            memcpy(correct, data, sizeof(data));
+            memcpy(test, data, sizeof(data));
+            scalarKernels.reverse(testLength, correct[0]);
+            available[s].reverse(testLength, test[0]);
+            assert(memcmp(correct, test, sizeof(data)) == 0);
+        }
+    }
+
+    //Random weights and numbers of taps, including odd numbers of taps and lengths that leave a scalar tail
+    for (int trial = 0; trial < 50; trial++){
+        const int taps = 1 + rand() % 12;
+        Byte const *sources[taps];
+        Int2 weights[taps];
+        for (int t = 0; t < taps; t++){
+            sources[t] = &data[t % channels][t];
+            weights[t] = rand() % 1200 - 200;
+        }
+        const long testLength = length - 16 - trial;
+        const int shift = trial % (WeightBits + 1);
+        scalarKernels.convolve(testLength, sources, weights, taps, shift, correct[0]);
+        for (int s = 1; s < availableCount; s++){
+            available[s].convolve(testLength, sources, weights, taps, shift, test[0]);
+            assert(memcmp(correct[0], test[0], testLength) == 0);
+        }
+    }
+
+    //The same for taps that have already been interleaved into pairs, where the vector loops are unrolled further
+    //and some of the pairs are added to mirror image pairs first, which can take the sums of two taps up to 510
+    Int2 pairData[2 * length];
+    for (long i = 0; i < 2 * length; i++) pairData[i] = rand() % 256;
+    for (int trial = 0; trial < 50; trial++){
+        const int pairCount = 1 + rand() % 16;
+        const int mirroredCount = rand() % (pairCount + 1);
+        Int2 const *pairs[pairCount];
+        Int2 const *mirrors[pairCount];
+        Int2 weights[2 * pairCount];
+        for (int m = 0; m < pairCount; m++){
+            pairs[m] = &pairData[2 * (rand() % 16)];
+            mirrors[m] = &pairData[2 * (rand() % 16)];
+            weights[2 * m] = rand() % 1200 - 200;
+            weights[2 * m + 1] = rand() % 1200 - 200;
+        }
+        const long testLength = length - 16 - 7 * trial;
+        const int shift = trial % (WeightBits + 1);
+        scalarKernels.convolvePairs(testLength, pairs, mirrors, weights, pairCount, mirroredCount, shift, correct[0]);
+        for (int s = 1; s < availableCount; s++){
+            available[s].convolvePairs(testLength, pairs, mirrors, weights, pairCount, mirroredCount, shift, test[0]);
+            assert(memcmp(correct[0], test[0], testLength) == 0);
+        }
+    }
+
+    //Interleaving at every short length and offset checks the tails, and the full length the unrolled loops
+    Int2 correctPairs[2 * length];
+    Int2 testPairs[2 * length];
+    for (long testLength = 0; testLength <= length; testLength += testLength < 100 ? 1 : length - 100){
+        const int offset = testLength % 7;
+        scalarKernels.interleave(testLength - offset, &data[0][offset], &data[1][0], correctPairs);
+        for (int s = 1; s < availableCount; s++){
+            available[s].interleave(testLength - offset, &data[0][offset], &data[1][0], testPairs);
+            assert(memcmp(correctPairs, testPairs, sizeof(Int2) * 2 * (testLength - offset)) == 0);
+        }
+    }
+
+    //Every possible sum of 3 channels must be averaged exactly
+    const long sumCount = 3 * 255 + 1;
+    for (long i = 0; i < sumCount; i++){
+        for (Byte k = 0; k < channels; k++) data[k][i] = i / 3 + (k < i % 3);
+    }
+    for (int s = 0; s < availableCount; s++){
+        memcpy(test, data, sizeof(data));
+        available[s].greyscale(sumCount, testPlanes);
+        for (long i = 0; i < sumCount; i++){
+            for (Byte k = 0; k < channels; k++) assert(test[k][i] == i / 3);
+        }
+    }
+}
+
+//Tests the edges effect function on a vertical edge, and the single pass engine against the reference on random images
+void testEdges(){
+    Byte pixels[3][3][3] = {{{0,0,0},{0,0,0},{255,255,255}},{{0,0,0},{0,0,0},{255,255,255}},{{0,0,0},{0,0,0},{255,255,255}}};
+    Byte correct[3][3][3] = {{{0,0,0},{0,0,0},{255,255,255}},{{0,0,0},{113,113,113},{255,255,255}},{{0,0,0},{0,0,0},{255,255,255}}};
+    PixelBuffer buffer;
+    loadPixels(3, 3, pixels, &buffer);
+    edges(&buffer);
+    storePixels(&buffer, 3, 3, pixels);
+    assert(checkPixels(3, 3, correct, pixels));
+
+    int sizes[][2] = {{1, 1}, {1, 7}, {7, 1}, {2, 2}, {23, 37}};
+    for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++){
+        const int height = sizes[s][0];
+        const int width = sizes[s][1];
+        PixelBuffer test;
+        PixelBuffer reference;
+        createBuffer(&test, height, width);
+        createBuffer(&reference, height, width);
+        randomPixels(&test, s);
+        copyPixels(&test, &reference);
+        edges(&test);
+        edgesReference(&reference);
+        for (Byte k = 0; k < channels; k++){
+            for (int i = 0; i < height; i++) assert(memcmp(planeRow(&test, k, i), planeRow(&reference, k, i), width) == 0);
+        }
+        freeBuffer(&test);
+        freeBuffer(&reference);
+    }
+}
+
+//Tests that runs of tone effects composed into lookup tables give exactly the same image as the effects one by one
+void testTone(){
+    const int height = 7;
+    const int width = 45;
+    Effect effects[] = {{GreyscaleOp, 0}, {DarkenOp, 40}, {InvertOp, 0}, {BrightenOp, 10}, {DarkenOp, 3}, {BlurOp, 1}, {BrightenOp, 77}};
+    const int effectCount = sizeof(effects) / sizeof(effects[0]);
+    PixelBuffer original;
+    PixelBuffer separate;
+    PixelBuffer composed;
+    createBuffer(&original, height, width);
+    createBuffer(&separate, height, width);
+    createBuffer(&composed, height, width);
+    randomPixels(&original, 9);
+    copyPixels(&original, &separate);
+    copyPixels(&original, &composed);
+
+    const int toneRun = kernels.toneRun;
+    kernels.toneRun = 2;
+    greyscale(&separate);
+    darken(&separate, 40);
+    invert(&separate);
+    brighten(&separate, 10);
+    darken(&separate, 3);
+    blur(&separate, 1);
+    brighten(&separate, 77);
+    effectsChain(&composed, effectCount, effects);
+    for (Byte k = 0; k < channels; k++){
+        for (int i = 0; i < height; i++) assert(memcmp(planeRow(&separate, k, i), planeRow(&composed, k, i), width) == 0);
+    }
+
+    //Every table agrees with its effect for every byte value
+    Byte values[256];
+    for (int v = 0; v < 256; v++) values[v] = v;
+    for (int param = 1; param <= 100; param++){
+        Effect darkenEffect = {DarkenOp, param, NULL};
+        Byte table[256];
+        toneTable(1, &darkenEffect, table);
+        Byte expected[256];
+        memcpy(expected, values, 256);
+        darkenScalar(256, expected, 1 - param / 100.0f);
+        assert(memcmp(table, expected, 256) == 0);
+    }
+
+    Byte tables[effectCount][256];
+    Effect chain[effectCount];
+    memcpy(chain, effects, sizeof(effects));
+    assert(composeToneEffects(effectCount, chain, tables) == 4);
+    assert(chain[0].type == GreyscaleOp);
+    assert(chain[1].type == ToneOp && chain[1].param == 4);
+    assert(chain[2].type == BlurOp && chain[3].type == BrightenOp);
+    copyPixels(&original, &composed);
+    effectsChain(&composed, 4, chain);
+    for (Byte k = 0; k < channels; k++){
+        for (int i = 0; i < height; i++) assert(memcmp(planeRow(&separate, k, i), planeRow(&composed, k, i), width) == 0);
+    }
+    kernels.toneRun = toneRun;
+
+    freeBuffer(&original);
+    freeBuffer(&separate);
+    freeBuffer(&composed);
+}
+
+//Tests the in place flips and the tiled transpose and rotation against their definitions
+//The sizes are odd and larger than a transpose tile so every edge case is covered
+void testOrientation(){
+    const int height = 71;
+    const int width = 130;
+    PixelBuffer original;
+    PixelBuffer pixels;
+    createBuffer(&original, height, width);
+    createBuffer(&pixels, height, width);
+    randomPixels(&original, 10);
+
+    copyPixels(&original, &pixels);
+    flipX(&pixels);
+    for (Byte k = 0; k < channels; k++){
+        for (int i = 0; i < height; i++) assert(memcmp(planeRow(&pixels, k, i), planeRow(&original, k, height - 1 - i), width) == 0);
+    }
+    flipY(&pixels);
+    for (Byte k = 0; k < channels; k++){
+        for (int i = 0; i < height; i++){
+            for (int j = 0; j < width; j++) assert(planeRow(&pixels, k, i)[j] == planeRow(&original, k, height - 1 - i)[width - 1 - j]);
+        }
+    }
+
+    copyPixels(&original, &pixels);
+    transpose(&pixels);
+    assert(pixels.height == width && pixels.width == height);
+    for (Byte k = 0; k < channels; k++){
+        for (int i = 0; i < width; i++){
+            for (int j = 0; j < height; j++) assert(planeRow(&pixels, k, i)[j] == planeRow(&original, k, j)[i]);
+        }
+    }
+    freeBuffer(&pixels);
+    createBuffer(&pixels, height, width);
+    copyPixels(&original, &pixels);
+    rotate90(&pixels);
+    assert(pixels.height == width && pixels.width == height);
+    for (Byte k = 0; k < channels; k++){
+        for (int i = 0; i < width; i++){
+            for (int j = 0; j < height; j++) assert(planeRow(&pixels, k, i)[j] == planeRow(&original, k, height - 1 - j)[i]);
+        }
+    }
+
+    //Four turns clockwise are the original image
+    for (int turn = 1; turn < 4; turn++) rotate90(&pixels);
+    for (Byte k = 0; k < channels; k++){
+        for (int i = 0; i < height; i++) assert(memcmp(planeRow(&pixels, k, i), planeRow(&original, k, i), width) == 0);
+    }
+    freeBuffer(&original);
+    freeBuffer(&pixels);
+}
+
+//Tests that a chain with turns gives the bitmap of applying the chain to the whole image, with the header turned to match
+void testTurnStreaming(){
+    const int height = 13;
+    const int width = 30;
+    Byte headerBytes[54];
+    ImageHeader header;
+    FILE *in = syntheticBitmap(height, width, 24, headerBytes, &header);
+    const long size = streamSize(in);
+    Effect effects[] = {{BlurOp, 1, NULL}, {Rotate90Op, 0, NULL}, {FlipXOp, 0, NULL}, {InvertOp, 0, NULL}, {DarkenOp, 10, NULL}, {TransposeOp, 0, NULL}, {FlipYOp, 0, NULL}, {FlipYOp, 0, NULL}, {Rotate90Op, 0, NULL}, {EdgesOp, 0, NULL}};
+    const int effectCount = sizeof(effects) / sizeof(effects[0]);
+
+    PixelBuffer pixels;
+    createBuffer(&pixels, height, width);
+    BitmapFile inFile;
+    attachFile(&inFile, in, size, false, false);
+    Byte *raw = mallocCheck(height * rowBytes(&header));
+    parseRawPixelArray(&pixels, readBytes(&inFile, header.pixelDataIndex, height * rowBytes(&header), raw), &header);
+    effectsChain(&pixels, effectCount, effects);
+    ImageHeader turned = header;
+    turned.height = width;
+    turned.width = height;
+    const long turnedArraySize = turned.height * rowBytes(&turned);
+    assert(pixels.height == turned.height && pixels.width == turned.width);
+    Byte *expected = mallocCheck(turnedArraySize);
+    Byte *actual = mallocCheck(turnedArraySize);
+    memset(expected, 0, turnedArraySize);
+    generateRawPixelArray(&pixels, expected, &turned);
+
+    const long outSize = outputFileSize(&header, size, effectCount, effects);
+    assert(outSize == header.pixelDataIndex + turnedArraySize);
+    ThreadPool pool;
+    createPool(&pool, 2);
+    Workspace workspace;
+    createWorkspace(&workspace);
+    for (int mode = 0; mode < 4; mode++){
+        Options options = {0, false, 2, 0, false, true, 0, false, false, false};
+        FILE *out = tmpfile();
+        assert(out != NULL);
+        BitmapFile outFile;
+        attachFile(&inFile, in, size, false, mode & 1);
+        attachFile(&outFile, out, outSize, true, mode & 2);
+        streamImage(&inFile, &outFile, &header, effectCount, effects, &options, &pool, &workspace);
+        detachFile(&outFile);
+        detachFile(&inFile);
+        assert(streamSize(out) == outSize);
+        Byte outHeader[54];
+        assert(fread(outHeader, sizeof(Byte), 54, out) == 54);
+        ImageHeader outHeaderData;
+        parseHeader(outHeader, &outHeaderData);
+        assert(outHeaderData.width == turned.width && outHeaderData.height == turned.height && outHeaderData.size == outSize);
+        assert(fread(actual, sizeof(Byte), turnedArraySize, out) == turnedArraySize);
+        assert(memcmp(expected, actual, turnedArraySize) == 0);
+        fclose(out);
+    }
+    freeWorkspace(&workspace);
+    destroyPool(&pool);
+    free(raw);
+    free(expected);
+    free(actual);
+    freeBuffer(&pixels);
+    fclose(in);
+}
+
+//Tests that streaming an image in bands, through mapped or stdio files, gives the same bitmap as applying the chain to the whole image at once
+void testStreaming(){
+    const int height = 41;
+    const int width = 17;
+    Byte headerBytes[54];
+    ImageHeader header;
+    FILE *in = syntheticBitmap(height, width, 24, headerBytes, &header);
+    const long rowSize = rowBytes(&header);
+    const long size = streamSize(in);
+
+    //The kernels are not symmetric, so they are mirrored when the flips are moved past them
+    Kernel *square = parseKernel("1,2,3/0,-1,0/2,0,-7");
+    Kernel *separable = parseKernel("1,-2,5,3,1");
+    Effect effects[] = {{BlurOp, 2}, {FlipXOp, 0}, {EdgesOp, 0}, {KernelOp, 0, NULL, square}, {InvertOp, 0}, {FlipYOp, 0}, {BlurOp, 1}, {GaussianOp, 1}, {FlipXOp, 0}, {KernelOp, 0, NULL, separable}, {DarkenOp, 30}, {SharpenOp, 0}};
+    const int effectCount = sizeof(effects) / sizeof(effects[0]);
+
+    Byte *expected = mallocCheck(height * rowSize);
+    PixelBuffer pixels;
+    createBuffer(&pixels, height, width);
+    BitmapFile inFile;
+    attachFile(&inFile, in, size, false, false);
+    readBytes(&inFile, header.pixelDataIndex, height * rowSize, expected);
+    parseRawPixelArray(&pixels, expected, &header);
+    effectsChain(&pixels, effectCount, effects);
+    generateRawPixelArray(&pixels, expected, &header);
+
+    Byte *actual = mallocCheck(height * rowSize);
+    Workspace workspace;
+    createWorkspace(&workspace);
+    int bandHeights[] = {1, 5, 9, 13, height};
+    int threadCounts[] = {1, 3};
+    for (int t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++){
+        ThreadPool pool;
+        createPool(&pool, threadCounts[t]);
+        for (int i = 0; i < sizeof(bandHeights) / sizeof(bandHeights[0]); i++){
+            //Every combination of mapped and stdio input and output
+            for (int mode = 0; mode < 4; mode++){
+                Options options = {bandHeights[i], false, threadCounts[t], 0, false, true, 0, false, false, false};
+                FILE *out = tmpfile();
+                assert(out != NULL);
+                BitmapFile outFile;
+                attachFile(&inFile, in, size, false, mode & 1);
+                attachFile(&outFile, out, size, true, mode & 2);
+                streamImage(&inFile, &outFile, &header, effectCount, effects, &options, &pool, &workspace);
+                detachFile(&outFile);
+                detachFile(&inFile);
+                assert(streamSize(out) == size);
+                fseek(out, 0, SEEK_SET);
+                assert(fread(actual, sizeof(Byte), header.pixelDataIndex, out) == header.pixelDataIndex);
+                assert(memcmp(headerBytes, actual, header.pixelDataIndex) == 0);
+                assert(fread(actual, sizeof(Byte), height * rowSize, out) == height * rowSize);
+                assert(memcmp(expected, actual, height * rowSize) == 0);
+                fclose(out);
+            }
+        }
+        destroyPool(&pool);
+    }
+
+    freeWorkspace(&workspace);
+    free(expected);
+    free(actual);
+    freeBuffer(&pixels);
+    fclose(in);
+    freeEffects(effectCount, effects);
+}
+
+//Streams a synthetic bitmap through a chain into a new temporary file, which is returned
+FILE *streamSynthetic(FILE *in, ImageHeader *header, int effectCount, Effect effects[effectCount], bool useMapping){
+    const long size = streamSize(in);
+    const long outSize = outputFileSize(header, size, effectCount, effects);
+    ThreadPool pool;
+    createPool(&pool, 2);
+    Workspace workspace;
+    createWorkspace(&workspace);
+    Options options = {5, false, 2, 0, false, useMapping, 0, false, false, false};
+    FILE *out = tmpfile();
+    assert(out != NULL);
+    BitmapFile inFile;
+    BitmapFile outFile;
+    attachFile(&inFile, in, size, false, useMapping);
+    attachFile(&outFile, out, outSize, true, useMapping);
+    streamImage(&inFile, &outFile, header, effectCount, effects, &options, &pool, &workspace);
+    detachFile(&outFile);
+    detachFile(&inFile);
+    assert(streamSize(out) == outSize);
+    freeWorkspace(&workspace);
+    destroyPool(&pool);
+    return out;
+}
+
+//Tests that 32 bit bitmaps keep their alpha bytes and that palettized bitmaps are recoloured through their colour table
+void testFormats(){
+    const int height = 11;
+    const int width = 23;
+    Byte headerBytes[54];
+    ImageHeader header;
+
+    //32 bit pixels: the alpha bytes move with the pixels but no effect changes them
+    FILE *in = syntheticBitmap(height, width, 32, headerBytes, &header);
+    assert(formatPlanes(&header) == 4 && rowBytes(&header) == width * 4);
+    const long arraySize = height * rowBytes(&header);
+    Byte *raw = mallocCheck(arraySize);
+    Byte *expected = mallocCheck(arraySize);
+    Byte *actual = mallocCheck(arraySize);
+    BitmapFile inFile;
+    attachFile(&inFile, in, streamSize(in), false, false);
+    readCopy(&inFile, header.pixelDataIndex, arraySize, raw);
+    Effect effects[] = {{BlurOp, 1, NULL}, {FlipXOp, 0, NULL}, {InvertOp, 0, NULL}, {FlipYOp, 0, NULL}, {EdgesOp, 0, NULL}};
+    const int effectCount = sizeof(effects) / sizeof(effects[0]);
+    PixelBuffer pixels;
+    createPlanes(&pixels, height, width, 4);
+    parseRawPixelArray(&pixels, raw, &header);
+    generateRawPixelArray(&pixels, expected, &header);
+    assert(memcmp(raw, expected, arraySize) == 0);
+    effectsChain(&pixels, effectCount, effects);
+    generateRawPixelArray(&pixels, expected, &header);
+    for (int i = 0; i < height; i++){
+        for (int j = 0; j < width; j++) assert(expected[(height - 1 - i) * width * 4 + (width - 1 - j) * 4 + 3] == raw[i * width * 4 + j * 4 + 3]);
+    }
+    for (int mode = 0; mode < 2; mode++){
+        FILE *out = streamSynthetic(in, &header, effectCount, effects, mode);
+        fseek(out, header.pixelDataIndex, SEEK_SET);
+        assert(fread(actual, sizeof(Byte), arraySize, out) == arraySize);
+        assert(memcmp(expected, actual, arraySize) == 0);
+        fclose(out);
+    }
+    //Stored rows are bottom up, so a clockwise turn sends the stored pixel at (i, j) to stored row width - 1 - j, column i
+    Effect turns[] = {{Rotate90Op, 0, NULL}, {GreyscaleOp, 0, NULL}};
+    FILE *out = streamSynthetic(in, &header, 2, turns, false);
+    fseek(out, header.pixelDataIndex, SEEK_SET);
+    assert(fread(actual, sizeof(Byte), arraySize, out) == arraySize);
+    for (int i = 0; i < height; i++){
+        for (int j = 0; j < width; j++) assert(actual[(width - 1 - j) * height * 4 + i * 4 + 3] == raw[i * width * 4 + j * 4 + 3]);
+    }
+    fclose(out);
+    freeBuffer(&pixels);
+    fclose(in);
+
+    //8 bit pixels: the colour effects change the colour table and the flips and turns move the indices
+    in = syntheticBitmap(height, width, 8, headerBytes, &header);
+    assert(header.colourCount == 256 && header.pixelDataIndex == 54 + 4 * 256);
+    const long indexRowSize = rowBytes(&header);
+    Byte table[4 * 256];
+    Byte outTable[4 * 256];
+    attachFile(&inFile, in, streamSize(in), false, false);
+    readCopy(&inFile, header.paletteIndex, sizeof(table), table);
+    readCopy(&inFile, header.pixelDataIndex, height * indexRowSize, raw);
+    Effect palettized[] = {{FlipXOp, 0, NULL}, {InvertOp, 0, NULL}, {TransposeOp, 0, NULL}};
+    out = streamSynthetic(in, &header, 3, palettized, true);
+    fseek(out, header.paletteIndex, SEEK_SET);
+    assert(fread(outTable, sizeof(Byte), sizeof(table), out) == sizeof(table));
+    ImageHeader turned = header;
+    turned.width = height;
+    turned.height = width;
+    const long turnedRowSize = rowBytes(&turned);
+    assert(fread(actual, sizeof(Byte), width * turnedRowSize, out) == width * turnedRowSize);
+    for (int c = 0; c < 256; c++){
+        for (Byte k = 0; k < channels; k++) assert(outTable[c * 4 + k] == 255 - table[c * 4 + k]);
+        assert(outTable[c * 4 + 3] == table[c * 4 + 3]);
+    }
+    //Flipping the rows undoes the bottom up storage, so the transposed index at stored (i, j) lands in stored row width - 1 - j, column i
+    for (int i = 0; i < height; i++){
+        for (int j = 0; j < width; j++) assert(actual[(width - 1 - j) * turnedRowSize + i] == raw[i * indexRowSize + j]);
+    }
+    fclose(out);
+
+    //Blur and edges need real colours, so the palette is expanded to 24 bits for them
+    FILE *expandedStream = expandPalette(&inFile, &header);
+    assert(expandedStream != NULL);
+    BitmapFile expanded;
+    attachFile(&expanded, expandedStream, streamSize(expandedStream), false, false);
+    Byte expandedHeader[54];
+    ImageHeader expandedData;
+    parseHeader(readBytes(&expanded, 0, 54, expandedHeader), &expandedData);
+    assert(imageProblem(&expandedData) == NULL);
+    assert(expandedData.bitsPerPixel == 24 && expandedData.width == width && expandedData.height == height);
+    const long expandedRowSize = rowBytes(&expandedData);
+    Byte *colours = mallocCheck(height * expandedRowSize);
+    readBytes(&expanded, expandedData.pixelDataIndex, height * expandedRowSize, colours);
+    for (int i = 0; i < height; i++){
+        for (int j = 0; j < width; j++){
+            for (Byte k = 0; k < channels; k++) assert(colours[i * expandedRowSize + j * 3 + k] == table[raw[i * indexRowSize + j] * 4 + k]);
+        }
+    }
+    fclose(expandedStream);
+    fclose(in);
+    free(colours);
+    free(raw);
+    free(expected);
+    free(actual);
+}
+
+//Tests resize against resampling in floating point, and that the chain and the streamed bitmap get the new size
+void testResize(){
+    const int shapes[][4] = {{20, 30, 7, 11}, {5, 4, 13, 9}, {9, 40, 9, 5}, {1, 1, 3, 2}};
+    for (int n = 0; n < sizeof(shapes) / sizeof(shapes[0]); n++){
+        const int height = shapes[n][0];
+        const int width = shapes[n][1];
+        const int newHeight = shapes[n][2];
+        const int newWidth = shapes[n][3];
+        PixelBuffer original;
+        PixelBuffer pixels;
+        createBuffer(&original, height, width);
+        randomPixels(&original, n);
+        for (int filter = BoxFilter; filter <= LanczosFilter; filter++){
+            //The same size gives back the image, and a flat image stays flat at any size
+            createBuffer(&pixels, height, width);
+            copyPixels(&original, &pixels);
+            resizeTo(&pixels, height, width, filter);
+            for (Byte k = 0; k < channels; k++){
+                for (int i = 0; i < height; i++) assert(memcmp(planeRow(&original, k, i), planeRow(&pixels, k, i), width) == 0);
+                memset(pixels.planes[k], 200, pixels.stride * height);
+            }
+            resizeTo(&pixels, newHeight, newWidth, filter);
+            for (Byte k = 0; k < channels; k++){
+                for (int i = 0; i < newHeight; i++){
+                    for (int j = 0; j < newWidth; j++) assert(planeRow(&pixels, k, i)[j] == 200);
+                }
+            }
+            freeBuffer(&pixels);
+
+            //Rounding the weights and the rows between the passes only costs a level or two
+            createBuffer(&pixels, height, width);
+            copyPixels(&original, &pixels);
+            resizeTo(&pixels, newHeight, newWidth, filter);
+            assert(pixels.height == newHeight && pixels.width == newWidth);
+            const double scales[2] = {(double) height / newHeight, (double) width / newWidth};
+            for (Byte k = 0; k < channels; k++){
+                for (int i = 0; i < newHeight; i++){
+                    for (int j = 0; j < newWidth; j++){
+                        const int outputs[2] = {i, j};
+                        const int lengths[2] = {height, width};
+                        double weights[2][height > width ? height : width];
+                        for (int axis = 0; axis < 2; axis++){
+                            const double filterScale = scales[axis] > 1 ? scales[axis] : 1;
+                            const double centre = (outputs[axis] + 0.5) * scales[axis] - 0.5;
+                            const int reach = (int) ceil(filterSupport(filter) * filterScale) + 1;
+                            double total = 0;
+                            for (int x = 0; x < lengths[axis]; x++) weights[axis][x] = 0;
+                            for (int x = floor(centre) - reach; x <= ceil(centre) + reach; x++){
+                                const double value = filterValue(filter, (x - centre) / filterScale);
+                                weights[axis][clampIndex(x, lengths[axis])] += value;
+                                total += value;
+                            }
+                            for (int x = 0; x < lengths[axis]; x++) weights[axis][x] /= total;
+                        }
+                        //Like resize, the rows are clamped to a byte before the columns are resampled
+                        double sum = 0;
+                        for (int y = 0; y < height; y++){
+                            double rowSum = 0;
+                            for (int x = 0; x < width; x++) rowSum += weights[1][x] * planeRow(&original, k, y)[x];
+                            sum += weights[0][y] * (rowSum < 0 ? 0 : rowSum > 255 ? 255 : rowSum);
+                        }
+                        const double expected = sum < 0 ? 0 : sum > 255 ? 255 : sum;
+                        assert(fabs(planeRow(&pixels, k, i)[j] - expected) <= 2);
+                    }
+                }
+            }
+            freeBuffer(&pixels);
+        }
+        freeBuffer(&original);
+    }
+
+    //Halving with the box filter averages pairs of pixels along the rows and then pairs of those down the columns, rounding halves up
+    PixelBuffer original;
+    PixelBuffer pixels;
+    createBuffer(&original, 6, 10);
+    createBuffer(&pixels, 6, 10);
+    randomPixels(&original, 7);
+    copyPixels(&original, &pixels);
+    resizeTo(&pixels, 3, 5, BoxFilter);
+    for (Byte k = 0; k < channels; k++){
+        for (int i = 0; i < 3; i++){
+            for (int j = 0; j < 5; j++){
+                int rows[2];
+                for (int y = 0; y < 2; y++) rows[y] = (planeRow(&original, k, 2 * i + y)[2 * j] + planeRow(&original, k, 2 * i + y)[2 * j + 1] + 1) / 2;
+                assert(planeRow(&pixels, k, i)[j] == (rows[0] + rows[1] + 1) / 2);
+            }
+        }
+    }
+    freeBuffer(&pixels);
+    freeBuffer(&original);
+
+    //A shrink far beyond maxShrink is made in steps, so even a single pixel made from a tall column is still close to the average of the column
+    const int tallHeight = 20000;
+    createBuffer(&original, tallHeight, 1);
+    randomPixels(&original, 8);
+    for (int filter = BoxFilter; filter <= LanczosFilter; filter++){
+        createBuffer(&pixels, tallHeight, 1);
+        copyPixels(&original, &pixels);
+        resizeTo(&pixels, 1, 1, filter);
+        assert(pixels.height == 1 && pixels.width == 1);
+        for (Byte k = 0; k < channels; k++){
+            double total = 0;
+            for (int i = 0; i < tallHeight; i++) total += planeRow(&original, k, i)[0];
+            assert(fabs(planeRow(&pixels, k, 0)[0] - total / tallHeight) <= 1);
+        }
+        freeBuffer(&pixels);
+    }
+    freeBuffer(&original);
+
+    int width = 0;
+    int height = 0;
+    assert(parseSize("640x480", &width, &height) && width == 640 && height == 480);
+    assert(parseSize("100x0", &width, &height) && width == 100 && height == 0);
+    char *invalid[] = {"0x0", "640", "x480", "640x", "640x480x2", "-5x10", "640X480", "70000x10", " 640x480", "640x 480"};
+    for (int i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) assert(!parseSize(invalid[i], &width, &height));
+    char *args[] = {"image", "in.bmp", "out.bmp", "resize", "100x0", "resize", "0x30", "box", "invert"};
+    Effect effects[9];
+    assert(parseEffects(9, args, effects) == 3);
+    assert(effects[0].type == ResizeOp && effects[0].param == LanczosFilter && effects[0].width == 100 && effects[0].height == 0);
+    assert(effects[1].type == ResizeOp && effects[1].param == BoxFilter && effects[1].height == 30);
+    assert(effects[2].type == InvertOp);
+    height = 50;
+    width = 200;
+    resizeShape(&effects[0], &height, &width);
+    assert(height == 25 && width == 100);
+    resizeShape(&effects[1], &height, &width);
+    assert(height == 30 && width == 120);
+
+    //Streaming a chain with resizes between other effects gives the bitmap of running the chain over the whole image
+    Byte headerBytes[54];
+    ImageHeader header;
+    FILE *in = syntheticBitmap(23, 31, 32, headerBytes, &header);
+    Effect chain[] = {{BlurOp, 1}, {FlipXOp, 0}, {ResizeOp, BilinearFilter, NULL, NULL, 12, 0}, {InvertOp, 0}, {Rotate90Op, 0}, {ResizeOp, LanczosFilter, NULL, NULL, 0, 40}, {FlipYOp, 0}};
+    const int effectCount = sizeof(chain) / sizeof(chain[0]);
+    int outHeight;
+    int outWidth;
+    outputShape(&header, effectCount, chain, &outHeight, &outWidth);
+    assert(outHeight == 40 && outWidth == 30);
+    PixelBuffer image;
+    BitmapFile inFile;
+    attachFile(&inFile, in, streamSize(in), false, false);
+    loadImage(&inFile, &header, &image);
+    detachFile(&inFile);
+    effectsChain(&image, effectCount, chain);
+    ImageHeader shaped = header;
+    shaped.height = outHeight;
+    shaped.width = outWidth;
+    const long arraySize = outHeight * rowBytes(&shaped);
+    Byte *expected = mallocCheck(arraySize);
+    Byte *actual = mallocCheck(arraySize);
+    generateRawPixelArray(&image, expected, &shaped);
+    for (int useMapping = 0; useMapping <= 1; useMapping++){
+        FILE *out = streamSynthetic(in, &header, effectCount, chain, useMapping);
+        Byte outHeader[54];
+        ImageHeader outHeaderData;
+        rewind(out);
+        assert(fread(outHeader, sizeof(Byte), 54, out) == 54);
+        parseHeader(outHeader, &outHeaderData);
+        assert(outHeaderData.height == outHeight && outHeaderData.width == outWidth && outHeaderData.bitsPerPixel == 32);
+        fseek(out, header.pixelDataIndex, SEEK_SET);
+        assert(fread(actual, sizeof(Byte), arraySize, out) == arraySize);
+        assert(memcmp(expected, actual, arraySize) == 0);
+        fclose(out);
+    }
+    free(expected);
+    free(actual);
+    freeBuffer(&image);
+    fclose(in);
+}
+
+//Tests the histogram effects against tables worked out by hand, and that splitting them across threads or streaming them changes nothing
+void testHistogram(){
+    //Every value from 50 to 150 in equal numbers is stretched to 0 - 255 by both effects, and a flat channel is left alone
+    const int height = 101;
+    const int width = 7;
+    PixelBuffer pixels;
+    createBuffer(&pixels, height, width);
+    for (int type = AutoLevelsOp; type <= EqualizeOp; type++){
+        for (int i = 0; i < height; i++){
+            memset(planeRow(&pixels, 0, i), 50 + i, width);
+            memset(planeRow(&pixels, 1, i), 150 - i, width);
+            memset(planeRow(&pixels, 2, i), 77, width);
+        }
+        histogramEffect(&pixels, type);
+        for (int i = 0; i < height; i++){
+            for (int j = 0; j < width; j++){
+                assert(planeRow(&pixels, 0, i)[j] == (2 * 255 * i + 100) / 200);
+                assert(planeRow(&pixels, 1, i)[j] == (2 * 255 * (100 - i) + 100) / 200);
+                assert(planeRow(&pixels, 2, i)[j] == 77);
+            }
+        }
+    }
+    freeBuffer(&pixels);
+
+    //Autolevels ignores the odd pixel far outside the range of the others
+    long bins[256];
+    Byte table[256];
+    memset(bins, 0, sizeof(bins));
+    for (int v = 100; v <= 200; v++) bins[v] = 100;
+    bins[0] = bins[255] = 1;
+    levelsTable(bins, table);
+    assert(table[100] == 0 && table[150] == 128 && table[200] == 255 && table[99] == 0 && table[201] == 255);
+    equalizeTable(bins, table);
+    assert(table[0] == 0 && table[255] == 255);
+    for (int v = 1; v < 256; v++) assert(table[v] >= table[v - 1]);
+
+    //The tiles of each pass are shared between the threads, and the alpha plane of a 32 bit image is never touched
+    PixelBuffer original;
+    PixelBuffer correct;
+    createPlanes(&original, 67, 45, 4);
+    createPlanes(&correct, 67, 45, 4);
+    createPlanes(&pixels, 67, 45, 4);
+    randomPixels(&original, 5);
+    for (int i = 0; i < 67; i++) memset(planeRow(&original, 3, i), 9, 45);
+    for (int type = AutoLevelsOp; type <= EqualizeOp; type++){
+        copyPixels(&original, &correct);
+        histogramEffect(&correct, type);
+        for (int threadCount = 1; threadCount <= 4; threadCount++){
+            ThreadPool pool;
+            createPool(&pool, threadCount);
+            copyPixels(&original, &pixels);
+            runHistogramEffect(&pool, &pixels, type);
+            destroyPool(&pool);
+            for (int k = 0; k < 4; k++){
+                for (int i = 0; i < 67; i++) assert(memcmp(planeRow(&correct, k, i), planeRow(&pixels, k, i), 45) == 0);
+            }
+            for (int i = 0; i < 67; i++){
+                for (int j = 0; j < 45; j++) assert(planeRow(&pixels, 3, i)[j] == 9);
+            }
+        }
+    }
+    freeBuffer(&original);
+    freeBuffer(&correct);
+    freeBuffer(&pixels);
+
+    //A chain with histogram effects is streamed in bands, with a counting pass for each histogram effect
+    Byte headerBytes[54];
+    ImageHeader header;
+    FILE *in = syntheticBitmap(29, 13, 24, headerBytes, &header);
+    Effect effects[] = {{DarkenOp, 30}, {AutoLevelsOp, 0}, {BlurOp, 1}, {FlipXOp, 0}, {EqualizeOp, 0}, {InvertOp, 0}};
+    const int effectCount = sizeof(effects) / sizeof(effects[0]);
+    PixelBuffer image;
+    BitmapFile inFile;
+    attachFile(&inFile, in, streamSize(in), false, false);
+    loadImage(&inFile, &header, &image);
+    detachFile(&inFile);
+    effectsChain(&image, effectCount, effects);
+    const long arraySize = header.height * rowBytes(&header);
+    Byte *expected = mallocCheck(arraySize);
+    Byte *actual = mallocCheck(arraySize);
+    generateRawPixelArray(&image, expected, &header);
+    FILE *out = streamSynthetic(in, &header, effectCount, effects, true);
+    fseek(out, header.pixelDataIndex, SEEK_SET);
+    assert(fread(actual, sizeof(Byte), arraySize, out) == arraySize);
+    assert(memcmp(expected, actual, arraySize) == 0);
+    fclose(out);
+    fclose(in);
+    free(expected);
+    free(actual);
+    freeBuffer(&image);
+
+    //A palettized bitmap keeps its indices and has its colour table remapped, giving the colours of the expanded image
+    in = syntheticBitmap(31, 17, 8, headerBytes, &header);
+    Effect palettized[] = {{InvertOp, 0}, {AutoLevelsOp, 0}, {FlipXOp, 0}, {EqualizeOp, 0}};
+    const int palettizedCount = sizeof(palettized) / sizeof(palettized[0]);
+    attachFile(&inFile, in, streamSize(in), false, false);
+    FILE *expandedStream = expandPalette(&inFile, &header);
+    assert(expandedStream != NULL);
+    detachFile(&inFile);
+    Byte expandedHeader[54];
+    ImageHeader expandedData;
+    BitmapFile expanded;
+    attachFile(&expanded, expandedStream, streamSize(expandedStream), false, false);
+    parseHeader(readBytes(&expanded, 0, 54, expandedHeader), &expandedData);
+    loadImage(&expanded, &expandedData, &image);
+    detachFile(&expanded);
+    effectsChain(&image, palettizedCount, palettized);
+    const long expandedRowSize = rowBytes(&expandedData);
+    const long indexRowSize = rowBytes(&header);
+    expected = mallocCheck(header.height * expandedRowSize);
+    actual = mallocCheck(header.height * indexRowSize);
+    generateRawPixelArray(&image, expected, &expandedData);
+    out = streamSynthetic(in, &header, palettizedCount, palettized, false);
+    Byte colourTable[4 * 256];
+    fseek(out, header.paletteIndex, SEEK_SET);
+    assert(fread(colourTable, sizeof(Byte), sizeof(colourTable), out) == sizeof(colourTable));
+    fseek(out, header.pixelDataIndex, SEEK_SET);
+    assert(fread(actual, sizeof(Byte), header.height * indexRowSize, out) == header.height * indexRowSize);
+    for (int i = 0; i < header.height; i++){
+        for (int j = 0; j < header.width; j++){
+            for (Byte k = 0; k < channels; k++) assert(colourTable[actual[i * indexRowSize + j] * 4 + k] == expected[i * expandedRowSize + j * 3 + k]);
+        }
+    }
+    fclose(out);
+    fclose(expandedStream);
+    fclose(in);
+    free(expected);
+    free(actual);
+    freeBuffer(&image);
+}
+
+//Tests that a file processed onto itself, through the mapping and through stdio, ends up holding the same bitmap as a separate output
+//and that the temporary file it was written to is gone afterwards
+//Needs a scratch directory for the file, so only runs where mkdtemp is available
+void testInPlace(){
+#ifdef HAVE_TEMPORARY_FILES
+    char directory[] = "/tmp/imageInPlaceXXXXXX";
+    assert(mkdtemp(directory) != NULL);
+    char name[FILENAME_MAX];
+    snprintf(name, sizeof(name), "%s/image.bmp", directory);
+    Effect effects[] = {{BlurOp, 2}, {InvertOp, 0}};
+    const int effectCount = sizeof(effects) / sizeof(effects[0]);
+    Byte headerBytes[54];
+    ImageHeader header;
+    FILE *synthetic = syntheticBitmap(37, 21, 24, headerBytes, &header);
+    const long size = streamSize(synthetic);
+    Byte *original = mallocCheck(size);
+    Byte *expected = mallocCheck(size);
+    Byte *actual = mallocCheck(size);
+    rewind(synthetic);
+    assert(fread(original, sizeof(Byte), size, synthetic) == size);
+    FILE *correct = streamSynthetic(synthetic, &header, effectCount, effects, false);
+    rewind(correct);
+    assert(fread(expected, sizeof(Byte), size, correct) == size);
+    fclose(correct);
+    fclose(synthetic);
+
+    ThreadPool pool;
+    createPool(&pool, 2);
+    Workspace workspace;
+    createWorkspace(&workspace);
+    for (int mapped = 0; mapped <= 1; mapped++){
+        FILE *file = fopenCheck(name, "wb");
+        fwrite(original, sizeof(Byte), size, file);
+        fclose(file);
+        Options options = {5, false, 2, 0, false, mapped, 0, false, false, false};
+        const char *problem = NULL;
+        assert(processFile(name, name, effectCount, effects, &options, &pool, &workspace, &problem) == size && problem == NULL);
+        file = fopenCheck(name, "rb");
+        assert(streamSize(file) == size && fread(actual, sizeof(Byte), size, file) == size);
+        fclose(file);
+        assert(memcmp(expected, actual, size) == 0);
+        assert(remove(name) == 0);
+    }
+    freeWorkspace(&workspace);
+    destroyPool(&pool);
+    free(original);
+    free(expected);
+    free(actual);
+    //The directory can only be removed if no temporary file was left in it
+    assert(rmdir(directory) == 0);
+#endif
+}
+
+//Tests that a chain starting with a resize makes the missing mip levels on its first run and starts from the cached level after that
+//Needs a scratch directory for the cache, so only runs where mkdtemp is available
+void testMipCache(){
+#ifdef HAVE_TEMPORARY_FILES
+    char directory[] = "/tmp/imageMipsXXXXXX";
+    assert(mkdtemp(directory) != NULL);
+    char inName[FILENAME_MAX];
+    char outName[FILENAME_MAX];
+    char levelNames[3][FILENAME_MAX];
+    snprintf(inName, sizeof(inName), "%s/in.bmp", directory);
+    snprintf(outName, sizeof(outName), "%s/out.bmp", directory);
+    Byte headerBytes[54];
+    ImageHeader header;
+    FILE *synthetic = syntheticBitmap(50, 64, 24, headerBytes, &header);
+    const long size = streamSize(synthetic);
+    Byte *bytes = mallocCheck(size);
+    rewind(synthetic);
+    assert(fread(bytes, sizeof(Byte), size, synthetic) == size);
+    fclose(synthetic);
+    FILE *in = fopenCheck(inName, "wb");
+    fwrite(bytes, sizeof(Byte), size, in);
+    fclose(in);
+    free(bytes);
+
+    //A width of 10 keeps the aspect ratio at a height of 8, so level 2 (16 x 12) is the smallest level big enough
+    Effect effects[] = {{ResizeOp, BilinearFilter, NULL, NULL, 10, 0}, {InvertOp, 0}};
+    const int effectCount = sizeof(effects) / sizeof(effects[0]);
+    Options options = {0, false, 1, 0, false, true, 0, false, false, false, directory};
+    ThreadPool pool;
+    createPool(&pool, 1);
+    Workspace workspace;
+    createWorkspace(&workspace);
+    in = fopenCheck(inName, "rb");
+    BitmapFile inFile;
+    attachFile(&inFile, in, size, false, true);
+    const uint64_t hash = fileHash(&inFile);
+    for (int level = 1; level <= 3; level++) mipName(directory, hash, level, levelNames[level - 1], sizeof(levelNames[0]));
+    PixelBuffer pixels;
+    loadImage(&inFile, &header, &pixels);
+    resizeTo(&pixels, 25, 32, BoxFilter);
+    resizeTo(&pixels, 12, 16, BoxFilter);
+    resizeTo(&pixels, 8, 10, BilinearFilter);
+    invert(&pixels);
+    ImageHeader shaped = header;
+    shaped.height = 8;
+    shaped.width = 10;
+    const long arraySize = 8 * rowBytes(&shaped);
+    Byte *expected = mallocCheck(arraySize);
+    Byte *actual = mallocCheck(arraySize);
+    generateRawPixelArray(&pixels, expected, &shaped);
+
+    //The second run reads level 2 from the cache, and the third makes it again from level 1
+    for (int run = 0; run < 3; run++){
+        if (run == 2) assert(remove(levelNames[1]) == 0);
+        const char *problem;
+        assert(processFile(inName, outName, effectCount, effects, &options, &pool, &workspace, &problem) == size);
+        FILE *out = fopenCheck(outName, "rb");
+        fseek(out, header.pixelDataIndex, SEEK_SET);
+        assert(fread(actual, sizeof(Byte), arraySize, out) == arraySize);
+        assert(memcmp(expected, actual, arraySize) == 0);
+        fclose(out);
+        FILE *level = fopen(levelNames[2], "rb");
+        assert(level == NULL);
+        for (int l = 0; l < 2; l++){
+            level = fopenCheck(levelNames[l], "rb");
+            Byte levelHeader[54];
+            ImageHeader levelHeaderData;
+            assert(fread(levelHeader, sizeof(Byte), 54, level) == 54);
+            parseHeader(levelHeader, &levelHeaderData);
+            assert(levelHeaderData.height == 25 / (l + 1) && levelHeaderData.width == 32 / (l + 1));
+            fclose(level);
+        }
+    }
+
+    //A cached level is used as it is, which shows the input is no longer read
+    PixelBuffer flat;
+    createBuffer(&flat, 12, 16);
+    for (Byte k = 0; k < channels; k++) memset(flat.planes[k], 100, flat.stride * flat.height);
+    assert(writeBitmap(levelNames[1], &flat, &inFile, &header));
+    const char *problem;
+    processFile(inName, outName, effectCount, effects, &options, &pool, &workspace, &problem);
+    FILE *out = fopenCheck(outName, "rb");
+    fseek(out, header.pixelDataIndex, SEEK_SET);
+    assert(fread(actual, sizeof(Byte), arraySize, out) == arraySize);
+    for (int i = 0; i < 8; i++){
+        for (int j = 0; j < 10 * channels; j++) assert(actual[i * rowBytes(&shaped) + j] == 155);
+    }
+    fclose(out);
+
+    //A cache that can't be written to is the reason the file can't be processed, rather than the end of the program
+    char missing[FILENAME_MAX];
+    snprintf(missing, sizeof(missing), "%s/missing", directory);
+    options.mipCache = missing;
+    assert(processFile(inName, outName, effectCount, effects, &options, &pool, &workspace, &problem) == -1);
+    assert(strcmp(problem, "Can't write to the mip cache") == 0);
+
+    freeBuffer(&flat);
+    freeBuffer(&pixels);
+    free(expected);
+    free(actual);
+    detachFile(&inFile);
+    fclose(in);
+    freeWorkspace(&workspace);
+    destroyPool(&pool);
+    for (int l = 0; l < 2; l++) assert(remove(levelNames[l]) == 0);
+    assert(remove(inName) == 0 && remove(outName) == 0);
+    assert(rmdir(directory) == 0);
+#endif
+}
+
+//Tests that one workspace reused for images of different sizes gives the same bitmaps as processing each on its own
+//and that batch output files keep the name of their input
+void testBatch(){
+    const int sizes[][2] = {{9, 70}, {41, 17}, {20, 130}, {3, 5}};
+    const int imageCount = sizeof(sizes) / sizeof(sizes[0]);
+    Effect effects[] = {{BlurOp, 3}, {GreyscaleOp, 0}, {FlipYOp, 0}};
+    const int effectCount = sizeof(effects) / sizeof(effects[0]);
+    Options options = {4, false, 1, 0, false, true, 0, true, false, false};
+    ThreadPool pool;
+    createPool(&pool, 1);
+    Workspace workspace;
+    createWorkspace(&workspace);
+
+    for (int n = 0; n < imageCount; n++){
+        const int height = sizes[n][0];
+        const int width = sizes[n][1];
+        Byte headerBytes[54];
+        ImageHeader header;
+        FILE *in = syntheticBitmap(height, width, 24, headerBytes, &header);
+        const long rowSize = rowBytes(&header);
+        const long size = streamSize(in);
+        BitmapFile inFile;
+        attachFile(&inFile, in, size, false, false);
+
+        Byte *expected = mallocCheck(height * rowSize);
+        Byte *actual = mallocCheck(height * rowSize);
+        PixelBuffer pixels;
+        createBuffer(&pixels, height, width);
+        readBytes(&inFile, header.pixelDataIndex, height * rowSize, expected);
+        parseRawPixelArray(&pixels, expected, &header);
+        effectsChain(&pixels, effectCount, effects);
+        generateRawPixelArray(&pixels, expected, &header);
+
+        FILE *out = tmpfile();
+        assert(out != NULL);
+        BitmapFile outFile;
+        attachFile(&inFile, in, size, false, true);
+        attachFile(&outFile, out, size, true, true);
+        streamImage(&inFile, &outFile, &header, effectCount, effects, &options, &pool, &workspace);
+        detachFile(&outFile);
+        detachFile(&inFile);
+        fseek(out, header.pixelDataIndex, SEEK_SET);
+        assert(fread(actual, sizeof(Byte), height * rowSize, out) == height * rowSize);
+        assert(memcmp(expected, actual, height * rowSize) == 0);
+
+        fclose(out);
+        fclose(in);
+        freeBuffer(&pixels);
+        free(expected);
+        free(actual);
+    }
+    freeWorkspace(&workspace);
+    destroyPool(&pool);
+
+    char outName[64];
+    assert(batchOutputName("out", "images/duck.bmp", outName, sizeof(outName)) && strcmp(outName, "out/duck.bmp") == 0);
+    assert(batchOutputName("out/", "duck.bmp", outName, sizeof(outName)) && strcmp(outName, "out/duck.bmp") == 0);
+    assert(!batchOutputName("out", "duck.bmp", outName, 8));
+
+    //A batch of good and bad files on several workers processes the good ones and reports the others
+    //The last file has the same name as b.bmp in another directory, so only b.bmp is processed
+    //Needs scratch directories for the files, so only runs where mkdtemp is available
+#ifdef HAVE_TEMPORARY_FILES
+    char inDirectory[] = "/tmp/imageBatchInXXXXXX";
+    char outDirectory[] = "/tmp/imageBatchOutXXXXXX";
+    assert(mkdtemp(inDirectory) != NULL && mkdtemp(outDirectory) != NULL);
+    char subdirectory[FILENAME_MAX];
+    snprintf(subdirectory, sizeof(subdirectory), "%s/sub", inDirectory);
+    assert(mkdir(subdirectory, 0700) == 0);
+    const char *baseNames[] = {"a.bmp", "missing.bmp", "b.bmp", "text.bmp", "c.bmp", "short.bmp", "sub/b.bmp"};
+    const int fileCount = sizeof(baseNames) / sizeof(baseNames[0]);
+    char names[fileCount][FILENAME_MAX];
+    char *fileNames[fileCount];
+    long long goodBytes = 0;
+    for (int f = 0; f < fileCount; f++){
+        snprintf(names[f], sizeof(names[f]), "%s/%s", inDirectory, baseNames[f]);
+        fileNames[f] = names[f];
+        if (f == 1) continue;
+        //Widths that are a multiple of 4 leave no padding, so inverting changes every byte of the pixel array
+        Byte headerBytes[54];
+        ImageHeader header;
+        FILE *synthetic = syntheticBitmap(5 + f, 4 * (f + 1), 24, headerBytes, &header);
+        long size = streamSize(synthetic);
+        Byte *bytes = mallocCheck(size);
+        rewind(synthetic);
+        assert(fread(bytes, sizeof(Byte), size, synthetic) == size);
+        fclose(synthetic);
+        if (f == 3){
+            memcpy(bytes, "Not a bitmap", 12);
+            size = 12;
+        }
+        if (f == 5) size -= 1;
+        if (f % 2 == 0 && f < 6) goodBytes += size;
+        FILE *file = fopenCheck(names[f], "wb");
+        fwrite(bytes, sizeof(Byte), size, file);
+        fclose(file);
+        free(bytes);
+    }
+
+    Effect invertEffect[] = {{InvertOp, 0}};
+    Options batchOptions = {0, false, 3, 0, false, true, 0, true, false, false};
+    FILE *report = tmpfile();
+    assert(report != NULL);
+    Batch batch = {fileNames, fileCount, outDirectory, 1, invertEffect, &batchOptions, report, PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, NULL, NULL};
+    reportBatch(&batch, runBatch(&batch, batchOptions.threadCount));
+    assert(batch.failedCount == 4 && batch.totalBytes == goodBytes);
+
+    //Each failure is on a line of its own, in whatever order the workers met them, followed by the totals
+    char text[4096];
+    rewind(report);
+    const size_t length = fread(text, sizeof(char), sizeof(text) - 1, report);
+    text[length] = '\0';
+    fclose(report);
+    for (int f = 1; f < fileCount; f += f < 5 ? 2 : 1){
+        char line[FILENAME_MAX + 16];
+        snprintf(line, sizeof(line), "FAILED: %s: ", names[f]);
+        assert(strstr(text, line) != NULL);
+    }
+    assert(strstr(text, "sub/b.bmp: Another file in the batch has the same output name\n") != NULL);
+    char summary[FILENAME_MAX + 64];
+    snprintf(summary, sizeof(summary), "SUCCESS: 3 images -> %s\nFAILED: 4 images\n", outDirectory);
+    assert(strstr(text, summary) != NULL && strstr(text, " images/s, ") != NULL && strstr(text, " MB/s\n") != NULL);
+
+    for (int f = 0; f < 6; f += 2){
+        FILE *in = fopenCheck(names[f], "rb");
+        assert(batchOutputName(outDirectory, names[f], outName, sizeof(outName)));
+        FILE *out = fopenCheck(outName, "rb");
+        const long size = streamSize(in);
+        assert(streamSize(out) == size);
+        for (long i = 0; i < size; i++) assert(fgetc(out) == (i < 54 ? fgetc(in) : 255 - fgetc(in)));
+        fclose(in);
+        fclose(out);
+        assert(remove(outName) == 0);
+    }
+    for (int f = 0; f < fileCount; f++) assert(f == 1 || remove(names[f]) == 0);
+    assert(rmdir(subdirectory) == 0 && rmdir(inDirectory) == 0 && rmdir(outDirectory) == 0);
+#endif
+}
+
+//Tests that the plan fuses only per-pixel effects and gives the same image as running the effects one by one
+void testPlan(){
+    Effect effects[] = {{GreyscaleOp, 0}, {InvertOp, 0}, {DarkenOp, 40}, {BrightenOp, 10}, {BlurOp, 1}, {InvertOp, 0}, {EdgesOp, 0}, {FlipYOp, 0}, {BrightenOp, 20}};
+    const int effectCount = sizeof(effects) / sizeof(effects[0]);
+    Stage stages[effectCount];
+    assert(compilePlan(effectCount, effects, stages) == 6);
+    assert(stages[0].fused && stages[0].first == 0 && stages[0].count == 4);
+    assert(!stages[1].fused && stages[1].first == 4);
+    assert(stages[2].fused && stages[2].count == 1);
+    assert(!stages[3].fused && !stages[4].fused);
+    assert(stages[5].fused && stages[5].first == 8);
+
+    //Tall enough that blur and edges are split into several tiles with halos
+    const int height = 67;
+    const int width = 11;
+    PixelBuffer original;
+    PixelBuffer correct;
+    PixelBuffer pixels;
+    createBuffer(&original, height, width);
+    createBuffer(&correct, height, width);
+    createBuffer(&pixels, height, width);
+    randomPixels(&original, 1);
+    copyPixels(&original, &correct);
+    effectsChain(&correct, effectCount, effects);
+    Byte correctPixels[height][width][channels];
+    Byte testPixels[height][width][channels];
+    storePixels(&correct, height, width, correctPixels);
+    for (int threadCount = 1; threadCount <= 4; threadCount++){
+        ThreadPool pool;
+        createPool(&pool, threadCount);
+        copyPixels(&original, &pixels);
+        runPlan(&pool, &pixels, 6, stages, effects);
+        for (int i = 0; i < height; i++){
+            for (int j = 0; j < width; j++){
+                for (Byte k = 0; k < channels; k++) testPixels[i][j][k] = planeRow(&pixels, k, i)[j];
+            }
+        }
+        assert(checkPixels(height, width, correctPixels, testPixels));
+        destroyPool(&pool);
+    }
+    freeBuffer(&original);
+    freeBuffer(&pixels);
+}
+
 //MANAGEMENT FUNCTIONS
 
 //Calls all tests
@@ -517,13 +5347,42 @@ void testAll(){
     testBrighten();
     testInvert();
     testBlur();
+    testPixelBuffer();
+    testBlurKernel();
+    testConvolution();
+    testKernels();
+    testEdges();
+    testTone();
+    testOrientation();
+    testStreaming();
+    testTurnStreaming();
+    testFormats();
+    testResize();
+    testMipCache();
+    testInPlace();
+    testHistogram();
+    testBatch();
+    testPlan();
     printf("All tests passed.\n");
 }
 
 //Entry point to the program
 int main(int argNum, char *args[argNum]){
     setbuf(stdout,NULL);
-    if (argNum > 1) proccessImage(argNum, args);
+    selectKernels();
+    initialiseEdgeTable();
+    if (argNum > 1) {
+        Options options;
+        int first = parseOptions(argNum, args, &options);
+        //Drop the options so the file names and effects keep their usual positions
+        if (options.benchmarkThreads > 0) benchmarkThreads(options.benchmarkThreads);
+        else if (options.benchmarkEdges) benchmarkEdges();
+        else if (options.benchmarkIO > 0) benchmarkIO(options.benchmarkIO);
+        else if (options.benchmarkTone) benchmarkTone();
+        else if (options.benchmarkSuite) benchmarkSuite(&options);
+        else if (options.batch) processBatch(argNum - first + 1, args + first - 1, &options);
+        else proccessImage(argNum - first + 1, args + first - 1, &options);
+    }
     else testAll();
     return 0;
 }
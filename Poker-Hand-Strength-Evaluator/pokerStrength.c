@@ -1,7 +1,20 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
 
 //Card structure definition
 struct card{
@@ -12,14 +25,10 @@ struct card{
 //Define stuct card synonym
 typedef struct card Card;
 
-//Rank structure definition
-struct rank{
-    int type;
-    int cardValue;
-};
-
-//Define struct card synonym
-typedef struct rank Rank;
+//Strength of a hand, which decides any showdown with a single integer comparison
+//The hand rank is in bits 20 - 23, followed by the card values that break ties, 4 bits each, most important first
+//e.g. a full house of 3s over 9s is FullHouse << 20 | 3 << 16 | 9 << 12
+typedef uint32_t Strength;
 
 //Define hand rank constants
 enum {HighCard=1, Pair=2, TwoPair=3, ThreeOfAKind=4, Straight=5, Flush=6, FullHouse=7, FourOfAKind=8, StraightFlush=9};
@@ -30,6 +39,71 @@ enum {J=11, Q=12, K=13, A=14};
 const int binSize = 15;
 const char suits[] = {'H','S','C','D'};
 
+//Set of cards as a 64 bit bitboard, with bit 16 * suit + value - 2 set for each card
+//Each suit's cards are a 13 bit mask of its values, so flushes and straights are found with masks and bit counts
+typedef uint64_t CardSet;
+
+enum {SuitBits = 16, ValueMask = 0x1FFF};
+
+//Number of cards in a set
+int setSize(CardSet set){
+    return __builtin_popcountll(set);
+}
+
+//Mask of the values (bit value - 2) of the cards of one suit in a set
+unsigned suitValues(CardSet set, int suit){
+    return (set >> (SuitBits * suit)) & ValueMask;
+}
+
+//Mask of the values of every card in a set, whatever the suit
+unsigned setValues(CardSet set){
+    return (set | set >> SuitBits | set >> (2 * SuitBits) | set >> (3 * SuitBits)) & ValueMask;
+}
+
+//Bit of a card's index (0 - 51, 13 values for each suit in the order of suits[])
+CardSet indexBit(int index){
+    return 1ULL << (SuitBits * (index / 13) + index % 13);
+}
+
+//Set of all 52 cards
+CardSet fullDeckSet(){
+    const CardSet suit = ValueMask;
+    return suit | suit << SuitBits | suit << (2 * SuitBits) | suit << (3 * SuitBits);
+}
+
+//Index of the lowest card in a non-empty set
+int lowestIndex(CardSet set){
+    const int bit = __builtin_ctzll(set);
+    return (bit / SuitBits) * 13 + bit % SuitBits;
+}
+
+//Key of each card value (2 -> Ace) in the sum that identifies the values of a 7 card hand
+//The sum of 7 keys, with no value used more than 4 times, is different for every possible set of values
+const uint32_t valueKeys[13] = {0, 1, 5, 22, 98, 453, 2031, 8698, 22854, 83661, 262349, 636345, 1479181};
+
+//The low 32 bits of a hand key are the sum of the value keys of its cards
+//Above them each suit has 4 bits counting its cards, starting at 3 so the top bit is set once a suit has 5 cards (a flush)
+const uint64_t flushBias = 0x3333ULL << 32;
+const uint64_t flushMask = 0x8888ULL << 32;
+
+//Value key sums are split into rows of 1 << KeyColumnBits sums, which are overlapped in one table by row displacement
+enum {KeyColumnBits = 10, MaxValueKey = 7825759};
+
+//Lookup tables of the 7 card evaluator, built by initialiseEvaluator
+//%cardBits% is the bit of each card in a CardSet
+struct Evaluator{
+    bool ready;
+    uint64_t cardKeys[52];
+    CardSet cardBits[52];
+    Strength flushRanks[1 << 13];
+    uint32_t rowOffsets[(MaxValueKey >> KeyColumnBits) + 1];
+    Strength *valueRanks;
+};
+
+typedef struct Evaluator Evaluator;
+
+Evaluator evaluator = {false};
+
 
 //Display the contents of the deck
 void printDeck(int size, Card deck[]) {
@@ -41,12 +115,72 @@ void printDeck(int size, Card deck[]) {
 }
 
 //Add one to the permutation pointers
+//Finds the last pointer that can still move up, moves it up one, and puts the pointers after it straight after it
 void incrementPointers(int pointers[], int current, int topValue){
-    if (pointers[current] < topValue - 1) {
-        pointers[current] += 1;
-    } else {
-        incrementPointers(pointers, current - 1, pointers[current]);
-        pointers[current] = pointers[current - 1] + 1;
+    int i = current;
+    while (i > 0 && pointers[i] == topValue - 1 - (current - i)) i--;
+    pointers[i]++;
+    for (int j = i + 1; j <= current; j++) pointers[j] = pointers[j - 1] + 1;
+}
+
+//COMBINATIONS
+//A combination of k items from n is also held as a mask of k of the low n bits
+//Masks of the same size are enumerated in increasing order, which is colexicographic order, and numbered in that order by rank
+
+//Number of ways of choosing k items from n, for n and k up to 52
+long long binomials[53][53];
+bool binomialsReady = false;
+
+//Fills the binomial table with Pascal's triangle
+void initialiseBinomials(){
+    if (binomialsReady) return;
+    for (int n = 0; n <= 52; n++){
+        binomials[n][0] = 1;
+        for (int k = 1; k <= n; k++) binomials[n][k] = binomials[n - 1][k - 1] + (k < n ? binomials[n - 1][k] : 0);
+    }
+    binomialsReady = true;
+}
+
+//Next mask with the same number of bits, by Gosper's hack
+//The lowest run of set bits moves its top bit up one, and the rest of the run drops to the bottom
+uint64_t nextCombination(uint64_t combination){
+    const uint64_t lowest = combination & -combination;
+    const uint64_t ripple = combination + lowest;
+    return ripple | ((combination ^ ripple) >> (2 + __builtin_ctzll(combination)));
+}
+
+//Position of a combination in increasing order among the combinations of the same size (its colexicographic rank)
+//The item in position i (counting from 0 in increasing order) at index c adds the number of ways of choosing i + 1 items from c
+long long rankCombination(uint64_t combination){
+    initialiseBinomials();
+    long long rank = 0;
+    for (int i = 1; combination != 0; i++){
+        rank += binomials[__builtin_ctzll(combination)][i];
+        combination &= combination - 1;
+    }
+    return rank;
+}
+
+//Combination of %size% items with a given rank, the inverse of rankCombination
+//Picks the items from the highest down, each the highest index whose count of choices doesn't exceed what's left of the rank
+uint64_t unrankCombination(long long rank, int size){
+    initialiseBinomials();
+    uint64_t combination = 0;
+    int index = 52;
+    for (int i = size; i >= 1; i--){
+        while (binomials[index][i] > rank) index--;
+        combination |= 1ULL << index;
+        rank -= binomials[index][i];
+        index--;
+    }
+    return combination;
+}
+
+//Writes the indices of a combination's items into %pointers%, in increasing order
+void combinationPointers(uint64_t combination, int pointers[]){
+    for (int i = 0; combination != 0; i++){
+        pointers[i] = __builtin_ctzll(combination);
+        combination &= combination - 1;
     }
 }
 
@@ -63,23 +197,27 @@ void initialiseDeck(int size, Card deck[]){
     }
 }
 
-//Checks if any of the cards to remove match the ith card in the deck
-bool isCardFound(Card deck[], Card toRemove[], int removeLength, int i){
-    bool cardFound = false;
-    for (int j = 0; j < removeLength; j++){
-        if (deck[i].value == toRemove[j].value && deck[i].suit == toRemove[j].suit){
-            cardFound = true;
-            break;
-        }
-    }
-    return cardFound;
+//Bit of a card
+CardSet cardBit(Card card){
+    int suit = 0;
+    while (suits[suit] != card.suit) suit++;
+    return 1ULL << (SuitBits * suit + card.value - 2);
+}
+
+//Set of the cards in an array
+CardSet cardsToSet(int size, Card cards[size]){
+    CardSet set = 0;
+    for (int i = 0; i < size; i++) set |= cardBit(cards[i]);
+    return set;
 }
 
 //Removes all the cards in an array from a source array
+//The cards to remove are made into a set first, so each card of the source is checked with a single mask
 void removeCardsFromDeck(int removeLength, Card toRemove[], int deckLength, Card sourceDeck[], Card newDeck[]){
+    const CardSet removed = cardsToSet(removeLength, toRemove);
     int cardsFound = 0;
     for (int i = 0; i < deckLength; i++){
-        if (isCardFound(sourceDeck, toRemove, removeLength, i)) cardsFound++;
+        if (removed & cardBit(sourceDeck[i])) cardsFound++;
         else newDeck[i-cardsFound] = sourceDeck[i];
     }
 }
@@ -97,117 +235,88 @@ void createBins(Card hand[5], int bins[binSize]){
     for (int i = 0; i < handSize; i++) bins[hand[i].value] += 1;
 }
 
-//Uses values from binAnalysis() to obtain the greatest rank for the hand
-//Detects high card, pair, 2 pair, 3 of a kind, full house and 4 of a kind
-Rank classifyBinRank(Rank binRank, int maxSize, int numOfLargeBins, int pairMax, int highCardValue){
-    if (maxSize == 4) binRank.type = FourOfAKind;
-    else if ((maxSize == 3) && (numOfLargeBins == 2)) binRank.type = FullHouse;
-    else if (maxSize == 3) binRank.type = ThreeOfAKind;
-    else if (numOfLargeBins == 2) {
-        binRank.type = TwoPair;
-        binRank.cardValue = pairMax;
-    }
-    else if (maxSize == 2) binRank.type = Pair;
-    else if (maxSize == 1) {
-        binRank.type = HighCard;
-        binRank.cardValue = highCardValue;
-    }
-    return binRank;
+//Builds a strength from the hand rank and up to 5 card values in order of importance
+Strength makeStrength(int type, int valueCount, const int values[]){
+    Strength strength = type;
+    for (int i = 0; i < 5; i++) strength = strength << 4 | (i < valueCount ? values[i] : 0);
+    return strength;
 }
 
-//Iterates through values in bins generating useful values for determining the best rank of the hand
-Rank binAnalysis(Card hand[5], int bins[binSize]){
-    Rank binRank;
-    int maxSize = 0;
-    int numOfLargeBins = 0;
-    int pairMax = 0;
-    int highCardValue = 0;
-
-    for (int i = binSize - 1; i >= 0; i--){
-        if (maxSize < bins[i]){
-            maxSize = bins[i];
-            binRank.cardValue = i;
-        }
-        if (bins[i] >= 2) {
-            numOfLargeBins++;
-            if (i > pairMax) pairMax = i;
-        }
-        if ((highCardValue == 0) && (bins[i] != 0)) highCardValue = i;
-    }
-
-    binRank = classifyBinRank(binRank, maxSize, numOfLargeBins, pairMax, highCardValue);
+//Hand rank of a strength
+int strengthType(Strength strength){
+    return strength >> 20;
+}
 
-    return binRank;
+//The card value in position %i% of a strength's tie breakers, 0 being the most important
+//e.g. the value of the pair, the top card of a straight or the highest card of a flush
+int strengthCardValue(Strength strength, int i){
+    return (strength >> (16 - 4 * i)) & 15;
 }
 
-//Checks if a flush is present in the hand
-Rank checkFlush(Card hand[5]){
-    Rank flushRank = {Flush, hand[0].value};
-    for (int i = 1; i < 5; i++){
-        if (hand[i].suit == hand[0].suit){
-            if (hand[i].value > flushRank.cardValue) flushRank.cardValue = hand[i].value;
-        } else {
-            flushRank.type = 0;
-            break;
+//Lists the values in the hand in order of importance: values with the most cards first, then higher values first
+//Returns the number of different values
+int groupValues(int bins[binSize], int values[5]){
+    int valueCount = 0;
+    for (int size = 4; size >= 1; size--){
+        for (int i = binSize - 1; i >= 2; i--){
+            if (bins[i] == size) values[valueCount++] = i;
         }
     }
-    return flushRank;
+    return valueCount;
 }
 
-//Checks if a straight is present in the hand
-Rank checkStraight(int bins[binSize]){
-    Rank straightRank = {0, 0};
-    int upperBound;
-    int lowerBound;
-
-    for (upperBound = binSize - 1; bins[upperBound] == 0; upperBound--){}
-    for (lowerBound = 2; bins[lowerBound] == 0; lowerBound++){}
+//Uses the grouped values to obtain the rank for the hand
+//Detects high card, pair, 2 pair, 3 of a kind, full house and 4 of a kind
+int classifyGroups(int bins[binSize], int values[5]){
+    const int maxSize = bins[values[0]];
+    const int nextSize = bins[values[1]];
+    int type = HighCard;
+    if (maxSize == 4) type = FourOfAKind;
+    else if ((maxSize == 3) && (nextSize == 2)) type = FullHouse;
+    else if (maxSize == 3) type = ThreeOfAKind;
+    else if ((maxSize == 2) && (nextSize == 2)) type = TwoPair;
+    else if (maxSize == 2) type = Pair;
+    return type;
+}
 
-    if ((upperBound - lowerBound) == 4){
-        straightRank.type = Straight;
-        straightRank.cardValue = upperBound;
+//Checks if a flush is present in the hand: all 5 cards in one suit's mask
+bool checkFlush(CardSet hand){
+    for (int suit = 0; suit < 4; suit++){
+        if (__builtin_popcount(suitValues(hand, suit)) == 5) return true;
     }
-
-    return straightRank;
+    return false;
 }
 
-//Determines which of 2 ranks is better (or if they tie)
-int compareRanks(Rank rank1, Rank rank2){
-    int bestRank;
-    if (rank1.type > rank2.type) bestRank = 1;
-    else if (rank1.type < rank2.type) bestRank = 2;
-    else {
-        if (rank1.cardValue > rank2.cardValue) bestRank = 1;
-        else if (rank1.cardValue < rank2.cardValue) bestRank = 2;
-        else bestRank = 0;
-    }
-    return bestRank;
+//Checks if a straight is present in a mask of 5 different values
+//Returns the top card of the straight, or 0 if there isn't one
+//Aces count low in A 2 3 4 5, which is a straight to the 5
+int checkStraight(unsigned values){
+    const unsigned wheel = 0x100F;
+    if (__builtin_popcount(values) != 5) return 0;
+    const int lowest = __builtin_ctz(values);
+    if (values >> lowest == 0x1F) return lowest + 6;
+    if (values == wheel) return 5;
+    return 0;
 }
 
-//Calcualtes the best rank and card values for the hand
-Rank bestRank(Card hand[5]){
+//Calcualtes the strength of the hand, including every card value needed to break ties
+Strength bestRank(Card hand[5]){
     int bins[binSize];
     createBins(hand, bins);
 
-    Rank finalRank;
-
-    Rank binRank = binAnalysis(hand, bins);
-    Rank flushRank = checkFlush(hand);
-
-    if (compareRanks(binRank, flushRank) == 1) finalRank = binRank;
-    else finalRank = flushRank;
+    int values[5];
+    const int valueCount = groupValues(bins, values);
+    int type = classifyGroups(bins, values);
 
-    if (binRank.type == HighCard){
-        Rank straightRank = checkStraight(bins);
-        if ((straightRank.type != 0) && (flushRank.type != 0)) {
-            finalRank.type = StraightFlush;
-            finalRank.cardValue = straightRank.cardValue;
-        } else {
-            if (compareRanks(straightRank, finalRank) == 1) finalRank = straightRank;
-        }
+    if (type == HighCard){
+        const CardSet set = cardsToSet(5, hand);
+        const int straightValue = checkStraight(setValues(set));
+        const bool flush = checkFlush(set);
+        if (straightValue != 0) return makeStrength(flush ? StraightFlush : Straight, 1, &straightValue);
+        if (flush) type = Flush;
     }
 
-    return finalRank;
+    return makeStrength(type, valueCount, values);
 }
 
 //Concatenate the contents of array2 to the end of array1 and save into outputArray
@@ -217,82 +326,1395 @@ void concatArray(Card outputArray[], int size1 ,Card array1[size1], int size2, C
 }
 
 //Calculates the best ranking card combination of the hole cards and the community cards
-Rank bestRankFromFullHand(Card sevenCardHand[7]){
+Strength bestRankFromFullHand(Card sevenCardHand[7]){
     const int fullHandSize = 7;
     const int playableHandSize = 5;
     int pointers[playableHandSize];
     initialisePointers(playableHandSize, pointers);
 
     Card fiveCardHand[playableHandSize];
-    Rank topRank = {0,0};
-    Rank tempRank;
+    Strength topRank = 0;
+    Strength tempRank;
 
-    while (pointers[0] < (fullHandSize - playableHandSize)){
+    //Known number of 5 card combinations from 7 cards
+    // 7 choose 5 = 21
+    const int cardCombinations = 21;
+    for (int i = 0; i < cardCombinations; i++){
         getHandFromPointers(fiveCardHand, playableHandSize, pointers, sevenCardHand);
         tempRank = bestRank(fiveCardHand);
-        if (compareRanks(tempRank,topRank) == 1) topRank = tempRank;
+        if (tempRank > topRank) topRank = tempRank;
 
-        incrementPointers(pointers, playableHandSize - 1, fullHandSize);
+        if (pointers[0] < (fullHandSize - playableHandSize)) incrementPointers(pointers, playableHandSize - 1, fullHandSize);
     }
     return topRank;
 }
 
+//TABLE DRIVEN EVALUATOR
+
+//Index (0 - 51) of a card, with 13 values for each suit in the order of suits[]
+int cardIndex(Card card){
+    int suit = 0;
+    while (suits[suit] != card.suit) suit++;
+    return suit * 13 + card.value - 2;
+}
+
+//Card of an index (0 - 51)
+Card indexCard(int index){
+    Card card = {2 + index % 13, suits[index / 13]};
+    return card;
+}
+
+//Fills the flush table with the best rank of the cards of a suit, for every mask of 5 to 7 values
+//Masks of 5 values are ranked by bestRank, and larger masks take the best rank of the masks with one value fewer
+void fillFlushRanks(){
+    for (int size = 5; size <= 7; size++){
+        for (unsigned mask = 0; mask < (1 << 13); mask++){
+            if (__builtin_popcount(mask) != size) continue;
+            if (size == 5){
+                Card hand[5];
+                int cardCount = 0;
+                for (int value = 0; value < 13; value++){
+                    if (mask & (1 << value)){
+                        Card card = {value + 2, suits[0]};
+                        hand[cardCount++] = card;
+                    }
+                }
+                evaluator.flushRanks[mask] = bestRank(hand);
+                continue;
+            }
+            Strength best = 0;
+            for (unsigned rest = mask; rest != 0; rest &= rest - 1){
+                Strength strength = evaluator.flushRanks[mask & ~(rest & -rest)];
+                if (strength > best) best = strength;
+            }
+            evaluator.flushRanks[mask] = best;
+        }
+    }
+}
+
+//Adds every set of 7 card values (no value more than 4 times) from %value% upwards to the list of keys and ranks
+//Each set is ranked by bestRankFromFullHand with the suits dealt in turn, which never gives 5 cards of one suit
+//Returns the new number of sets in the list
+int listValueSets(int value, int cardsLeft, Card hand[7], uint32_t key, uint32_t keys[], Strength ranks[], int setCount){
+    const int handSize = 7;
+    if (cardsLeft == 0){
+        for (int i = 0; i < handSize; i++) hand[i].suit = suits[i % 4];
+        keys[setCount] = key;
+        ranks[setCount] = bestRankFromFullHand(hand);
+        return setCount + 1;
+    }
+    if (value > A) return setCount;
+    for (int count = 0; count <= 4 && count <= cardsLeft; count++){
+        for (int i = 0; i < count; i++) hand[handSize - cardsLeft + i].value = value;
+        setCount = listValueSets(value + 1, cardsLeft - count, hand, key + count * valueKeys[value - 2], keys, ranks, setCount);
+    }
+    return setCount;
+}
+
+//Number of 64 bit words in a row of 1 << KeyColumnBits bits
+enum {RowWords = (1 << KeyColumnBits) / 64};
+
+//Checks whether the columns of a row all land on free slots when the row starts at %offset%
+//The slots are a bitset, so each word of the row's columns is tested against 64 slots at once
+bool rowFits(const uint64_t used[], const uint64_t columns[RowWords], int offset){
+    const int shift = offset & 63;
+    const uint64_t *slots = &used[offset >> 6];
+    for (int word = 0; word < RowWords; word++){
+        if (columns[word] == 0) continue;
+        uint64_t window = slots[word] >> shift;
+        if (shift != 0) window |= slots[word + 1] << (64 - shift);
+        if (window & columns[word]) return false;
+    }
+    return true;
+}
+
+//Stores the ranks of the value sets in a single table indexed by rowOffsets[key >> KeyColumnBits] + (key & columnMask)
+//Rows with the most sets are placed first, each at the first offset found where none of its sets land on one already placed
+void displaceRows(int setCount, uint32_t keys[], Strength ranks[]){
+    const int rowCount = (MaxValueKey >> KeyColumnBits) + 1;
+    const uint32_t columnMask = (1 << KeyColumnBits) - 1;
+    int *rowSizes = calloc(rowCount, sizeof(int));
+    uint64_t (*rowColumns)[RowWords] = calloc(rowCount, sizeof(uint64_t[RowWords]));
+    int *order = malloc(sizeof(int) * rowCount);
+    for (int i = 0; i < setCount; i++){
+        const int row = keys[i] >> KeyColumnBits;
+        const uint32_t column = keys[i] & columnMask;
+        rowSizes[row]++;
+        //No two sets of values may share a key
+        assert((rowColumns[row][column >> 6] >> (column & 63) & 1) == 0);
+        rowColumns[row][column >> 6] |= 1ULL << (column & 63);
+    }
+    for (int row = 0; row < rowCount; row++) order[row] = row;
+    //Insertion sort by size is quick enough, as most rows are the same handful of sizes
+    for (int i = 1; i < rowCount; i++){
+        int row = order[i];
+        int j = i;
+        for (; j > 0 && rowSizes[order[j - 1]] < rowSizes[row]; j--) order[j] = order[j - 1];
+        order[j] = row;
+    }
+
+    //A row always fits past the end of the rows placed before it, so no slot is beyond the rows' full width
+    const int maxTableSize = rowCount << KeyColumnBits;
+    uint64_t *used = calloc(maxTableSize / 64 + RowWords + 1, sizeof(uint64_t));
+    int tableSize = 0;
+    int firstFree = 0;
+    for (int n = 0; n < rowCount && rowSizes[order[n]] != 0; n++){
+        const int row = order[n];
+        int lowest = 0;
+        while ((rowColumns[row][lowest >> 6] >> (lowest & 63) & 1) == 0) lowest++;
+        int offset = firstFree > lowest ? firstFree - lowest : 0;
+        //Rows of the same size tend to clash in the same places, so the search carries on from the last one's offset
+        //This leaves the table about 5% larger than a full search, but builds it several times faster
+        if (n > 0 && rowSizes[order[n - 1]] == rowSizes[row] && evaluator.rowOffsets[order[n - 1]] > offset) offset = evaluator.rowOffsets[order[n - 1]];
+        while (!rowFits(used, rowColumns[row], offset)) offset++;
+        for (int column = 0; column <= columnMask; column++){
+            if ((rowColumns[row][column >> 6] >> (column & 63) & 1) == 0) continue;
+            const int slot = offset + column;
+            used[slot >> 6] |= 1ULL << (slot & 63);
+            if (slot + 1 > tableSize) tableSize = slot + 1;
+        }
+        while (used[firstFree >> 6] >> (firstFree & 63) & 1) firstFree++;
+        evaluator.rowOffsets[row] = offset;
+    }
+
+    //Rows without sets are never read, and keep offset 0
+    //Keys between the sets map to slots that are never read, so they are left as 0
+    evaluator.valueRanks = calloc(tableSize, sizeof(Strength));
+    for (int i = 0; i < setCount; i++){
+        evaluator.valueRanks[evaluator.rowOffsets[keys[i] >> KeyColumnBits] + (keys[i] & columnMask)] = ranks[i];
+    }
+    free(used);
+    free(order);
+    free(rowColumns);
+    free(rowSizes);
+}
+
+//Builds the evaluator tables on first use, ranking every flush and every set of values once with the original evaluator
+void initialiseEvaluator(){
+    if (evaluator.ready) return;
+    for (int index = 0; index < 52; index++){
+        const int suit = index / 13;
+        const int value = index % 13;
+        evaluator.cardKeys[index] = valueKeys[value] + (1ULL << (32 + 4 * suit));
+        evaluator.cardBits[index] = indexBit(index);
+    }
+    fillFlushRanks();
+
+    //There are 49205 sets of 7 values
+    const int maxSets = 49205;
+    uint32_t *keys = malloc(sizeof(uint32_t) * maxSets);
+    Strength *ranks = malloc(sizeof(Strength) * maxSets);
+    Card hand[7];
+    const int setCount = listValueSets(2, 7, hand, 0, keys, ranks, 0);
+    assert(setCount == maxSets);
+    displaceRows(setCount, keys, ranks);
+    free(keys);
+    free(ranks);
+    evaluator.ready = true;
+}
+
+//Ranks a 7 card hand from the sum of its card keys and the union of its card bits
+//With 5 or more cards of a suit no other card can make a better hand than the flush, so the rank comes from the suit's cards alone
+//Otherwise the suits don't matter and the rank is looked up from the sum of the value keys
+Strength rankFromKey(uint64_t key, CardSet bits){
+    const uint64_t flushes = (key & flushMask) >> 35;
+    if (flushes != 0){
+        const int suit = (flushes & 0x1) ? 0 : (flushes & 0x10) ? 1 : (flushes & 0x100) ? 2 : 3;
+        return evaluator.flushRanks[suitValues(bits, suit)];
+    }
+    const uint32_t valueKey = (uint32_t) key;
+    return evaluator.valueRanks[evaluator.rowOffsets[valueKey >> KeyColumnBits] + (valueKey & ((1 << KeyColumnBits) - 1))];
+}
+
+//Ranks 7 cards given by index, exactly as bestRankFromFullHand would
+Strength evaluateIndices(const int cards[7]){
+    uint64_t key = flushBias;
+    CardSet bits = 0;
+    for (int i = 0; i < 7; i++){
+        key += evaluator.cardKeys[cards[i]];
+        bits |= evaluator.cardBits[cards[i]];
+    }
+    return rankFromKey(key, bits);
+}
+
+//Cards dealt so far, summed into a hand key and card bits so that more cards can be added one at a time
+//The key holds the value counts (as the sum of value keys) and the suit counts, and the bits a mask of each suit's values
+struct BoardState{
+    uint64_t key;
+    CardSet bits;
+};
+
+typedef struct BoardState BoardState;
+
+//State of no cards
+BoardState emptyBoard(){
+    BoardState board = {flushBias, 0};
+    return board;
+}
+
+//State with one more card
+BoardState addToBoard(BoardState board, int card){
+    board.key += evaluator.cardKeys[card];
+    board.bits |= evaluator.cardBits[card];
+    return board;
+}
+
+//Ranks the 6 cards of a state with one more card, which completes a 7 card hand
+Strength rankWithCard(const BoardState *board, int card){
+    return rankFromKey(board->key + evaluator.cardKeys[card], board->bits | evaluator.cardBits[card]);
+}
+
+//Ranks a 5 card board with a pair of hole cards
+Strength rankHoleCards(const BoardState *board, int first, int second){
+    return rankFromKey(board->key + evaluator.cardKeys[first] + evaluator.cardKeys[second], board->bits | evaluator.cardBits[first] | evaluator.cardBits[second]);
+}
+
+//Calculates the best rank of the hole cards and the community cards with the evaluator tables
+//Gives the same rank as bestRankFromFullHand in a few table lookups
+Strength evaluateHand(Card sevenCardHand[7]){
+    initialiseEvaluator();
+    int cards[7];
+    for (int i = 0; i < 7; i++) cards[i] = cardIndex(sevenCardHand[i]);
+    return evaluateIndices(cards);
+}
+
+//Sorts items packed as strength << indexBits | index by strength, with a radix sort over the 24 bits of strength
+void sortByStrength(uint64_t items[], uint64_t spare[], int count, int indexBits){
+    for (int shift = indexBits; shift < indexBits + 24; shift += 8){
+        int counts[257] = {0};
+        for (int i = 0; i < count; i++) counts[((items[i] >> shift) & 255) + 1]++;
+        for (int i = 1; i < 257; i++) counts[i] += counts[i - 1];
+        for (int i = 0; i < count; i++) spare[counts[(items[i] >> shift) & 255]++] = items[i];
+        memcpy(items, spare, sizeof(uint64_t) * count);
+    }
+}
+
+//ENUMERATION
+//Exhaustive calculations number the cases they work through, such as each way of dealing the rest of the board by its combination's rank
+//The cases are cut into chunks and each thread starts with an equal run of chunks, which it works through from the front
+//A thread that finishes its run steals the back half of the longest run left, so chunks of uneven cost still finish together
+//Each thread adds its results into a tally of its own, and the tallies are merged in thread order once every thread is done
+
+enum {MaxThreads = 256, ChunksPerThread = 32, CacheLine = 64};
+
+//Chunks a thread has left to work through, from %next% up to %end%
+//Each run has its own lock and cache line, so a thread taking chunks from its own run doesn't hold up the others
+struct WorkRun{
+    _Alignas(CacheLine) pthread_mutex_t lock;
+    long long next;
+    long long end;
+};
+
+typedef struct WorkRun WorkRun;
+
+//Cases 0 to %caseCount% - 1 of a calculation, shared out in chunks of %chunkSize% cases
+//%visit% works through the cases from %first% up to %end%, adding its results to a thread's tally
+struct Enumeration{
+    long long caseCount;
+    long long chunkSize;
+    int threadCount;
+    WorkRun *runs;
+    char *tallies;
+    size_t tallyStride;
+    const void *context;
+    void (*visit)(const void *context, long long first, long long end, void *tally);
+};
+
+typedef struct Enumeration Enumeration;
+
+//A thread of an enumeration and the run it starts with
+struct EnumerationThread{
+    Enumeration *enumeration;
+    int index;
+};
+
+typedef struct EnumerationThread EnumerationThread;
+
+//Takes the next chunk from the front of a run, returning false if the run is empty
+bool takeChunk(WorkRun *run, long long *chunk){
+    pthread_mutex_lock(&run->lock);
+    const bool taken = run->next < run->end;
+    if (taken) *chunk = run->next++;
+    pthread_mutex_unlock(&run->lock);
+    return taken;
+}
+
+//Moves the back half of the longest other run into the thief's own run, returning false once every other run is empty
+//Only one lock is held at a time; chunks being moved are in neither run, but the thief moving them always works through them
+bool stealChunks(Enumeration *enumeration, int thief){
+    int victim = -1;
+    long long most = 0;
+    for (int i = 0; i < enumeration->threadCount; i++){
+        if (i == thief) continue;
+        WorkRun *run = &enumeration->runs[i];
+        pthread_mutex_lock(&run->lock);
+        const long long left = run->end - run->next;
+        pthread_mutex_unlock(&run->lock);
+        if (left > most){
+            most = left;
+            victim = i;
+        }
+    }
+    if (victim == -1) return false;
+
+    WorkRun *run = &enumeration->runs[victim];
+    pthread_mutex_lock(&run->lock);
+    const long long half = (run->end - run->next + 1) / 2;
+    const long long end = run->end;
+    run->end -= half;
+    pthread_mutex_unlock(&run->lock);
+
+    //The victim may have emptied its run since it was chosen, in which case the thief looks again
+    run = &enumeration->runs[thief];
+    pthread_mutex_lock(&run->lock);
+    run->next = end - half;
+    run->end = end;
+    pthread_mutex_unlock(&run->lock);
+    return true;
+}
+
+//Worker thread of an enumeration: works through chunks from its own run, then from others' until there are none left
+void *enumerationWorker(void *data){
+    const EnumerationThread *thread = data;
+    Enumeration *enumeration = thread->enumeration;
+    WorkRun *run = &enumeration->runs[thread->index];
+    void *tally = enumeration->tallies + thread->index * enumeration->tallyStride;
+    while (true){
+        long long chunk;
+        if (!takeChunk(run, &chunk)){
+            if (stealChunks(enumeration, thread->index)) continue;
+            break;
+        }
+        const long long first = chunk * enumeration->chunkSize;
+        const long long end = first + enumeration->chunkSize < enumeration->caseCount ? first + enumeration->chunkSize : enumeration->caseCount;
+        enumeration->visit(enumeration->context, first, end, tally);
+    }
+    return NULL;
+}
+
+//Works through cases 0 to %caseCount% - 1 with %visit%, on %threadCount% threads, the calling thread being one of them
+//Each thread's tally of %tallySize% bytes starts zeroed, and once every thread is done %merge% adds each tally in turn to %result%
+//Tallies only hold counts, so the result doesn't depend on the number of threads or on how the chunks were shared out
+void enumerate(long long caseCount, int threadCount, const void *context, void (*visit)(const void *context, long long first, long long end, void *tally),
+                    size_t tallySize, void *result, void (*merge)(void *result, const void *tally)){
+    if (threadCount < 1) threadCount = 1;
+    if (threadCount > MaxThreads) threadCount = MaxThreads;
+    Enumeration enumeration = {caseCount, 1, threadCount};
+    enumeration.context = context;
+    enumeration.visit = visit;
+
+    long long chunkCount = (long long) threadCount * ChunksPerThread;
+    if (chunkCount > caseCount) chunkCount = caseCount;
+    if (chunkCount > 0){
+        enumeration.chunkSize = (caseCount + chunkCount - 1) / chunkCount;
+        chunkCount = (caseCount + enumeration.chunkSize - 1) / enumeration.chunkSize;
+    }
+
+    //Tallies are padded to whole cache lines, so that threads never write to the same line
+    enumeration.tallyStride = (tallySize + CacheLine - 1) / CacheLine * CacheLine;
+    enumeration.tallies = aligned_alloc(CacheLine, enumeration.tallyStride * threadCount);
+    memset(enumeration.tallies, 0, enumeration.tallyStride * threadCount);
+    enumeration.runs = aligned_alloc(CacheLine, sizeof(WorkRun) * threadCount);
+    EnumerationThread workers[threadCount];
+    for (int i = 0; i < threadCount; i++){
+        WorkRun *run = &enumeration.runs[i];
+        pthread_mutex_init(&run->lock, NULL);
+        run->next = chunkCount * i / threadCount;
+        run->end = chunkCount * (i + 1) / threadCount;
+        workers[i] = (EnumerationThread) {&enumeration, i};
+    }
+
+    //If a thread can't be started, its run is stolen by the others
+    pthread_t threads[threadCount];
+    int started = 1;
+    for (; started < threadCount; started++){
+        if (pthread_create(&threads[started], NULL, enumerationWorker, &workers[started]) != 0) break;
+    }
+    enumerationWorker(&workers[0]);
+    for (int i = 1; i < started; i++) pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < threadCount; i++){
+        merge(result, enumeration.tallies + i * enumeration.tallyStride);
+        pthread_mutex_destroy(&enumeration.runs[i].lock);
+    }
+    free(enumeration.runs);
+    free(enumeration.tallies);
+}
+
+//EQUITY
+
+//Number of showdowns the player wins, ties and plays in total
+struct Equity{
+    long long wins;
+    long long ties;
+    long long trials;
+};
+
+typedef struct Equity Equity;
+
+//Known cards of an equity calculation and the deck still to be dealt from
+//Each way of dealing the rest of the board is a case of the enumeration, numbered by the rank of its positions in %deck%
+struct EquityJob{
+    BoardState player;
+    BoardState board;
+    CardSet unknown;
+    int deck[50];
+    int deckSize;
+    int missingCards;
+};
+
+typedef struct EquityJob EquityJob;
+
 //Displays the hand's strength as the percentage of possible hands it beats
-void displayResult(float numberOfWins, float numberOfTrials, float numberOfTies){
-    float winRate = (numberOfWins / numberOfTrials) * 100;
-    float tieRate = (numberOfTies / numberOfTrials) * 100;
-    float lossRate = 100 - winRate - tieRate;
+void displayResult(double numberOfWins, double numberOfTrials, double numberOfTies){
+    double winRate = (numberOfWins / numberOfTrials) * 100;
+    double tieRate = (numberOfTies / numberOfTrials) * 100;
+    double lossRate = 100 - winRate - tieRate;
     printf("Win - %.2f%%\n", winRate);
     printf("Split Pot - %.2f%%\n", tieRate);
     printf("Loss - %.2f%%\n", lossRate);
 }
 
-//Iterates through all the potential hole cards other players may have
+//Iterates through all the potential hole cards other players may have, given a complete board
 //For each potential opposing hand -> determines whether the player would win, lose, or tie (same strength hand)
-void checkAllOpponentHands(Card deck[], Card potCards[], Rank playerRank){
-    const int deckLength = 45;
-    const int numOfOpponentCards = 2;
-    int pointers[numOfOpponentCards];
-    initialisePointers(numOfOpponentCards, pointers);
+//The board's cards are added up once, then each opponent's first card once for all of their second cards
+void checkAllOpponentHands(const EquityJob *job, CardSet dealt, const BoardState *board, Strength playerRank, Equity *equity){
+    int deck[50];
+    int deckLength = 0;
+    for (CardSet rest = job->unknown & ~dealt; rest != 0; rest &= rest - 1) deck[deckLength++] = lowestIndex(rest);
+
+    long long playerWins = 0;
+    long long ties = 0;
+    for (int i = 0; i < deckLength - 1; i++){
+        const BoardState withFirst = addToBoard(*board, deck[i]);
+        for (int j = i + 1; j < deckLength; j++){
+            const Strength opponentRank = rankWithCard(&withFirst, deck[j]);
+            playerWins += playerRank > opponentRank;
+            ties += playerRank == opponentRank;
+        }
+    }
+    equity->wins += playerWins;
+    equity->ties += ties;
+    equity->trials += deckLength * (deckLength - 1) / 2;
+}
 
-    Rank opponentRank;
-    Card opponentCards[numOfOpponentCards];
-    Card opponentFullHand[7];
+//Plays the runouts numbered %first% up to %end% against every opponent
+//The player's state holds its hole cards as well as the board
+void equityChunk(const void *context, long long first, long long end, void *tally){
+    const EquityJob *job = context;
+    uint64_t positions = unrankCombination(first, job->missingCards);
+    for (long long runout = first; runout < end; runout++){
+        BoardState player = job->player;
+        BoardState board = job->board;
+        CardSet dealt = 0;
+        for (uint64_t rest = positions; rest != 0; rest &= rest - 1){
+            const int card = job->deck[__builtin_ctzll(rest)];
+            player = addToBoard(player, card);
+            board = addToBoard(board, card);
+            dealt |= indexBit(card);
+        }
+        checkAllOpponentHands(job, dealt, &board, rankFromKey(player.key, player.bits), tally);
+        //With the whole board known the only runout is the empty one, which has no next combination
+        if (runout + 1 < end) positions = nextCombination(positions);
+    }
+}
 
-    int playerWins = 0;
-    int ties = 0;
+//Adds one thread's equity totals to the result's
+void mergeEquity(void *result, const void *tally){
+    Equity *total = result;
+    const Equity *equity = tally;
+    total->wins += equity->wins;
+    total->ties += equity->ties;
+    total->trials += equity->trials;
+}
 
-    //Known number of combinations of opposing hands
-    //45 * 44 = 990
-    // 45 choose 2 = 990
-    const int cardCombintions = 990;
-    for (int i = 0; i < cardCombintions; i++){
-        getHandFromPointers(opponentCards, numOfOpponentCards, pointers, deck);
-        concatArray(opponentFullHand, numOfOpponentCards, opponentCards, 5, potCards);
-        opponentRank = bestRankFromFullHand(opponentFullHand);
-        if (compareRanks(playerRank, opponentRank) == 1) playerWins++;
-        else if (compareRanks(playerRank, opponentRank) == 0) ties++;
-        if (pointers[0] < (deckLength - numOfOpponentCards)) incrementPointers(pointers, numOfOpponentCards - 1, deckLength);
+//Plays the hole cards against every opponent hole pair on every way of completing the board
+//%boardSize% is the number of known community cards: 0 (pre-flop), 3 (flop), 4 (turn) or 5 (river)
+//The runouts are shared between %threadCount% threads, the calling thread being one of them
+Equity calculateEquity(Card handCards[2], Card potCards[], int boardSize, int threadCount){
+    initialiseEvaluator();
+    initialiseBinomials();
+    EquityJob job = {emptyBoard(), emptyBoard()};
+    for (int i = 0; i < 2; i++) job.player = addToBoard(job.player, cardIndex(handCards[i]));
+    for (int i = 0; i < boardSize; i++){
+        const int card = cardIndex(potCards[i]);
+        job.player = addToBoard(job.player, card);
+        job.board = addToBoard(job.board, card);
     }
-    displayResult(playerWins, cardCombintions, ties);
+    //The player's state holds every known card, so its bits are the cards not left to deal
+    job.unknown = fullDeckSet() & ~job.player.bits;
+    for (CardSet rest = job.unknown; rest != 0; rest &= rest - 1) job.deck[job.deckSize++] = lowestIndex(rest);
+    job.missingCards = 5 - boardSize;
+
+    Equity total = {0, 0, 0};
+    enumerate(binomials[job.deckSize][job.missingCards], threadCount, &job, equityChunk, sizeof(Equity), &total, mergeEquity);
+    return total;
 }
 
-//Evaluates the strength of a player's hole cards given all 5 community cards
-void handStrength(Card handCards[2], Card potCards[5]){
-    const int fullHandSize = 7;
-    Card playerCards[fullHandSize];
+//Number of threads to calculate with: one for each processor
+int processorCount(){
+#if defined(__unix__) || defined(__APPLE__)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+#elif defined(_WIN32)
+    SYSTEM_INFO system;
+    GetSystemInfo(&system);
+    long count = system.dwNumberOfProcessors;
+#else
+    long count = 1;
+#endif
+    return count < 1 ? 1 : (int) count;
+}
 
-    concatArray(playerCards, 2, handCards, 5, potCards);
-    Rank playerRank = bestRankFromFullHand(playerCards);
+//Evaluates the strength of a player's hole cards given the community cards known so far
+void handStrength(Card handCards[2], Card potCards[], int boardSize){
+    Equity equity = calculateEquity(handCards, potCards, boardSize, processorCount());
+    displayResult(equity.wins, equity.trials, equity.ties);
+}
+
+//Every opponent hand on a complete board, ranked once and grouped by strength, for ranking many players' hands on the same board
+//For the groups up to %group%, %below%[group] counts the hands of lower strength and %belowCards%[group][card] those holding a card
+struct BoardCache{
+    BoardState board;
+    int groupCount;
+    Strength strengths[1081];
+    int below[1082];
+    int belowCards[1082][52];
+};
+
+typedef struct BoardCache BoardCache;
+
+//Ranks every pair of the 47 cards left off a 5 card board and counts the pairs below each strength
+void fillBoardCache(BoardCache *cache, const int board[5]){
+    initialiseEvaluator();
+    cache->board = emptyBoard();
+    for (int i = 0; i < 5; i++) cache->board = addToBoard(cache->board, board[i]);
+    int deck[47];
+    int deckLength = 0;
+    for (CardSet rest = fullDeckSet() & ~cache->board.bits; rest != 0; rest &= rest - 1) deck[deckLength++] = lowestIndex(rest);
+
+    uint64_t sorted[1081];
+    uint64_t spare[1081];
+    int pairCount = 0;
+    for (int i = 0; i < deckLength - 1; i++){
+        const BoardState withFirst = addToBoard(cache->board, deck[i]);
+        for (int j = i + 1; j < deckLength; j++){
+            sorted[pairCount++] = (uint64_t) rankWithCard(&withFirst, deck[j]) << 12 | deck[i] << 6 | deck[j];
+        }
+    }
+    sortByStrength(sorted, spare, pairCount, 12);
+
+    cache->groupCount = 0;
+    cache->below[0] = 0;
+    memset(cache->belowCards[0], 0, sizeof(cache->belowCards[0]));
+    for (int n = 0; n < pairCount; n++){
+        const Strength strength = sorted[n] >> 12;
+        int group = cache->groupCount - 1;
+        if (n == 0 || cache->strengths[group] != strength){
+            group = cache->groupCount++;
+            cache->strengths[group] = strength;
+            cache->below[group + 1] = cache->below[group];
+            memcpy(cache->belowCards[group + 1], cache->belowCards[group], sizeof(cache->belowCards[0]));
+        }
+        cache->below[group + 1]++;
+        cache->belowCards[group + 1][(sorted[n] >> 6) & 63]++;
+        cache->belowCards[group + 1][sorted[n] & 63]++;
+    }
+}
+
+//Plays a pair of hole cards against every opponent hand on a cached board, without ranking the opponents again
+//Opponent hands holding either hole card are taken off using the counts for each card
+Equity checkCachedOpponents(const BoardCache *cache, int first, int second){
+    const Strength playerRank = rankHoleCards(&cache->board, first, second);
+    //The player's own hand is one of the cached hands, so its strength has a group
+    int low = 0;
+    int high = cache->groupCount - 1;
+    while (low < high){
+        const int middle = (low + high) / 2;
+        if (cache->strengths[middle] < playerRank) low = middle + 1;
+        else high = middle;
+    }
+    const int group = low;
+    const int *below = cache->belowCards[group];
+    const int *upTo = cache->belowCards[group + 1];
+    Equity equity;
+    equity.wins = cache->below[group] - below[first] - below[second];
+    //The player's own hand holds both cards, so it is taken off twice and added back once
+    equity.ties = cache->below[group + 1] - cache->below[group] - (upTo[first] - below[first]) - (upTo[second] - below[second]) + 1;
+    equity.trials = 45 * 44 / 2;
+    return equity;
+}
+
+//MONTE CARLO
+
+//Number of independent xoshiro256+ generators stepped together
+//Each step updates every lane with the same shifts and xors, so the compiler can use vector instructions
+enum {RandomLanes = 4};
+
+//Random number generator: RandomLanes xoshiro256+ generators, with the last step's outputs buffered
+struct Random{
+    uint64_t state[4][RandomLanes];
+    uint64_t output[RandomLanes];
+    int used;
+};
+
+typedef struct Random Random;
+
+//Next value of the splitmix64 sequence, used to spread a seed over the generators' states
+uint64_t splitMix(uint64_t *seed){
+    uint64_t z = (*seed += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+//Seeds every lane of the generator from a single seed
+void seedRandom(Random *random, uint64_t seed){
+    for (int word = 0; word < 4; word++){
+        for (int lane = 0; lane < RandomLanes; lane++) random->state[word][lane] = splitMix(&seed);
+    }
+    random->used = RandomLanes;
+}
+
+//Steps every lane once, buffering one output from each
+void stepRandom(Random *random){
+    uint64_t (*s)[RandomLanes] = random->state;
+    for (int lane = 0; lane < RandomLanes; lane++){
+        random->output[lane] = s[0][lane] + s[3][lane];
+        const uint64_t t = s[1][lane] << 17;
+        s[2][lane] ^= s[0][lane];
+        s[3][lane] ^= s[1][lane];
+        s[1][lane] ^= s[2][lane];
+        s[0][lane] ^= s[3][lane];
+        s[2][lane] ^= t;
+        s[3][lane] = (s[3][lane] << 45) | (s[3][lane] >> 19);
+    }
+    random->used = 0;
+}
+
+//Random integer from 0 to %range% - 1, with no bias
+//Uses the top 32 bits (the low bits of xoshiro256+ are weaker), scaled by a multiply rather than divided
+int randomBelow(Random *random, uint32_t range){
+    while (true){
+        if (random->used == RandomLanes) stepRandom(random);
+        const uint64_t scaled = (random->output[random->used++] >> 32) * range;
+        //Rejects the few values that would make some results more likely than others
+        if ((uint32_t) scaled >= (uint32_t) -range % range) return scaled >> 32;
+    }
+}
+
+//Totals of a Monte Carlo simulation
+//%potShare% sums the share of the pot the player takes in each deal, and %potShareSquares% the squares, for the confidence interval
+struct Simulation{
+    Equity equity;
+    double potShare;
+    double potShareSquares;
+};
+
+typedef struct Simulation Simulation;
+
+//Known cards of a Monte Carlo simulation, and the totals shared by its threads
+//Threads deal in batches, adding each batch to the totals and stopping once the interval is narrow enough
+struct MonteCarloJob{
+    BoardState player;
+    BoardState board;
+    int deck[50];
+    int deckSize;
+    int missingCards;
+    int opponents;
+    double margin;
+    long long maxTrials;
+    uint64_t seed;
+    int nextSeed;
+    bool done;
+    pthread_mutex_t lock;
+    Simulation total;
+};
+
+typedef struct MonteCarloJob MonteCarloJob;
+
+enum {MonteCarloBatch = 4096, MinMonteCarloTrials = 10000};
+
+//Half the width of the 95% confidence interval of the player's share of the pot
+double confidenceMargin(const Simulation *simulation){
+    const double trials = simulation->equity.trials;
+    if (trials < 2) return 1;
+    const double mean = simulation->potShare / trials;
+    const double variance = (simulation->potShareSquares - trials * mean * mean) / (trials - 1);
+    return 1.96 * sqrt(variance > 0 ? variance / trials : 0);
+}
 
+//Deals the rest of the board and every opponent's hole cards, and plays the showdown
+//The deck is shuffled only as far as the cards needed, continuing from the previous deal's order
+void playDeal(const MonteCarloJob *job, int deck[], Random *random, Simulation *simulation){
+    const int needed = job->missingCards + 2 * job->opponents;
+    for (int i = 0; i < needed; i++){
+        const int j = i + randomBelow(random, job->deckSize - i);
+        const int swap = deck[i];
+        deck[i] = deck[j];
+        deck[j] = swap;
+    }
+
+    BoardState player = job->player;
+    BoardState board = job->board;
+    for (int i = 0; i < job->missingCards; i++){
+        player = addToBoard(player, deck[i]);
+        board = addToBoard(board, deck[i]);
+    }
+    const Strength playerRank = rankFromKey(player.key, player.bits);
+    Strength bestOpponent = 0;
+    int bestCount = 0;
+    for (int i = job->missingCards; i < needed; i += 2){
+        const Strength opponentRank = rankHoleCards(&board, deck[i], deck[i + 1]);
+        if (opponentRank > bestOpponent){
+            bestOpponent = opponentRank;
+            bestCount = 1;
+        }
+        else if (opponentRank == bestOpponent) bestCount++;
+    }
+
+    double share = 0;
+    if (playerRank > bestOpponent){
+        simulation->equity.wins++;
+        share = 1;
+    }
+    else if (playerRank == bestOpponent){
+        simulation->equity.ties++;
+        share = 1.0 / (bestCount + 1);
+    }
+    simulation->equity.trials++;
+    simulation->potShare += share;
+    simulation->potShareSquares += share * share;
+}
+
+//Worker thread of a Monte Carlo simulation, with its own generator, deck and batch totals
+void *monteCarloWorker(void *data){
+    MonteCarloJob *job = data;
+    pthread_mutex_lock(&job->lock);
+    uint64_t seed = job->seed + job->nextSeed++;
+    pthread_mutex_unlock(&job->lock);
+    Random random;
+    seedRandom(&random, splitMix(&seed));
+    int deck[50];
+    memcpy(deck, job->deck, sizeof(int) * job->deckSize);
+
+    bool done = false;
+    while (!done){
+        Simulation batch = {{0, 0, 0}, 0, 0};
+        for (int i = 0; i < MonteCarloBatch; i++) playDeal(job, deck, &random, &batch);
+
+        pthread_mutex_lock(&job->lock);
+        if (!job->done){
+            Simulation *total = &job->total;
+            total->equity.wins += batch.equity.wins;
+            total->equity.ties += batch.equity.ties;
+            total->equity.trials += batch.equity.trials;
+            total->potShare += batch.potShare;
+            total->potShareSquares += batch.potShareSquares;
+            if (total->equity.trials >= job->maxTrials) job->done = true;
+            if (total->equity.trials >= MinMonteCarloTrials && confidenceMargin(total) <= job->margin) job->done = true;
+        }
+        done = job->done;
+        pthread_mutex_unlock(&job->lock);
+    }
+    return NULL;
+}
+
+//Estimates the player's equity against %opponents% opponents by dealing random boards and opponent hands
+//Stops once the 95% confidence interval of the pot share is within %margin% either side, or after %maxTrials% deals
+//With one thread the deals only depend on %seed%, so results can be repeated
+Simulation monteCarloEquity(Card handCards[2], Card potCards[], int boardSize, int opponents, double margin, long long maxTrials, uint64_t seed, int threadCount){
+    initialiseEvaluator();
+    MonteCarloJob job = {emptyBoard(), emptyBoard()};
+    for (int i = 0; i < 2; i++) job.player = addToBoard(job.player, cardIndex(handCards[i]));
+    for (int i = 0; i < boardSize; i++){
+        const int card = cardIndex(potCards[i]);
+        job.player = addToBoard(job.player, card);
+        job.board = addToBoard(job.board, card);
+    }
+
+    //The deck is dealt from in initialiseDeck's order, leaving out the known cards
     const int deckLength = 52;
     Card fullDeck[deckLength];
     initialiseDeck(deckLength, fullDeck);
+    for (int i = 0; i < deckLength; i++){
+        if (!(job.player.bits & cardBit(fullDeck[i]))) job.deck[job.deckSize++] = cardIndex(fullDeck[i]);
+    }
+    job.missingCards = 5 - boardSize;
+    job.opponents = opponents;
+    job.margin = margin;
+    job.maxTrials = maxTrials;
+    job.seed = seed;
+    pthread_mutex_init(&job.lock, NULL);
+
+    pthread_t threads[threadCount];
+    int started = 1;
+    for (; started < threadCount; started++){
+        if (pthread_create(&threads[started], NULL, monteCarloWorker, &job) != 0) break;
+    }
+    monteCarloWorker(&job);
+    for (int i = 1; i < started; i++) pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&job.lock);
+    return job.total;
+}
+
+enum {MaxOpponents = 9};
+
+//Most deals an exact calculation against several opponents will play, a few minutes' work on one processor
+const double MaxExactDeals = 1e10;
+
+//Known cards of an exact calculation against several opponents
+//Each case is a runout together with the first opponent's hole cards from the cards left, numbered runout * %pairCount% + pair by their ranks
+//The first opponent is the one holding the lowest card of all the opponents' hands
+struct ShowdownJob{
+    BoardState player;
+    BoardState board;
+    int deck[50];
+    int deckSize;
+    int missingCards;
+    int opponents;
+    long long pairCount;
+};
+
+typedef struct ShowdownJob ShowdownJob;
+
+//Showdowns played against several opponents, with the number of them split between each number of players
+struct Showdowns{
+    Equity equity;
+    long long splits[MaxOpponents + 2];
+};
+
+typedef struct Showdowns Showdowns;
+
+//Deals the other opponents' hole cards in every way from %rest%, and plays each showdown against the best opponent hand so far
+//Each opponent's lower card is above the one before's (by its bit in a CardSet), so every set of opponent hands is dealt once
+void dealOpponents(const BoardState *board, CardSet rest, int lowest, int opponentsLeft, Strength playerRank, Strength best, int bestCount, Showdowns *showdowns){
+    if (opponentsLeft == 0){
+        showdowns->equity.trials++;
+        if (playerRank > best) showdowns->equity.wins++;
+        else if (playerRank == best){
+            showdowns->equity.ties++;
+            showdowns->splits[bestCount + 1]++;
+        }
+        return;
+    }
+    for (CardSet firsts = rest & ~((indexBit(lowest) << 1) - 1); firsts != 0; firsts &= firsts - 1){
+        const int first = lowestIndex(firsts);
+        const BoardState withFirst = addToBoard(*board, first);
+        for (CardSet seconds = firsts & (firsts - 1); seconds != 0; seconds &= seconds - 1){
+            const int second = lowestIndex(seconds);
+            const Strength rank = rankWithCard(&withFirst, second);
+            const CardSet left = rest & ~(indexBit(first) | indexBit(second));
+            if (rank > best) dealOpponents(board, left, first, opponentsLeft - 1, playerRank, rank, 1, showdowns);
+            else dealOpponents(board, left, first, opponentsLeft - 1, playerRank, best, bestCount + (rank == best), showdowns);
+        }
+    }
+}
+
+//Plays the cases numbered %first% up to %end%: for each, every way of dealing the other opponents' hands
+void showdownChunk(const void *context, long long first, long long end, void *tally){
+    const ShowdownJob *job = context;
+    uint64_t positions = unrankCombination(first / job->pairCount, job->missingCards);
+    long long number = first;
+    while (number < end){
+        BoardState player = job->player;
+        BoardState board = job->board;
+        CardSet rest = 0;
+        for (int i = 0; i < job->deckSize; i++) rest |= indexBit(job->deck[i]);
+        for (uint64_t dealt = positions; dealt != 0; dealt &= dealt - 1){
+            const int card = job->deck[__builtin_ctzll(dealt)];
+            player = addToBoard(player, card);
+            board = addToBoard(board, card);
+            rest &= ~indexBit(card);
+        }
+        const Strength playerRank = rankFromKey(player.key, player.bits);
+        int left[50];
+        int leftSize = 0;
+        for (CardSet cards = rest; cards != 0; cards &= cards - 1) left[leftSize++] = lowestIndex(cards);
+
+        long long pairNumber = number % job->pairCount;
+        uint64_t pair = unrankCombination(pairNumber, 2);
+        for (; pairNumber < job->pairCount && number < end; pairNumber++, number++){
+            //The cards left are in CardSet bit order, so the pair's first card is its lower
+            const int low = left[__builtin_ctzll(pair)];
+            const int high = left[__builtin_ctzll(pair & (pair - 1))];
+            const Strength rank = rankHoleCards(&board, low, high);
+            dealOpponents(&board, rest & ~(indexBit(low) | indexBit(high)), low, job->opponents - 1, playerRank, rank, 1, tally);
+            if (pairNumber + 1 < job->pairCount) pair = nextCombination(pair);
+        }
+        if (number < end) positions = nextCombination(positions);
+    }
+}
+
+//Adds one thread's showdowns to the result's
+void mergeShowdowns(void *result, const void *tally){
+    Showdowns *total = result;
+    const Showdowns *showdowns = tally;
+    mergeEquity(&total->equity, &showdowns->equity);
+    for (int i = 0; i < MaxOpponents + 2; i++) total->splits[i] += showdowns->splits[i];
+}
+
+//Share of the pot won over a set of showdowns, a split pot being shared equally between the players with the best hand
+double showdownPotShare(const Showdowns *showdowns){
+    double share = showdowns->equity.wins;
+    for (int players = 2; players < MaxOpponents + 2; players++) share += (double) showdowns->splits[players] / players;
+    return share / showdowns->equity.trials;
+}
+
+//Plays the player's hole cards against %opponents% opponents on every way of dealing the rest of the board and the opponents' hands
+//Only practical late in the hand or against few opponents: on the river against 3 opponents there are about 122 million deals
+Showdowns exactMultiwayEquity(Card handCards[2], Card potCards[], int boardSize, int opponents, int threadCount){
+    initialiseEvaluator();
+    initialiseBinomials();
+    ShowdownJob job = {emptyBoard(), emptyBoard()};
+    for (int i = 0; i < 2; i++) job.player = addToBoard(job.player, cardIndex(handCards[i]));
+    for (int i = 0; i < boardSize; i++){
+        const int card = cardIndex(potCards[i]);
+        job.player = addToBoard(job.player, card);
+        job.board = addToBoard(job.board, card);
+    }
+    for (CardSet rest = fullDeckSet() & ~job.player.bits; rest != 0; rest &= rest - 1) job.deck[job.deckSize++] = lowestIndex(rest);
+    job.missingCards = 5 - boardSize;
+    job.opponents = opponents;
+    job.pairCount = binomials[job.deckSize - job.missingCards][2];
+
+    Showdowns total = {{0, 0, 0}};
+    enumerate(binomials[job.deckSize][job.missingCards] * job.pairCount, threadCount, &job, showdownChunk, sizeof(Showdowns), &total, mergeShowdowns);
+    return total;
+}
+
+//Number of deals exactMultiwayEquity plays: every way of dealing the rest of the board, then every set of opponent hands
+//Kept as a double since before the flop against many opponents it is far beyond the range of a long long
+double exactDealCount(int boardSize, int opponents){
+    initialiseBinomials();
+    const int deckSize = 50 - boardSize;
+    double deals = binomials[deckSize][5 - boardSize];
+    for (int i = 0, left = deckSize - (5 - boardSize); i < opponents; i++, left -= 2) deals *= binomials[left][2];
+    for (int i = 2; i <= opponents; i++) deals /= i;
+    return deals;
+}
+
+//Estimates the strength of a player's hole cards against several opponents, and displays the confidence interval
+void multiwayStrength(Card handCards[2], Card potCards[], int boardSize, int opponents, double margin){
+    const long long maxTrials = 100000000;
+    Simulation simulation = monteCarloEquity(handCards, potCards, boardSize, opponents, margin, maxTrials, (uint64_t) time(NULL), processorCount());
+    displayResult(simulation.equity.wins, simulation.equity.trials, simulation.equity.ties);
+    const double equity = simulation.potShare / simulation.equity.trials * 100;
+    printf("Equity - %.2f%% +/- %.2f%% (95%% confidence, %lld deals)\n", equity, confidenceMargin(&simulation) * 100, simulation.equity.trials);
+}
+
+//Calculates the strength of a player's hole cards against several opponents exactly, playing every deal
+void exactMultiwayStrength(Card handCards[2], Card potCards[], int boardSize, int opponents){
+    Showdowns showdowns = exactMultiwayEquity(handCards, potCards, boardSize, opponents, processorCount());
+    displayResult(showdowns.equity.wins, showdowns.equity.trials, showdowns.equity.ties);
+    printf("Equity - %.2f%% (exact, %lld deals)\n", showdownPotShare(&showdowns) * 100, showdowns.equity.trials);
+}
+
+//RANGES
+
+//Number of different pairs of hole cards, and of hand classes (pairs, suited and offsuit hands) they fall into
+//Weights are whole numbers of 1/RangeWeightUnit, so the totals of a range calculation are exact whatever order they are added in
+enum {PairCount = 1326, ClassCount = 169, RangeWeightUnit = 10000};
+
+//Weighted set of hole cards, such as "JJ+,AKs,KQo"
+//%weights% is indexed by pairIndex, with RangeWeightUnit for a whole pair and 0 for pairs not in the range
+struct Range{
+    int weights[PairCount];
+};
+
+typedef struct Range Range;
+
+//Index (0 - 1325) of the pair of card indices %first% and %second%, in either order
+int pairIndex(int first, int second){
+    if (first > second){
+        const int swap = first;
+        first = second;
+        second = swap;
+    }
+    return second * (second - 1) / 2 + first;
+}
+
+//Class of a pair of cards: the 13 x 13 grid with pairs on the diagonal, suited hands above and offsuit hands below
+int classIndex(int first, int second){
+    const int high = first % 13 > second % 13 ? first % 13 : second % 13;
+    const int low = first % 13 > second % 13 ? second % 13 : first % 13;
+    if (first / 13 == second / 13) return (12 - high) * 13 + (12 - low);
+    return (12 - low) * 13 + (12 - high);
+}
+
+//Writes the name of a hand class, such as "AKs", "T9o" or "77"
+void className(int index, char name[4]){
+    const char values[] = "AKQJT98765432";
+    const int row = index / 13;
+    const int column = index % 13;
+    name[0] = values[row < column ? row : column];
+    name[1] = values[row < column ? column : row];
+    name[2] = row < column ? 's' : row > column ? 'o' : '\0';
+    name[3] = '\0';
+}
+
+//Converts a range value charecter (2 - 9, T, J, Q, K, A) to an integer, or -1 if it isn't one
+int parseRangeValue(char digit){
+    const char values[] = "23456789TJQKA";
+    for (int i = 0; i < 13; i++){
+        if (values[i] == digit) return i + 2;
+    }
+    return -1;
+}
+
+//Converts a suit charecter of either case to its index in suits[], or -1 if it isn't one
+int parseRangeSuit(char letter){
+    for (int i = 0; i < 4; i++){
+        if (suits[i] == letter || suits[i] - 'A' + 'a' == letter) return i;
+    }
+    return -1;
+}
+
+//Sets the weight of every pair of cards in a hand class
+//%kind% is 'p' for a pair, 's' for suited, 'o' for offsuit, or 'b' for both suited and offsuit
+void addClass(Range *range, int high, int low, char kind, int weight){
+    for (int firstSuit = 0; firstSuit < 4; firstSuit++){
+        for (int secondSuit = 0; secondSuit < 4; secondSuit++){
+            if (kind == 'p' && firstSuit >= secondSuit) continue;
+            if (kind == 's' && firstSuit != secondSuit) continue;
+            if (kind == 'o' && firstSuit == secondSuit) continue;
+            range->weights[pairIndex(firstSuit * 13 + high - 2, secondSuit * 13 + low - 2)] = weight;
+        }
+    }
+}
+
+//Parses a hand class such as "AK", "AKs", "AKo" or "77" from the start of %text%
+//Sets the higher and lower value and the kind of class (as in addClass), and returns the number of charecters read or 0 if it isn't valid
+int parseClass(const char text[], int *high, int *low, char *kind){
+    *high = parseRangeValue(text[0]);
+    *low = text[0] == '\0' ? -1 : parseRangeValue(text[1]);
+    if (*high < 0 || *low < 0) return 0;
+    if (*high < *low){
+        const int swap = *high;
+        *high = *low;
+        *low = swap;
+    }
+    if (*high == *low){
+        *kind = 'p';
+        return 2;
+    }
+    if (text[2] == 's' || text[2] == 'o'){
+        *kind = text[2];
+        return 3;
+    }
+    *kind = 'b';
+    return 2;
+}
 
-    Card deck[deckLength - fullHandSize];
-    removeCardsFromDeck(fullHandSize, playerCards, deckLength, fullDeck, deck);
+//Parses one comma separated item of a range and adds its pairs of cards
+//Items are a class ("AKs"), a class and every better kicker or pair ("ATs+", "77+"), a span of classes ("A2s-A5s", "22-55")
+//or two exact cards ("AhKs"), optionally followed by a weight from 0 to 1 (":0.5"), which is rounded to a whole number of 1/RangeWeightUnit
+bool parseRangeItem(Range *range, char item[]){
+    int weight = RangeWeightUnit;
+    char *colon = strchr(item, ':');
+    if (colon != NULL){
+        char *end;
+        const double share = strtod(colon + 1, &end);
+        if (*end != '\0' || end == colon + 1 || share < 0 || share > 1) return false;
+        weight = lround(share * RangeWeightUnit);
+        *colon = '\0';
+    }
+
+    if (strlen(item) == 4 && parseRangeSuit(item[1]) >= 0 && parseRangeSuit(item[3]) >= 0){
+        const int firstValue = parseRangeValue(item[0]);
+        const int secondValue = parseRangeValue(item[2]);
+        if (firstValue < 0 || secondValue < 0) return false;
+        const int first = parseRangeSuit(item[1]) * 13 + firstValue - 2;
+        const int second = parseRangeSuit(item[3]) * 13 + secondValue - 2;
+        if (first == second) return false;
+        range->weights[pairIndex(first, second)] = weight;
+        return true;
+    }
 
-    checkAllOpponentHands(deck, potCards, playerRank);
+    int high;
+    int low;
+    char kind;
+    const int length = parseClass(item, &high, &low, &kind);
+    if (length == 0) return false;
+    const char *rest = item + length;
+    if (*rest == '\0') addClass(range, high, low, kind, weight);
+    else if (strcmp(rest, "+") == 0){
+        if (kind == 'p') for (int value = low; value <= A; value++) addClass(range, value, value, kind, weight);
+        else for (int value = low; value < high; value++) addClass(range, high, value, kind, weight);
+    }
+    else if (*rest == '-'){
+        int lastHigh;
+        int lastLow;
+        char lastKind;
+        const int lastLength = parseClass(rest + 1, &lastHigh, &lastLow, &lastKind);
+        if (lastLength == 0 || rest[1 + lastLength] != '\0' || lastKind != kind) return false;
+        if (kind != 'p' && lastHigh != high) return false;
+        const int from = low < lastLow ? low : lastLow;
+        const int to = low < lastLow ? lastLow : low;
+        for (int value = from; value <= to; value++) addClass(range, kind == 'p' ? value : high, value, kind, weight);
+    }
+    else return false;
+    return true;
+}
+
+//Parses a comma separated range, such as "JJ+,AKs,KQo:0.5"
+//Later items replace the weights of earlier ones where they overlap
+bool parseRange(Range *range, const char text[]){
+    const int maxLength = 512;
+    char buffer[maxLength];
+    if (strlen(text) >= maxLength) return false;
+    strcpy(buffer, text);
+    memset(range, 0, sizeof(Range));
+    bool validRange = false;
+    for (char *item = strtok(buffer, ", "); item != NULL; item = strtok(NULL, ", ")){
+        if (!parseRangeItem(range, item)) return false;
+        validRange = true;
+    }
+    return validRange;
+}
+
+//Checks whether relabelling the suits in any way leaves the range's weights the same
+//This holds for ranges written as classes, but not for most ranges with exact cards
+bool suitSymmetric(const Range *range){
+    for (int second = 1; second < 52; second++){
+        for (int first = 0; first < second; first++){
+            const int weight = range->weights[pairIndex(first, second)];
+            //Swapping any two suits generates every relabelling, so these are the only ones to check
+            for (int suitA = 0; suitA < 4; suitA++){
+                for (int suitB = suitA + 1; suitB < 4; suitB++){
+                    int swapped[2] = {first, second};
+                    for (int i = 0; i < 2; i++){
+                        const int suit = swapped[i] / 13;
+                        if (suit == suitA) swapped[i] += (suitB - suitA) * 13;
+                        else if (suit == suitB) swapped[i] -= (suitB - suitA) * 13;
+                    }
+                    if (range->weights[pairIndex(swapped[0], swapped[1])] != weight) return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+//Known cards and ranges of a range against range calculation, with its totals
+//Each way of dealing the rest of the board is a case of the enumeration, numbered by the rank of its positions in %deck%
+//%pairs% lists the pairs of cards in either range, which are each ranked once per board and the results used by both ranges
+struct RangeJob{
+    const Range *hero;
+    const Range *villain;
+    int pairs[PairCount];
+    int pairCards[PairCount][2];
+    int pairCount;
+    int board[5];
+    int boardSize;
+    int deck[52];
+    int deckSize;
+    bool symmetric;
+    long long wins[PairCount];
+    long long ties[PairCount];
+    long long trials[PairCount];
+};
+
+typedef struct RangeJob RangeJob;
+
+//Per thread totals and working space of a range calculation
+//The totals are the villain weight each hero pair beats, ties with and meets, summed over the boards
+struct RangeTally{
+    long long wins[PairCount];
+    long long ties[PairCount];
+    long long trials[PairCount];
+    uint64_t sorted[PairCount];
+    uint64_t spare[PairCount];
+};
+
+typedef struct RangeTally RangeTally;
+
+//Plays every hero pair against every villain pair on a complete board, weighting the results by %boardWeight%
+//Pairs are ranked once and sorted by strength; then, strength by strength, a hero pair beats the villain weight below it
+//Villain pairs sharing a card with the hero pair are taken off using totals kept for each card
+void playRangeBoard(const RangeJob *job, const int board[5], int boardWeight, RangeTally *tally){
+    BoardState state = emptyBoard();
+    for (int i = 0; i < 5; i++) state = addToBoard(state, board[i]);
+
+    int count = 0;
+    long long villainTotal = 0;
+    long long villainCards[52] = {0};
+    for (int i = 0; i < job->pairCount; i++){
+        const int *cards = job->pairCards[i];
+        if (state.bits & (indexBit(cards[0]) | indexBit(cards[1]))) continue;
+        const Strength strength = rankHoleCards(&state, cards[0], cards[1]);
+        tally->sorted[count++] = (uint64_t) strength << 11 | i;
+        const int weight = job->villain->weights[job->pairs[i]];
+        villainTotal += weight;
+        villainCards[cards[0]] += weight;
+        villainCards[cards[1]] += weight;
+    }
+    sortByStrength(tally->sorted, tally->spare, count, 11);
+
+    long long belowTotal = 0;
+    long long belowCards[52] = {0};
+    long long equalCards[52] = {0};
+    for (int start = 0; start < count;){
+        const uint64_t strength = tally->sorted[start] >> 11;
+        int end = start;
+        long long equalTotal = 0;
+        for (; end < count && tally->sorted[end] >> 11 == strength; end++){
+            const int i = tally->sorted[end] & 2047;
+            const int weight = job->villain->weights[job->pairs[i]];
+            equalTotal += weight;
+            equalCards[job->pairCards[i][0]] += weight;
+            equalCards[job->pairCards[i][1]] += weight;
+        }
+        for (int n = start; n < end; n++){
+            const int i = tally->sorted[n] & 2047;
+            const int pair = job->pairs[i];
+            if (job->hero->weights[pair] == 0) continue;
+            const int first = job->pairCards[i][0];
+            const int second = job->pairCards[i][1];
+            //The villain can't hold the hero's own pair, which is counted in both cards' totals and in the equal strengths
+            const int same = job->villain->weights[pair];
+            tally->wins[pair] += boardWeight * (belowTotal - belowCards[first] - belowCards[second]);
+            tally->ties[pair] += boardWeight * (equalTotal - equalCards[first] - equalCards[second] + same);
+            tally->trials[pair] += boardWeight * (villainTotal - villainCards[first] - villainCards[second] + same);
+        }
+        for (int n = start; n < end; n++){
+            const int i = tally->sorted[n] & 2047;
+            const int weight = job->villain->weights[job->pairs[i]];
+            belowCards[job->pairCards[i][0]] += weight;
+            belowCards[job->pairCards[i][1]] += weight;
+            equalCards[job->pairCards[i][0]] = 0;
+            equalCards[job->pairCards[i][1]] = 0;
+        }
+        belowTotal += equalTotal;
+        start = end;
+    }
+}
+
+//Number of ways of relabelling suits that give a different board, if the board is the first of those ways; otherwise 0
+//The first board is the one whose suits' value masks are in decreasing order
+int boardRelabellings(const int board[5]){
+    CardSet set = 0;
+    for (int i = 0; i < 5; i++) set |= indexBit(board[i]);
+    unsigned masks[4];
+    for (int suit = 0; suit < 4; suit++) masks[suit] = suitValues(set, suit);
+    for (int suit = 1; suit < 4; suit++){
+        if (masks[suit] > masks[suit - 1]) return 0;
+    }
+    //Suits with the same mask give the same board when swapped
+    int relabellings = 24;
+    for (int suit = 0; suit < 4;){
+        int same = 1;
+        while (suit + same < 4 && masks[suit + same] == masks[suit]) same++;
+        for (int i = 2; i <= same; i++) relabellings /= i;
+        suit += same;
+    }
+    return relabellings;
+}
+
+//Plays the boards numbered %first% up to %end%
+//With suit symmetric ranges and no known board, only the first of each set of relabelled boards is played, weighted by the set's size
+void rangeChunk(const void *context, long long first, long long end, void *tally){
+    const RangeJob *job = context;
+    int board[5];
+    memcpy(board, job->board, sizeof(int) * job->boardSize);
+    uint64_t positions = unrankCombination(first, 5 - job->boardSize);
+    for (long long runout = first; runout < end; runout++){
+        int boardSize = job->boardSize;
+        for (uint64_t rest = positions; rest != 0; rest &= rest - 1) board[boardSize++] = job->deck[__builtin_ctzll(rest)];
+        if (!job->symmetric) playRangeBoard(job, board, 1, tally);
+        else {
+            const int relabellings = boardRelabellings(board);
+            if (relabellings != 0) playRangeBoard(job, board, relabellings, tally);
+        }
+        if (runout + 1 < end) positions = nextCombination(positions);
+    }
+}
+
+//Adds one thread's totals to the job's
+void mergeRangeTally(void *result, const void *data){
+    RangeJob *job = result;
+    const RangeTally *tally = data;
+    for (int pair = 0; pair < PairCount; pair++){
+        job->wins[pair] += tally->wins[pair];
+        job->ties[pair] += tally->ties[pair];
+        job->trials[pair] += tally->trials[pair];
+    }
+}
+
+//Plays every pair of the hero's range against every pair of the villain's range, over every way of completing the board
+//Fills %job%'s totals with the villain weight each hero pair beats, ties with and meets
+//Pairs that share a card with the board or each other are never played against each other
+//The totals are whole numbers, so they don't depend on how the boards were shared out between the threads
+void rangeEquity(RangeJob *job, const Range *hero, const Range *villain, Card potCards[], int boardSize, int threadCount){
+    initialiseEvaluator();
+    initialiseBinomials();
+    memset(job, 0, sizeof(RangeJob));
+    job->hero = hero;
+    job->villain = villain;
+    CardSet known = 0;
+    for (int i = 0; i < boardSize; i++){
+        job->board[i] = cardIndex(potCards[i]);
+        known |= indexBit(job->board[i]);
+    }
+    job->boardSize = boardSize;
+    for (CardSet rest = fullDeckSet() & ~known; rest != 0; rest &= rest - 1) job->deck[job->deckSize++] = lowestIndex(rest);
+    for (int second = 1; second < 52; second++){
+        for (int first = 0; first < second; first++){
+            const int pair = pairIndex(first, second);
+            if (hero->weights[pair] == 0 && villain->weights[pair] == 0) continue;
+            job->pairs[job->pairCount] = pair;
+            job->pairCards[job->pairCount][0] = first;
+            job->pairCards[job->pairCount][1] = second;
+            job->pairCount++;
+        }
+    }
+    job->symmetric = boardSize == 0 && suitSymmetric(hero) && suitSymmetric(villain);
+    enumerate(binomials[job->deckSize][5 - boardSize], threadCount, job, rangeChunk, sizeof(RangeTally), job, mergeRangeTally);
+}
+
+//Adds up the totals of the hero pairs in a class, or of every hero pair if %classFilter% is -1, weighted by the hero's range
+//Returns the number of hero pairs added
+int rangeTotals(const RangeJob *job, int classFilter, double *wins, double *ties, double *trials){
+    *wins = 0;
+    *ties = 0;
+    *trials = 0;
+    int pairs = 0;
+    for (int i = 0; i < job->pairCount; i++){
+        const int pair = job->pairs[i];
+        const double weight = (double) job->hero->weights[pair] / RangeWeightUnit;
+        if (weight == 0) continue;
+        if (classFilter >= 0 && classIndex(job->pairCards[i][0], job->pairCards[i][1]) != classFilter) continue;
+        *wins += weight * job->wins[pair];
+        *ties += weight * job->ties[pair];
+        *trials += weight * job->trials[pair];
+        pairs++;
+    }
+    return pairs;
+}
+
+//Displays the hero range's equity against the villain range, then each hero class's if the range has more than one
+void displayRangeResult(const RangeJob *job){
+    double wins;
+    double ties;
+    double trials;
+    rangeTotals(job, -1, &wins, &ties, &trials);
+    if (trials == 0){
+        printf("The ranges have no hands that can meet\n");
+        return;
+    }
+    displayResult(wins, trials, ties);
+    printf("Equity - %.2f%%\n", (wins + ties / 2) / trials * 100);
+
+    int classes = 0;
+    for (int index = 0; index < ClassCount; index++){
+        if (rangeTotals(job, index, &wins, &ties, &trials) > 0) classes++;
+    }
+    if (classes < 2) return;
+    for (int index = 0; index < ClassCount; index++){
+        if (rangeTotals(job, index, &wins, &ties, &trials) == 0 || trials == 0) continue;
+        char name[4];
+        className(index, name);
+        printf("%s - %.2f%%\n", name, (wins + ties / 2) / trials * 100);
+    }
 }
 
 //Converts a charecter card value to an integer
@@ -335,51 +1757,376 @@ bool parseCard(int argNum, char *args[argNum], int argIndex, int cardIndex, Card
     return validCard;
 }
 
-//Parses all 7 cards provided by the user input
-bool parseHand(Card handCards[2], Card potCards[5], int argNum, char *args[argNum]){
+//Checks that no card is given twice
+bool cardsDistinct(int size, Card cards[size]){
+    return setSize(cardsToSet(size, cards)) == size;
+}
+
+//Parses the 2 hole cards and %boardSize% community cards provided by the user input
+bool parseHand(Card handCards[2], Card potCards[5], int boardSize, int argNum, char *args[argNum]){
     bool validArgs = true;
     const int offset = 3;
     for (int i = 0; (i < 2) && (validArgs); i++){
         validArgs = parseCard(argNum, args, i + 1, i, handCards);
     }
-    for (int i = 0; (i < 5) && (validArgs); i++){
+    for (int i = 0; (i < boardSize) && (validArgs); i++){
         validArgs = parseCard(argNum, args, i + offset, i, potCards);
     }
 
-    return validArgs;
+    Card cards[7];
+    concatArray(cards, 2, handCards, boardSize, potCards);
+    return validArgs && cardsDistinct(2 + boardSize, cards);
 }
 
 //Calcualtes the strength of a user-provided set of cards
+//The arguments after the 2 hole cards are the community cards known so far
 void userHand(int argNum, char *args[argNum]){
     const int handCardsSize = 2;
     const int potCardsSize = 5;
+    const int boardSize = argNum - 1 - handCardsSize;
     Card handCards[handCardsSize];
     Card potCards[potCardsSize];
-    if (parseHand(handCards, potCards, argNum, args)){
-        handStrength(handCards, potCards);
+    if (parseHand(handCards, potCards, boardSize, argNum, args)){
+        handStrength(handCards, potCards, boardSize);
     }
     else printf("Invalid arguments\n");
 }
 
+//Reads pairs of hole cards from standard input, one pair a line, and displays each one's strength on the same board
+//The board is ranked against every opponent hand once, and the ranks are shared by all the hole cards
+void batchStrength(Card potCards[5]){
+    int board[5];
+    for (int i = 0; i < 5; i++) board[i] = cardIndex(potCards[i]);
+    BoardCache *cache = malloc(sizeof(BoardCache));
+    fillBoardCache(cache, board);
+
+    const int maxLength = 64;
+    char line[maxLength];
+    while (fgets(line, maxLength, stdin) != NULL){
+        //A line too long for the buffer is invalid, and the rest of it is skipped
+        bool tooLong = false;
+        if (strchr(line, '\n') == NULL){
+            for (int c = getchar(); c != '\n' && c != EOF; c = getchar()) tooLong = true;
+        }
+        //The order the elements of an initialiser are evaluated in is unspecified, so the tokens are read one by one
+        char *args[4] = {""};
+        args[1] = strtok(line, " \t\r\n");
+        args[2] = strtok(NULL, " \t\r\n");
+        args[3] = strtok(NULL, " \t\r\n");
+        if (args[1] == NULL && !tooLong) continue;
+        Card handCards[2];
+        Card cards[7];
+        bool validArgs = !tooLong && args[2] != NULL && args[3] == NULL;
+        validArgs = validArgs && parseCard(3, args, 1, 0, handCards) && parseCard(3, args, 2, 1, handCards);
+        concatArray(cards, 2, handCards, 5, potCards);
+        if (!validArgs || !cardsDistinct(7, cards)){
+            printf("Invalid arguments\n");
+            continue;
+        }
+        Equity equity = checkCachedOpponents(cache, cardIndex(handCards[0]), cardIndex(handCards[1]));
+        printf("%s %s\n", args[1], args[2]);
+        displayResult(equity.wins, equity.trials, equity.ties);
+    }
+    free(cache);
+}
+
+//Calculates the strength of many hole cards on a user-provided board
+//Takes "--batch" then the 5 community cards, and reads the hole cards from standard input
+void userBatch(int argNum, char *args[argNum]){
+    const int offset = 2;
+    const int potCardsSize = 5;
+    Card potCards[potCardsSize];
+    bool validArgs = true;
+    for (int i = 0; (i < potCardsSize) && (validArgs); i++){
+        validArgs = parseCard(argNum, args, i + offset, i, potCards);
+    }
+    if (validArgs && cardsDistinct(potCardsSize, potCards)) batchStrength(potCards);
+    else printf("Invalid arguments\n");
+}
+
+//Calculates the equity of one range against another, on a user-provided board
+//Takes "--range HERO VILLAIN" then the community cards known so far (none, 3, 4 or 5)
+void userRange(int argNum, char *args[argNum]){
+    const int offset = 4;
+    const int boardSize = argNum - offset;
+    Card potCards[5];
+    bool validArgs = boardSize == 0 || boardSize == 3 || boardSize == 4 || boardSize == 5;
+    for (int i = 0; (i < boardSize) && (validArgs); i++){
+        validArgs = parseCard(argNum, args, i + offset, i, potCards);
+    }
+    Range *hero = malloc(sizeof(Range));
+    Range *villain = malloc(sizeof(Range));
+    if (validArgs && cardsDistinct(boardSize, potCards) && parseRange(hero, args[2]) && parseRange(villain, args[3])){
+        RangeJob *job = malloc(sizeof(RangeJob));
+        rangeEquity(job, hero, villain, potCards, boardSize, processorCount());
+        displayRangeResult(job);
+        free(job);
+    }
+    else printf("Invalid arguments\n");
+    free(hero);
+    free(villain);
+}
+
+//Calculates the strength of a user-provided set of cards against several opponents
+//Takes "--opponents N", optionally "--margin M" (the confidence interval wanted, in percent) or "--exact", then the cards as userHand does
+void userMultiway(int argNum, char *args[argNum]){
+    const int handCardsSize = 2;
+    const int potCardsSize = 5;
+    const int opponents = atoi(args[2]);
+    double margin = 0.1;
+    bool exact = false;
+    int shift = 2;
+    if (argNum > 4 && strcmp(args[3], "--margin") == 0){
+        margin = atof(args[4]);
+        shift = 4;
+    }
+    else if (strcmp(args[3], "--exact") == 0){
+        exact = true;
+        shift = 3;
+    }
+    const int boardSize = argNum - shift - 1 - handCardsSize;
+    Card handCards[handCardsSize];
+    Card potCards[potCardsSize];
+    bool validBoard = boardSize == 0 || boardSize == 3 || boardSize == 4 || boardSize == 5;
+    if (opponents < 1 || opponents > MaxOpponents || margin <= 0 || !validBoard) printf("Invalid arguments\n");
+    else if (parseHand(handCards, potCards, boardSize, argNum - shift, args + shift)){
+        if (exact && exactDealCount(boardSize, opponents) > MaxExactDeals){
+            printf("Too many deals to play exactly (%.3g, the limit is %.3g), leave out --exact for an estimate\n", exactDealCount(boardSize, opponents), MaxExactDeals);
+        }
+        else if (exact) exactMultiwayStrength(handCards, potCards, boardSize, opponents);
+        else multiwayStrength(handCards, potCards, boardSize, opponents, margin / 100);
+    }
+    else printf("Invalid arguments\n");
+}
+
+//Seconds since an arbitrary point, for timing
+double seconds(){
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+//Calls %visit% with the key and bits of every 7 card hand, adding one card's key and bits at each level of the loops
+//Returns the sum of the packed ranks, so that the work can't be optimised away
+long long eachHand(Strength (*visit)(uint64_t key, CardSet bits, const int cards[7])){
+    const uint64_t *keys = evaluator.cardKeys;
+    const CardSet *bits = evaluator.cardBits;
+    long long total = 0;
+    int c[7];
+    for (c[0] = 0; c[0] < 46; c[0]++){
+        const uint64_t k0 = flushBias + keys[c[0]], b0 = bits[c[0]];
+        for (c[1] = c[0] + 1; c[1] < 47; c[1]++){
+            const uint64_t k1 = k0 + keys[c[1]], b1 = b0 | bits[c[1]];
+            for (c[2] = c[1] + 1; c[2] < 48; c[2]++){
+                const uint64_t k2 = k1 + keys[c[2]], b2 = b1 | bits[c[2]];
+                for (c[3] = c[2] + 1; c[3] < 49; c[3]++){
+                    const uint64_t k3 = k2 + keys[c[3]], b3 = b2 | bits[c[3]];
+                    for (c[4] = c[3] + 1; c[4] < 50; c[4]++){
+                        const uint64_t k4 = k3 + keys[c[4]], b4 = b3 | bits[c[4]];
+                        for (c[5] = c[4] + 1; c[5] < 51; c[5]++){
+                            const uint64_t k5 = k4 + keys[c[5]], b5 = b4 | bits[c[5]];
+                            for (c[6] = c[5] + 1; c[6] < 52; c[6]++){
+                                total += visit(k5 + keys[c[6]], b5 | bits[c[6]], c);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return total;
+}
+
+//Ranks a hand from its key and bits alone
+Strength visitRank(uint64_t key, CardSet bits, const int cards[7]){
+    return rankFromKey(key, bits);
+}
+
+//Ranks the hands numbered %first% up to %end% (the ranks of their cards' indices) with both evaluators, counting the hands where they disagree
+void compareChunk(const void *context, long long first, long long end, void *tally){
+    long long *mismatches = tally;
+    uint64_t combination = unrankCombination(first, 7);
+    for (long long number = first; number < end; number++){
+        int cards[7];
+        combinationPointers(combination, cards);
+        Card hand[7];
+        uint64_t key = flushBias;
+        CardSet bits = 0;
+        for (int i = 0; i < 7; i++){
+            hand[i] = indexCard(cards[i]);
+            key += evaluator.cardKeys[cards[i]];
+            bits |= evaluator.cardBits[cards[i]];
+        }
+        if (rankFromKey(key, bits) != bestRankFromFullHand(hand)) (*mismatches)++;
+        combination = nextCombination(combination);
+    }
+}
+
+//Adds one thread's count to the total
+void mergeCount(void *result, const void *tally){
+    *(long long *) result += *(const long long *) tally;
+}
+
+//Compares the table driven evaluator with bestRankFromFullHand on all 133784560 hands, with a thread for each processor
+void validateEvaluator(){
+    double start = seconds();
+    initialiseEvaluator();
+    initialiseBinomials();
+    printf("Tables built in %.3f s\n", seconds() - start);
+    start = seconds();
+    long long mismatches = 0;
+    enumerate(binomials[52][7], processorCount(), NULL, compareChunk, sizeof(long long), &mismatches, mergeCount);
+    printf("%lld mismatches in 133784560 hands (%.1f s)\n", mismatches, seconds() - start);
+}
+
+//Times the table driven evaluator over every hand in order, and over random hands which spread the lookups over the tables
+void benchEvaluator(){
+    //The random hands fit in cache, so that the time is the evaluator's rather than memory's
+    const int handCount = 1 << 16;
+    const int repeats = 512;
+    double start = seconds();
+    initialiseEvaluator();
+    printf("Tables built in %.3f s\n", seconds() - start);
+
+    start = seconds();
+    long long total = eachHand(visitRank);
+    double elapsed = seconds() - start;
+    printf("Every hand:   %.1f M evaluations/s (checksum %lld)\n", 133784560 / elapsed * 1e-6, total);
+
+    //Hands are drawn with a partial shuffle of the deck from a fixed seed, so every run times the same hands
+    int (*hands)[7] = malloc(sizeof(int[7]) * handCount);
+    int deck[52];
+    for (int i = 0; i < 52; i++) deck[i] = i;
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (int n = 0; n < handCount; n++){
+        for (int i = 0; i < 7; i++){
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            const int j = i + (int) ((state >> 33) % (52 - i));
+            const int swap = deck[i];
+            deck[i] = deck[j];
+            deck[j] = swap;
+            hands[n][i] = deck[i];
+        }
+    }
+    total = 0;
+    start = seconds();
+    for (int repeat = 0; repeat < repeats; repeat++){
+        for (int n = 0; n < handCount; n++) total += evaluateIndices(hands[n]);
+    }
+    elapsed = seconds() - start;
+    printf("Random hands: %.1f M evaluations/s (checksum %lld)\n", (double) handCount * repeats / elapsed * 1e-6, total);
+    free(hands);
+}
+
+enum {ScalingWorkloads = 4};
+
+//Runs one of the scaling benchmark's workloads on %threadCount% threads, filling %totals% with its wins, ties and trials
+void runWorkload(int workload, int threadCount, double totals[3]){
+    Card handCards[2] = {{A,'H'},{K,'D'}};
+    Card potCards[5] = {{J,'S'},{10,'C'},{4,'H'},{8,'D'},{2,'S'}};
+    if (workload == 0){
+        Equity equity = calculateEquity(handCards, potCards, 0, threadCount);
+        totals[0] = equity.wins;
+        totals[1] = equity.ties;
+        totals[2] = equity.trials;
+    }
+    else if (workload < 3){
+        //The flop against 2 opponents, then the river against 3
+        Showdowns showdowns = exactMultiwayEquity(handCards, potCards, workload == 1 ? 3 : 5, workload + 1, threadCount);
+        totals[0] = showdowns.equity.wins;
+        totals[1] = showdowns.equity.ties;
+        totals[2] = showdowns.equity.trials;
+    }
+    else {
+        Range *hero = malloc(sizeof(Range));
+        Range *villain = malloc(sizeof(Range));
+        RangeJob *job = malloc(sizeof(RangeJob));
+        parseRange(hero, "JJ+,AKs,KQo");
+        parseRange(villain, "22+,A2s+,KTo+");
+        rangeEquity(job, hero, villain, potCards, 0, threadCount);
+        rangeTotals(job, -1, &totals[0], &totals[1], &totals[2]);
+        free(job);
+        free(hero);
+        free(villain);
+    }
+}
+
+//Times exhaustive calculations on 1, 2, 4 ... threads up to %maxThreads%, checking that every thread count gives the same totals
+void benchScaling(int maxThreads){
+    const char *names[ScalingWorkloads] = {"Pre-flop, 1 opponent", "Flop, 2 opponents", "River, 3 opponents", "Pre-flop, range against range"};
+    initialiseEvaluator();
+    printf("%d processors\n", processorCount());
+    for (int workload = 0; workload < ScalingWorkloads; workload++){
+        printf("%s\n", names[workload]);
+        double expected[3];
+        double baseline = 0;
+        for (int threads = 1; threads <= maxThreads; threads = threads < maxThreads && threads * 2 > maxThreads ? maxThreads : threads * 2){
+            double totals[3];
+            const double start = seconds();
+            runWorkload(workload, threads, totals);
+            const double elapsed = seconds() - start;
+            if (threads == 1){
+                memcpy(expected, totals, sizeof(expected));
+                baseline = elapsed;
+            }
+            const bool same = memcmp(expected, totals, sizeof(expected)) == 0;
+            printf("%4d threads: %8.3f s  %6.2fx%s\n", threads, elapsed, baseline / elapsed, same ? "" : "  totals differ from 1 thread");
+            if (threads == maxThreads) break;
+        }
+    }
+}
+
 //Test the permutation generation functionality
 void testPermutations(){
     const int deckLength = 52;
-    Card deck[deckLength];
-    initialiseDeck(deckLength, deck);
-
     const int subsetLength = 7;
-    int pointers[subsetLength];
-    initialisePointers(subsetLength, pointers);
+    const uint64_t end = 1ULL << deckLength;
 
-    int counter = 1;
-    while (pointers[0] < (deckLength - subsetLength)){
-        incrementPointers(pointers, subsetLength - 1, deckLength);
-        counter++;
-    }
+    int counter = 0;
+    for (uint64_t combination = (1ULL << subsetLength) - 1; combination < end; combination = nextCombination(combination)) counter++;
 
     //Checks that the known number of 7 card permutations from a 52 card deck are generated
     // 52!/((7!)(52 - 7)!) = 133784560 permutations
     assert(counter == 133784560);
+
+    //The iterative pointer stepping still generates every permutation, checked on a smaller subset
+    const int smallLength = 3;
+    int pointers[smallLength];
+    initialisePointers(smallLength, pointers);
+    counter = 1;
+    while (pointers[0] < (deckLength - smallLength)){
+        incrementPointers(pointers, smallLength - 1, deckLength);
+        counter++;
+    }
+    assert(counter == 22100);
+}
+
+//Tests ranking and unranking combinations
+void testCombinations(){
+    initialiseBinomials();
+    assert(binomials[52][7] == 133784560 && binomials[52][5] == 2598960 && binomials[45][2] == 990);
+
+    //Consecutive combinations have consecutive ranks, and unranking gives the combination back
+    uint64_t combination = (1ULL << 5) - 1;
+    for (long long rank = 0; rank < 100000; rank++){
+        assert(rankCombination(combination) == rank);
+        assert(unrankCombination(rank, 5) == combination);
+        combination = nextCombination(combination);
+    }
+
+    //The last combination has the last rank
+    const uint64_t last = ((1ULL << 7) - 1) << 45;
+    assert(rankCombination(last) == 133784560 - 1 && unrankCombination(133784560 - 1, 7) == last);
+    assert(nextCombination(last) >= 1ULL << 52);
+
+    //Ranks spread over the whole range round trip
+    for (long long rank = 0; rank < 133784560; rank += 1234567){
+        combination = unrankCombination(rank, 7);
+        assert(__builtin_popcountll(combination) == 7 && rankCombination(combination) == rank);
+        int pointers[7];
+        combinationPointers(combination, pointers);
+        for (int i = 1; i < 7; i++) assert(pointers[i] > pointers[i - 1]);
+    }
 }
 
 //Tests the card removal functionality
@@ -397,92 +2144,500 @@ void testRemoveCards(){
     //Perform visual inspection - new deck should be missing 10H and 10S
 }
 
+//Tests the bitboard card sets
+void testCardSets(){
+    for (int index = 0; index < 52; index++){
+        assert(cardBit(indexCard(index)) == indexBit(index));
+        assert(lowestIndex(indexBit(index)) == index);
+    }
+    assert(setSize(fullDeckSet()) == 52);
+
+    Card hand[5] = {{A,'S'},{K,'S'},{Q,'S'},{J,'S'},{10,'S'}};
+    CardSet set = cardsToSet(5, hand);
+    assert(setSize(set) == 5 && suitValues(set, 1) == 0x1F00 && suitValues(set, 0) == 0);
+    assert(checkFlush(set) && checkStraight(setValues(set)) == A);
+    hand[0].suit = 'D';
+    set = cardsToSet(5, hand);
+    assert(!checkFlush(set) && checkStraight(setValues(set)) == A);
+    assert(checkStraight(0x100F) == 5 && checkStraight(0x1F) == 6 && checkStraight(0x101F) == 0 && checkStraight(0x1017) == 0);
+
+    //Removed cards are left out and the rest keep their order
+    Card deck[52];
+    initialiseDeck(52, deck);
+    Card removed[3] = {{2,'H'},{K,'C'},{A,'D'}};
+    Card freeCards[49];
+    removeCardsFromDeck(3, removed, 52, deck, freeCards);
+    const CardSet removedSet = cardsToSet(3, removed);
+    for (int i = 0; i < 49; i++){
+        assert(!(cardBit(freeCards[i]) & removedSet));
+        if (i > 0) assert(cardIndex(freeCards[i]) > cardIndex(freeCards[i - 1]));
+    }
+    assert(cardsToSet(49, freeCards) == (fullDeckSet() & ~removedSet));
+}
+
 //Tests the hand strength classifier on examples for all hand types
 void testBestRank(){
 
     Card handCards1[5] = {{6,'H'},{4,'H'},{5,'H'},{J,'H'},{8,'C'}};
-    Rank strength = bestRank(handCards1);
-    assert(strength.type == HighCard && strength.cardValue == 11);
+    Strength strength = bestRank(handCards1);
+    assert(strengthType(strength) == HighCard && strengthCardValue(strength, 0) == 11);
 
     Card handCards2[5] = {{6,'H'},{4,'H'},{4,'C'},{J,'H'},{8,'C'}};
     strength = bestRank(handCards2);
-    assert(strength.type == Pair && strength.cardValue == 4);
+    assert(strengthType(strength) == Pair && strengthCardValue(strength, 0) == 4);
 
     Card handCards3[5] = {{6,'H'},{4,'H'},{4,'C'},{6,'S'},{8,'C'}};
     strength = bestRank(handCards3);
-    assert(strength.type == TwoPair && strength.cardValue == 6);
+    assert(strengthType(strength) == TwoPair && strengthCardValue(strength, 0) == 6);
 
     Card handCards4[5] = {{7,'H'},{4,'H'},{7,'C'},{7,'S'},{8,'C'}};
     strength = bestRank(handCards4);
-    assert(strength.type == ThreeOfAKind && strength.cardValue == 7);
+    assert(strengthType(strength) == ThreeOfAKind && strengthCardValue(strength, 0) == 7);
 
     Card handCards5[5] = {{4,'H'},{5,'H'},{6,'C'},{7,'S'},{8,'C'}};
     strength = bestRank(handCards5);
-    assert(strength.type == Straight && strength.cardValue == 8);
+    assert(strengthType(strength) == Straight && strengthCardValue(strength, 0) == 8);
 
     Card handCards6[5] = {{7,'H'},{4,'H'},{3,'H'},{J,'H'},{8,'H'}};
     strength = bestRank(handCards6);
-    assert(strength.type == Flush && strength.cardValue == 11);
+    assert(strengthType(strength) == Flush && strengthCardValue(strength, 0) == 11);
 
     Card handCards7[5] = {{3,'H'},{4,'H'},{3,'C'},{3,'S'},{4,'C'}};
     strength = bestRank(handCards7);
-    assert(strength.type == FullHouse && strength.cardValue == 3);
+    assert(strengthType(strength) == FullHouse && strengthCardValue(strength, 0) == 3);
 
     Card handCards8[5] = {{Q,'H'},{4,'H'},{Q,'C'},{Q,'S'},{Q,'D'}};
     strength = bestRank(handCards8);
-    assert(strength.type == FourOfAKind && strength.cardValue == 12);
+    assert(strengthType(strength) == FourOfAKind && strengthCardValue(strength, 0) == 12);
 
     Card handCards9[5] = {{7,'H'},{8,'H'},{9,'H'},{10,'H'},{J,'H'}};
     strength = bestRank(handCards9);
-    assert(strength.type == StraightFlush && strength.cardValue == 11);
+    assert(strengthType(strength) == StraightFlush && strengthCardValue(strength, 0) == 11);
+
+    //The ace counts low in a straight to the 5
+    Card handCards10[5] = {{A,'H'},{2,'C'},{3,'H'},{4,'S'},{5,'D'}};
+    strength = bestRank(handCards10);
+    assert(strengthType(strength) == Straight && strengthCardValue(strength, 0) == 5);
+    assert(strength < bestRank(handCards5));
+
+    //Kickers are kept in order of importance
+    strength = bestRank(handCards3);
+    assert(strengthCardValue(strength, 1) == 4 && strengthCardValue(strength, 2) == 8 && strengthCardValue(strength, 3) == 0);
+    strength = bestRank(handCards6);
+    assert(strengthCardValue(strength, 1) == 8 && strengthCardValue(strength, 4) == 3);
+
+}
 
+//Tests that hands of the same rank are decided by their kickers
+void testKickers(){
+    //Pair of 4s with a king beats a pair of 4s with a jack
+    Card pairKing[5] = {{4,'H'},{4,'C'},{K,'H'},{8,'C'},{6,'S'}};
+    Card pairJack[5] = {{4,'S'},{4,'D'},{J,'H'},{8,'D'},{6,'D'}};
+    assert(bestRank(pairKing) > bestRank(pairJack));
+
+    //Two pair with the same top pair is decided by the second pair, then the last card
+    Card twoPairSixes[5] = {{9,'H'},{9,'C'},{6,'H'},{6,'C'},{2,'S'}};
+    Card twoPairFives[5] = {{9,'S'},{9,'D'},{5,'H'},{5,'C'},{A,'S'}};
+    Card twoPairSixesAce[5] = {{9,'S'},{9,'D'},{6,'S'},{6,'D'},{A,'D'}};
+    assert(bestRank(twoPairSixes) > bestRank(twoPairFives));
+    assert(bestRank(twoPairSixesAce) > bestRank(twoPairSixes));
+
+    //Flushes with the same high card are decided by the next highest card
+    Card flushNine[5] = {{K,'H'},{9,'H'},{7,'H'},{4,'H'},{2,'H'}};
+    Card flushEight[5] = {{K,'S'},{8,'S'},{7,'S'},{5,'S'},{3,'S'}};
+    assert(bestRank(flushNine) > bestRank(flushEight));
+
+    //Full houses with the same three of a kind are decided by the pair
+    Card fullNines[5] = {{3,'H'},{3,'C'},{3,'S'},{9,'H'},{9,'C'}};
+    Card fullFours[5] = {{3,'H'},{3,'C'},{3,'D'},{4,'H'},{4,'C'}};
+    assert(bestRank(fullNines) > bestRank(fullFours));
+
+    //Identical values in different suits tie
+    Card highHearts[5] = {{A,'H'},{Q,'S'},{9,'H'},{7,'H'},{3,'H'}};
+    Card highClubs[5] = {{A,'C'},{Q,'C'},{9,'D'},{7,'C'},{3,'C'}};
+    assert(bestRank(highHearts) == bestRank(highClubs));
+
+    //With 7 cards the 2 best kickers play, so a lower 6th card doesn't matter
+    Card handQueen[7] = {{Q,'H'},{2,'S'},{A,'H'},{K,'C'},{8,'S'},{8,'D'},{3,'C'}};
+    Card handQueenFour[7] = {{Q,'D'},{4,'S'},{A,'H'},{K,'C'},{8,'S'},{8,'D'},{3,'C'}};
+    Card handJack[7] = {{J,'D'},{4,'H'},{A,'H'},{K,'C'},{8,'S'},{8,'D'},{3,'C'}};
+    assert(evaluateHand(handQueen) > evaluateHand(handJack));
+    assert(evaluateHand(handQueen) == evaluateHand(handQueenFour));
 }
 
 //Tests the 7 card hand strength classifier on examples
 void testBestRankFromFullHand() {
     Card fullHand1[7] = {{6,'H'},{4,'H'},{5,'H'},{K,'H'},{8,'C'},{2,'S'},{J,'D'}};
-    Rank strength = bestRankFromFullHand(fullHand1);
-    assert(strength.type == HighCard && strength.cardValue == K);
+    Strength strength = bestRankFromFullHand(fullHand1);
+    assert(strengthType(strength) == HighCard && strengthCardValue(strength, 0) == K);
 
     Card fullHand2[7] = {{6,'H'},{4,'H'},{5,'H'},{J,'H'},{8,'C'},{4,'S'},{2,'D'}};
     strength = bestRankFromFullHand(fullHand2);
-    assert(strength.type == Pair && strength.cardValue == 4);
+    assert(strengthType(strength) == Pair && strengthCardValue(strength, 0) == 4);
 
     Card fullHand3[7] = {{2,'H'},{4,'H'},{5,'H'},{7,'H'},{8,'C'},{4,'S'},{7,'D'}};
     strength = bestRankFromFullHand(fullHand3);
-    assert(strength.type == TwoPair && strength.cardValue == 7);
+    assert(strengthType(strength) == TwoPair && strengthCardValue(strength, 0) == 7);
 
     Card fullHand4[7] = {{6,'H'},{4,'H'},{5,'H'},{J,'H'},{8,'C'},{J,'S'},{J,'D'}};
     strength = bestRankFromFullHand(fullHand4);
-    assert(strength.type == ThreeOfAKind && strength.cardValue == J);
+    assert(strengthType(strength) == ThreeOfAKind && strengthCardValue(strength, 0) == J);
 
     Card fullHand5[7] = {{4,'H'},{2,'H'},{5,'H'},{3,'H'},{6,'C'},{J,'S'},{J,'D'}};
     strength = bestRankFromFullHand(fullHand5);
-    assert(strength.type == Straight && strength.cardValue == 6);
+    assert(strengthType(strength) == Straight && strengthCardValue(strength, 0) == 6);
 
     Card fullHand6[7] = {{4,'H'},{2,'H'},{5,'H'},{3,'H'},{6,'C'},{J,'H'},{J,'D'}};
     strength = bestRankFromFullHand(fullHand6);
-    assert(strength.type == Flush && strength.cardValue == J);
+    assert(strengthType(strength) == Flush && strengthCardValue(strength, 0) == J);
 
     Card fullHand7[7] = {{4,'H'},{4,'D'},{5,'H'},{3,'H'},{5,'C'},{J,'H'},{5,'D'}};
     strength = bestRankFromFullHand(fullHand7);
-    assert(strength.type == FullHouse && strength.cardValue == 5);
+    assert(strengthType(strength) == FullHouse && strengthCardValue(strength, 0) == 5);
 
     Card fullHand8[7] = {{3,'S'},{3,'C'},{5,'H'},{3,'H'},{6,'C'},{J,'H'},{3,'D'}};
     strength = bestRankFromFullHand(fullHand8);
-    assert(strength.type == FourOfAKind && strength.cardValue == 3);
+    assert(strengthType(strength) == FourOfAKind && strengthCardValue(strength, 0) == 3);
 
     Card fullHand9[7] = {{J,'D'},{8,'D'},{9,'D'},{3,'H'},{2,'D'},{Q,'D'},{10,'D'}};
     strength = bestRankFromFullHand(fullHand9);
-    assert(strength.type == StraightFlush && strength.cardValue == Q);
+    assert(strengthType(strength) == StraightFlush && strengthCardValue(strength, 0) == Q);
+}
+
+//Tests the table driven evaluator against bestRankFromFullHand
+void testEvaluator(){
+    initialiseEvaluator();
+
+    //The largest key (4 aces and 3 kings) is within the row table
+    assert(valueKeys[12] * 4 + valueKeys[11] * 3 == MaxValueKey);
+
+    //The examples from testBestRankFromFullHand
+    Card fullHand[7] = {{J,'D'},{8,'D'},{9,'D'},{3,'H'},{2,'D'},{Q,'D'},{10,'D'}};
+    Strength strength = evaluateHand(fullHand);
+    assert(strengthType(strength) == StraightFlush && strengthCardValue(strength, 0) == Q);
+
+    Card fullHand2[7] = {{4,'H'},{4,'D'},{5,'H'},{3,'H'},{5,'C'},{J,'H'},{5,'D'}};
+    strength = evaluateHand(fullHand2);
+    assert(strengthType(strength) == FullHouse && strengthCardValue(strength, 0) == 5);
+
+    Card fullHand3[7] = {{4,'H'},{2,'H'},{5,'H'},{3,'H'},{6,'C'},{J,'H'},{J,'D'}};
+    strength = evaluateHand(fullHand3);
+    assert(strengthType(strength) == Flush && strengthCardValue(strength, 0) == J);
+
+    Card fullHand4[7] = {{6,'H'},{4,'H'},{5,'H'},{K,'H'},{8,'C'},{2,'S'},{J,'D'}};
+    strength = evaluateHand(fullHand4);
+    assert(strengthType(strength) == HighCard && strengthCardValue(strength, 0) == K);
+
+    //Random hands from a fixed seed agree with the original evaluator
+    int deck[52];
+    for (int i = 0; i < 52; i++) deck[i] = i;
+    srand(17);
+    for (int n = 0; n < 100000; n++){
+        Card hand[7];
+        int cards[7];
+        for (int i = 0; i < 7; i++){
+            const int j = i + rand() % (52 - i);
+            const int swap = deck[i];
+            deck[i] = deck[j];
+            deck[j] = swap;
+            cards[i] = deck[i];
+            hand[i] = indexCard(cards[i]);
+            assert(cardIndex(hand[i]) == cards[i]);
+        }
+        assert(evaluateIndices(cards) == bestRankFromFullHand(hand));
+    }
+}
+
+//Tests the equity calculation on each street against simpler calculations
+void testEquity(){
+    Card handCards[2] = {{4,'H'},{10,'S'}};
+    Card potCards[5] = {{5,'C'},{J,'D'},{3,'H'},{K,'S'},{A,'C'}};
+
+    //On the river every opponent hand is played once, as the original evaluator would
+    Equity river = calculateEquity(handCards, potCards, 5, 1);
+    Card playerCards[7];
+    concatArray(playerCards, 2, handCards, 5, potCards);
+    Card fullDeck[52];
+    initialiseDeck(52, fullDeck);
+    Card deck[45];
+    removeCardsFromDeck(7, playerCards, 52, fullDeck, deck);
+    const Strength playerRank = bestRankFromFullHand(playerCards);
+    int wins = 0;
+    int ties = 0;
+    for (int i = 0; i < 45; i++){
+        for (int j = i + 1; j < 45; j++){
+            Card opponentCards[2] = {deck[i], deck[j]};
+            Card opponentFullHand[7];
+            concatArray(opponentFullHand, 2, opponentCards, 5, potCards);
+            const Strength opponentRank = bestRankFromFullHand(opponentFullHand);
+            wins += playerRank > opponentRank;
+            ties += playerRank == opponentRank;
+        }
+    }
+    assert(river.trials == 990 && river.wins == wins && river.ties == ties);
+
+    //On the turn the totals are the sum of the totals for each river card
+    Equity turn = calculateEquity(handCards, potCards, 4, 1);
+    Equity rivers = {0, 0, 0};
+    Card riverCards[5] = {potCards[0], potCards[1], potCards[2], potCards[3]};
+    for (int card = 0; card < 52; card++){
+        riverCards[4] = indexCard(card);
+        Card allCards[7];
+        concatArray(allCards, 2, handCards, 5, riverCards);
+        if (!cardsDistinct(7, allCards)) continue;
+        Equity equity = calculateEquity(handCards, riverCards, 5, 1);
+        rivers.wins += equity.wins;
+        rivers.ties += equity.ties;
+        rivers.trials += equity.trials;
+    }
+    assert(turn.trials == 46 * 990 && turn.wins == rivers.wins && turn.ties == rivers.ties);
+
+    //Threads share out the runouts without changing the totals
+    Equity flop = calculateEquity(handCards, potCards, 3, 1);
+    Equity threadedFlop = calculateEquity(handCards, potCards, 3, 3);
+    assert(flop.trials == 1081 * 990 && flop.trials == threadedFlop.trials);
+    assert(flop.wins == threadedFlop.wins && flop.ties == threadedFlop.ties);
+
+    //A card can only be given once
+    Card repeated[5] = {{5,'C'},{J,'D'},{4,'H'},{K,'S'},{5,'C'}};
+    assert(!cardsDistinct(5, repeated));
+    assert(cardsDistinct(5, potCards));
+}
+
+//Tests that cards added to a board one at a time rank the same as a whole hand, and the board cache against the equity calculation
+void testBoardCache(){
+    initialiseEvaluator();
+    const int cards[7] = {cardIndex((Card) {J,'D'}), cardIndex((Card) {8,'D'}), cardIndex((Card) {9,'D'}), cardIndex((Card) {3,'H'}),
+        cardIndex((Card) {2,'D'}), cardIndex((Card) {Q,'D'}), cardIndex((Card) {10,'D'})};
+    BoardState board = emptyBoard();
+    for (int i = 0; i < 5; i++) board = addToBoard(board, cards[i]);
+    assert(rankHoleCards(&board, cards[5], cards[6]) == evaluateIndices(cards));
+    const BoardState withFirst = addToBoard(board, cards[5]);
+    assert(rankWithCard(&withFirst, cards[6]) == evaluateIndices(cards));
+
+    //Every pair of hole cards on the board gets the same result from the cache as from playing every opponent
+    Card potCards[5] = {{5,'C'},{J,'D'},{3,'H'},{K,'S'},{5,'H'}};
+    int boardCards[5];
+    for (int i = 0; i < 5; i++) boardCards[i] = cardIndex(potCards[i]);
+    BoardCache *cache = malloc(sizeof(BoardCache));
+    fillBoardCache(cache, boardCards);
+    assert(cache->below[cache->groupCount] == 1081);
+    for (int second = 1; second < 52; second++){
+        for (int first = 0; first < second; first += 3){
+            Card handCards[2] = {indexCard(first), indexCard(second)};
+            Card allCards[7];
+            concatArray(allCards, 2, handCards, 5, potCards);
+            if (!cardsDistinct(7, allCards)) continue;
+            Equity cached = checkCachedOpponents(cache, first, second);
+            Equity equity = calculateEquity(handCards, potCards, 5, 1);
+            assert(cached.wins == equity.wins && cached.ties == equity.ties && cached.trials == equity.trials);
+        }
+    }
+    free(cache);
+}
+
+//Tests the random number generator and the Monte Carlo equity against exact results
+void testMonteCarlo(){
+    //Random integers are in range and close to evenly spread
+    Random random;
+    seedRandom(&random, 1);
+    int counts[7] = {0};
+    for (int i = 0; i < 70000; i++){
+        const int value = randomBelow(&random, 7);
+        assert(value >= 0 && value < 7);
+        counts[value]++;
+    }
+    for (int i = 0; i < 7; i++) assert(counts[i] > 9500 && counts[i] < 10500);
+
+    //Against one opponent the estimate agrees with the exact equity
+    Card handCards[2] = {{4,'H'},{10,'S'}};
+    Card potCards[5] = {{5,'C'},{J,'D'},{3,'H'},{K,'S'},{A,'C'}};
+    Equity exact = calculateEquity(handCards, potCards, 3, 1);
+    const double exactShare = (exact.wins + exact.ties / 2.0) / exact.trials;
+    Simulation simulation = monteCarloEquity(handCards, potCards, 3, 1, 0.005, 10000000, 42, 1);
+    assert(confidenceMargin(&simulation) <= 0.005);
+    assert(fabs(simulation.potShare / simulation.equity.trials - exactShare) < 0.01);
+
+    //One thread with the same seed deals the same hands
+    Simulation repeat = monteCarloEquity(handCards, potCards, 3, 1, 0.005, 10000000, 42, 1);
+    assert(repeat.equity.trials == simulation.equity.trials && repeat.equity.wins == simulation.equity.wins);
+
+    //A royal flush beats every opponent, however many there are
+    Card royalHand[2] = {{A,'H'},{K,'H'}};
+    Card royalBoard[5] = {{Q,'H'},{J,'H'},{10,'H'},{2,'C'},{3,'D'}};
+    Simulation royal = monteCarloEquity(royalHand, royalBoard, 5, 9, 0.001, 1000000, 7, 2);
+    assert(royal.equity.trials >= MinMonteCarloTrials && royal.equity.wins == royal.equity.trials);
+
+    //Trials stop at the limit when the interval is out of reach
+    Simulation limited = monteCarloEquity(handCards, potCards, 0, 5, 0.00001, 20000, 3, 2);
+    assert(limited.equity.trials >= 20000 && limited.equity.trials < 20000 + 2 * MonteCarloBatch);
+}
+
+//Counts and adds up the case numbers visited, to check that an enumeration visits each case once
+void countChunk(const void *context, long long first, long long end, void *tally){
+    long long *counts = tally;
+    for (long long number = first; number < end; number++){
+        counts[0]++;
+        counts[1] += number;
+    }
+}
+
+//Adds one thread's case counts to the total
+void mergeCounts(void *result, const void *tally){
+    long long *total = result;
+    const long long *counts = tally;
+    total[0] += counts[0];
+    total[1] += counts[1];
+}
+
+//Tests that enumerations visit every case once on any number of threads, and the exact calculation against several opponents
+void testEnumeration(){
+    const long long caseCounts[4] = {0, 3, 1000, 123457};
+    const int threadCounts[3] = {1, 7, 300};
+    for (int i = 0; i < 4; i++){
+        for (int j = 0; j < 3; j++){
+            long long total[2] = {0, 0};
+            enumerate(caseCounts[i], threadCounts[j], NULL, countChunk, sizeof(total), total, mergeCounts);
+            assert(total[0] == caseCounts[i] && total[1] == caseCounts[i] * (caseCounts[i] - 1) / 2);
+        }
+    }
+
+    //Against one opponent the showdowns are the equity calculation's
+    Card handCards[2] = {{4,'H'},{10,'S'}};
+    Card potCards[5] = {{5,'C'},{J,'D'},{3,'H'},{K,'S'},{A,'C'}};
+    Equity equity = calculateEquity(handCards, potCards, 4, 1);
+    Showdowns single = exactMultiwayEquity(handCards, potCards, 4, 1, 2);
+    assert(single.equity.trials == equity.trials && single.equity.wins == equity.wins && single.equity.ties == equity.ties);
+    assert(single.splits[2] == equity.ties);
+
+    //Against two opponents on the river, each pair of opponent hands is played once, however many threads share them
+    Showdowns pair = exactMultiwayEquity(handCards, potCards, 5, 2, 1);
+    Showdowns threadedPair = exactMultiwayEquity(handCards, potCards, 5, 2, 3);
+    assert(memcmp(&pair, &threadedPair, sizeof(Showdowns)) == 0);
+    assert(single.equity.trials == exactDealCount(4, 1) && pair.equity.trials == exactDealCount(5, 2));
+    assert(exactDealCount(5, 3) == 122175900 && exactDealCount(0, MaxOpponents) > MaxExactDeals);
+
+    //Dealing the two opponents in order plays each pair of hands twice
+    BoardState board = emptyBoard();
+    for (int i = 0; i < 5; i++) board = addToBoard(board, cardIndex(potCards[i]));
+    const Strength playerRank = rankHoleCards(&board, cardIndex(handCards[0]), cardIndex(handCards[1]));
+    int deck[45];
+    int deckSize = 0;
+    for (CardSet rest = fullDeckSet() & ~board.bits & ~(cardBit(handCards[0]) | cardBit(handCards[1])); rest != 0; rest &= rest - 1) deck[deckSize++] = lowestIndex(rest);
+    Strength ranks[45][45];
+    for (int i = 0; i < deckSize; i++){
+        for (int j = i + 1; j < deckSize; j++) ranks[i][j] = rankHoleCards(&board, deck[i], deck[j]);
+    }
+    Showdowns ordered = {{0, 0, 0}};
+    for (int a = 0; a < deckSize; a++){
+        for (int b = a + 1; b < deckSize; b++){
+            for (int c = 0; c < deckSize; c++){
+                for (int d = c + 1; d < deckSize; d++){
+                    if (c == a || c == b || d == a || d == b) continue;
+                    const Strength best = ranks[a][b] > ranks[c][d] ? ranks[a][b] : ranks[c][d];
+                    ordered.equity.trials++;
+                    if (playerRank > best) ordered.equity.wins++;
+                    else if (playerRank == best){
+                        ordered.equity.ties++;
+                        ordered.splits[ranks[a][b] == ranks[c][d] ? 3 : 2]++;
+                    }
+                }
+            }
+        }
+    }
+    assert(pair.equity.trials == 990 * 903 / 2 && 2 * pair.equity.trials == ordered.equity.trials);
+    assert(2 * pair.equity.wins == ordered.equity.wins && 2 * pair.equity.ties == ordered.equity.ties);
+    assert(2 * pair.splits[2] == ordered.splits[2] && 2 * pair.splits[3] == ordered.splits[3]);
+}
+
+//Number of pairs of cards in a range, counting weighted pairs as their weight
+double rangeSize(const Range *range){
+    long long size = 0;
+    for (int pair = 0; pair < PairCount; pair++) size += range->weights[pair];
+    return (double) size / RangeWeightUnit;
+}
+
+//Tests the range parser and the range against range equity
+void testRanges(){
+    Range *hero = malloc(sizeof(Range));
+    Range *villain = malloc(sizeof(Range));
+    RangeJob *job = malloc(sizeof(RangeJob));
+
+    assert(parseRange(hero, "JJ+,AKs,KQo") && rangeSize(hero) == 4 * 6 + 4 + 12);
+    assert(parseRange(hero, "A2s-A5s, 22-44") && rangeSize(hero) == 4 * 4 + 3 * 6);
+    assert(parseRange(hero, "ATs+,KJ") && rangeSize(hero) == 4 * 4 + 16);
+    assert(parseRange(hero, "AhKs,77:0.5") && rangeSize(hero) == 1 + 3);
+    assert(hero->weights[pairIndex(cardIndex((Card) {A,'H'}), cardIndex((Card) {K,'S'}))] == RangeWeightUnit);
+    assert(parseRange(hero, "AhKs:0.33333") && hero->weights[pairIndex(cardIndex((Card) {A,'H'}), cardIndex((Card) {K,'S'}))] == 3333);
+    assert(!parseRange(hero, "AK+x") && !parseRange(hero, "XY") && !parseRange(hero, "AKs:2") && !parseRange(hero, "AKs-QJs") && !parseRange(hero, ""));
+
+    char name[4];
+    className(classIndex(cardIndex((Card) {A,'H'}), cardIndex((Card) {K,'H'})), name);
+    assert(strcmp(name, "AKs") == 0);
+    className(classIndex(cardIndex((Card) {K,'S'}), cardIndex((Card) {A,'H'})), name);
+    assert(strcmp(name, "AKo") == 0);
+    className(classIndex(cardIndex((Card) {7,'S'}), cardIndex((Card) {7,'D'})), name);
+    assert(strcmp(name, "77") == 0);
+
+    //One pair against every pair gives the same totals as playing every opponent hand
+    Card handCards[2] = {{A,'H'},{A,'S'}};
+    Card potCards[5] = {{5,'C'},{J,'D'},{3,'H'},{K,'S'},{A,'C'}};
+    assert(parseRange(hero, "AhAs") && parseRange(villain, "22+,A2+,K2+,Q2+,J2+,T2+,92+,82+,72+,62+,52+,42+,32"));
+    assert(rangeSize(villain) == PairCount && !suitSymmetric(hero) && suitSymmetric(villain));
+    rangeEquity(job, hero, villain, potCards, 3, 2);
+    Equity equity = calculateEquity(handCards, potCards, 3, 1);
+    const int pair = pairIndex(cardIndex(handCards[0]), cardIndex(handCards[1]));
+    assert(job->wins[pair] == equity.wins * RangeWeightUnit && job->ties[pair] == equity.ties * RangeWeightUnit);
+    assert(job->trials[pair] == equity.trials * RangeWeightUnit);
+
+    //Weights that aren't whole give exactly the same totals on any number of threads
+    RangeJob *threaded = malloc(sizeof(RangeJob));
+    assert(parseRange(hero, "QQ,AK:0.5,T9s:0.3") && parseRange(villain, "22+:0.7,A2s+,KTo+:0.1"));
+    rangeEquity(job, hero, villain, potCards, 3, 1);
+    rangeEquity(threaded, hero, villain, potCards, 3, 3);
+    assert(memcmp(job->wins, threaded->wins, sizeof(job->wins)) == 0 && memcmp(job->ties, threaded->ties, sizeof(job->ties)) == 0);
+    assert(memcmp(job->trials, threaded->trials, sizeof(job->trials)) == 0);
+    free(threaded);
+
+    //Every board is counted once among the relabelled boards played
+    long long boards = 0;
+    int board[5];
+    for (board[0] = 0; board[0] < 52; board[0]++)
+    for (board[1] = board[0] + 1; board[1] < 52; board[1]++)
+    for (board[2] = board[1] + 1; board[2] < 52; board[2]++)
+    for (board[3] = board[2] + 1; board[3] < 52; board[3]++)
+    for (board[4] = board[3] + 1; board[4] < 52; board[4]++) boards += boardRelabellings(board);
+    assert(boards == 2598960);
+
+    //Aces against kings before the flop, which is a well known 81.95%
+    assert(parseRange(hero, "AA") && parseRange(villain, "KK"));
+    rangeEquity(job, hero, villain, potCards, 0, 2);
+    double wins;
+    double ties;
+    double trials;
+    assert(rangeTotals(job, -1, &wins, &ties, &trials) == 6);
+    assert(fabs((wins + ties / 2) / trials - 0.8195) < 0.0001);
+
+    free(job);
+    free(villain);
+    free(hero);
 }
 
 //Run automated testing
 void test(){
     testPermutations();
+    testCombinations();
     testRemoveCards();
+    testCardSets();
     testBestRank();
+    testKickers();
     testBestRankFromFullHand();
+    testEvaluator();
+    testEquity();
+    testBoardCache();
+    testMonteCarlo();
+    testEnumeration();
+    testRanges();
     printf("All tests passed\n");
 }
 
@@ -491,7 +2646,17 @@ void test(){
 int main(int argNum, char *args[argNum]){
     setbuf(stdout, NULL);
     if (argNum == 1) test();
-    else if (argNum == 8){
+    else if (argNum == 2 && strcmp(args[1], "--validate") == 0) validateEvaluator();
+    else if (argNum == 2 && strcmp(args[1], "--bench") == 0) benchEvaluator();
+    else if ((argNum == 2 || argNum == 3) && strcmp(args[1], "--scaling") == 0){
+        const int maxThreads = argNum == 3 ? atoi(args[2]) : processorCount();
+        if (maxThreads < 1 || maxThreads > MaxThreads) printf("Invalid arguments\n");
+        else benchScaling(maxThreads);
+    }
+    else if (argNum > 3 && strcmp(args[1], "--opponents") == 0) userMultiway(argNum, args);
+    else if (argNum > 3 && strcmp(args[1], "--range") == 0) userRange(argNum, args);
+    else if (argNum == 7 && strcmp(args[1], "--batch") == 0) userBatch(argNum, args);
+    else if (argNum == 3 || argNum == 6 || argNum == 7 || argNum == 8){
         userHand(argNum, args);
     } else printf("Invalid number of arguments provided\n");
 